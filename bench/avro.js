@@ -0,0 +1,116 @@
+var Avro = require('../lib/avro'),
+    Toji = require('../lib/index'),
+    H = require('./harness');
+
+exports.name = 'avro';
+exports.targets = targets;
+exports.run = run;
+
+
+// ## Avro ##
+
+// Encoding and decoding documents in both storage formats. Nothing
+// is stored, so there's a single target. The JSON cases are also run
+// with generated codecs turned off (see `Avro.compileCodecs()`) to
+// compare them with the interpreted loops.
+
+var BenchDocument = Toji.type('BenchDocument', {
+  id: Toji.ObjectId,
+  title: String,
+  created: Date,
+  score: Number,
+  tags: [String],
+  meta: {
+    votes: Number,
+    favs: Number
+  }
+});
+
+var SAMPLES = 100;
+
+function targets(options) {
+  return { none: null };
+}
+
+function run(bench, target, done) {
+  var ops = bench.options.ops,
+      rand = new H.Random(bench.options.seed),
+      objs = [],
+      binary = [],
+      json = [];
+
+  for (var i = 0; i < SAMPLES; i++) {
+    objs.push(new BenchDocument({
+      id: 'doc' + i,
+      title: rand.string(40),
+      created: new Date(1300000000000 + rand.int(1000000000)),
+      score: rand.int(1000) / 10,
+      tags: [rand.string(6), rand.string(6), rand.string(6)],
+      meta: { votes: rand.int(100), favs: rand.int(100) }
+    }));
+    binary.push(Avro.dumpBinary(objs[i]));
+    json.push(Avro.dumpJSON(objs[i]));
+  }
+
+  H.series([
+    function(next) {
+      bench.measure('encode binary', ops, function(i, next) {
+        Avro.dumpBinary(objs[i % SAMPLES]);
+        next();
+      }, { bytes: binary[0].length }, next);
+    },
+
+    function(next) {
+      bench.measure('decode binary', ops, function(i, next) {
+        Avro.loadBinary(BenchDocument, binary[i % SAMPLES]);
+        next();
+      }, next);
+    },
+
+    function(next) {
+      bench.measure('encode json', ops, function(i, next) {
+        Avro.dumpJSON(objs[i % SAMPLES]);
+        next();
+      }, { bytes: Buffer.byteLength(json[0]) }, next);
+    },
+
+    function(next) {
+      bench.measure('decode json', ops, function(i, next) {
+        Avro.loadJSON(BenchDocument, json[i % SAMPLES]);
+        next();
+      }, next);
+    },
+
+    function(next) {
+      bench.measure('validate', ops, function(i, next) {
+        BenchDocument.validate(objs[i % SAMPLES]);
+        next();
+      }, next);
+    },
+
+    function(next) {
+      Avro.compileCodecs(false);
+      bench.measure('encode json interpreted', ops, function(i, next) {
+        Avro.dumpJSON(objs[i % SAMPLES]);
+        next();
+      }, { bytes: Buffer.byteLength(json[0]) }, next);
+    },
+
+    function(next) {
+      bench.measure('decode json interpreted', ops, function(i, next) {
+        Avro.loadJSON(BenchDocument, json[i % SAMPLES]);
+        next();
+      }, next);
+    },
+
+    function(next) {
+      bench.measure('validate interpreted', ops, function(i, next) {
+        BenchDocument.validate(objs[i % SAMPLES]);
+        next();
+      }, function(err) {
+        Avro.compileCodecs(true);
+        next(err);
+      });
+    }
+  ], done);
+}
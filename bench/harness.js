@@ -0,0 +1,204 @@
+var Fs = require('fs');
+
+exports.Bench = Bench;
+exports.Random = Random;
+exports.series = series;
+exports.mkdir = mkdir;
+exports.now = now;
+
+
+// ## Bench ##
+
+// Runs cases one operation at a time and writes a JSON line for each
+// to `out`, so runs can be saved and compared. Latencies are in
+// milliseconds. When `db` is set, each result also carries that
+// database's native statistics for the case (see `KyotoDB.stats()`),
+// which are timed in microseconds even where `now()` isn't.
+//
+// Options:
+//
+//   + ops     - Number of operations per case
+//   + queries - Number of queries per query case
+//   + seed    - Number seed for generated data
+//   + dir     - String folder for database files
+
+function Bench(options, out) {
+  this.options = options;
+  this.out = out || process.stdout;
+  this.suite = null;
+  this.target = null;
+  this.db = null;
+}
+
+Bench.prototype.header = function(info) {
+  return this.write(info);
+};
+
+// Run `fn(i, next)` for `i` from zero up to `ops` and report it as
+// `name`. Any `extra` properties are added to the result.
+Bench.prototype.measure = function(name, ops, fn, extra, done) {
+  var self = this;
+
+  if (typeof extra == 'function') {
+    done = extra;
+    extra = undefined;
+  }
+
+  if (this.db)
+    this.db.stats(true);
+
+  timeOps(ops, fn, function(err, times, elapsed) {
+    if (err)
+      return done(err);
+
+    var result = {
+      suite: self.suite,
+      target: self.target,
+      'case': name,
+      ops: ops,
+      seconds: elapsed / 1000,
+      opsPerSec: elapsed > 0 ? ops * 1000 / elapsed : null,
+      latency: summarize(times)
+    };
+
+    for (var key in extra)
+      result[key] = extra[key];
+
+    if (self.db)
+      result['native'] = self.db.stats(true);
+
+    self.write(result);
+    done(null);
+  });
+
+  return this;
+};
+
+Bench.prototype.write = function(obj) {
+  this.out.write(JSON.stringify(obj) + '\n');
+  return this;
+};
+
+// Operations may call back synchronously (Avro encoding does), so
+// they're run from a loop instead of recursively.
+function timeOps(ops, fn, done) {
+  var times = new Array(ops),
+      index = 0,
+      start = now(),
+      began, inside, waiting, failed;
+
+  loop();
+
+  function loop() {
+    while (index < ops) {
+      inside = waiting = true;
+      began = now();
+      fn(index, finished);
+      inside = false;
+      if (waiting)
+        return;
+    }
+    done(null, times, now() - start);
+  }
+
+  function finished(err) {
+    if (failed)
+      return;
+    else if (err) {
+      failed = true;
+      return done(err);
+    }
+
+    times[index++] = now() - began;
+    waiting = false;
+    if (!inside)
+      loop();
+  }
+}
+
+function summarize(times) {
+  var sorted = times.slice(0).sort(function(a, b) { return a - b; }),
+      total = 0;
+
+  for (var i = 0, l = sorted.length; i < l; i++)
+    total += sorted[i];
+
+  return {
+    mean: sorted.length ? total / sorted.length : 0,
+    p50: percentile(sorted, 0.5),
+    p90: percentile(sorted, 0.9),
+    p99: percentile(sorted, 0.99),
+    p999: percentile(sorted, 0.999),
+    max: sorted.length ? sorted[sorted.length - 1] : 0
+  };
+}
+
+function percentile(sorted, q) {
+  if (sorted.length == 0)
+    return 0;
+  return sorted[Math.max(0, Math.ceil(q * sorted.length) - 1)];
+}
+
+// Milliseconds, with a fraction where the platform allows it.
+var now = process.hrtime
+  ? function() { var t = process.hrtime(); return t[0] * 1e3 + t[1] / 1e6; }
+  : function() { return Date.now(); };
+
+
+// ## Random ##
+
+// A seeded Park-Miller generator, so every run works on the same data.
+
+function Random(seed) {
+  this.state = (seed % 2147483646) + 1;
+}
+
+Random.prototype.next = function() {
+  this.state = (this.state * 16807) % 2147483647;
+  return this.state;
+};
+
+Random.prototype.int = function(limit) {
+  return this.next() % limit;
+};
+
+Random.prototype.pick = function(list) {
+  return list[this.int(list.length)];
+};
+
+Random.prototype.string = function(length) {
+  var chars = 'abcdefghijklmnopqrstuvwxyz0123456789',
+      result = '';
+
+  for (var i = 0; i < length; i++)
+    result += chars.charAt(this.int(chars.length));
+
+  return result;
+};
+
+
+// ## Helpers ##
+
+// Call each `step(next)` in turn, stopping at the first error.
+function series(steps, done) {
+  var index = 0;
+
+  next();
+
+  function next(err) {
+    if (err || index >= steps.length)
+      done(err);
+    else
+      steps[index++](next);
+  }
+}
+
+function mkdir(path) {
+  try {
+    Fs.mkdirSync(path, 0755);
+  } catch (x) {
+    if (x.code != 'EEXIST')
+      throw x;
+  }
+  return path;
+}
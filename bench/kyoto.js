@@ -0,0 +1,85 @@
+var Path = require('path'),
+    Kyoto = require('../lib/kyoto'),
+    H = require('./harness');
+
+exports.name = 'kyoto';
+exports.targets = targets;
+exports.run = run;
+
+
+// ## Binding ##
+
+// Point, bulk and scan operations through `KyotoDB`, against memory
+// and file databases of both kinds.
+
+var VALUE_SIZE = 100,
+    BULK = 100,
+    SCANS = 5;
+
+function targets(options) {
+  return {
+    '-': '-',
+    '+': '+',
+    kch: Path.join(options.dir, 'bench.kch'),
+    kct: Path.join(options.dir, 'bench.kct')
+  };
+}
+
+function run(bench, path, done) {
+  var ops = bench.options.ops,
+      rand = new H.Random(bench.options.seed),
+      value = rand.string(VALUE_SIZE),
+      db;
+
+  db = Kyoto.open(path, 'w+', function(err) {
+    if (err) return done(err);
+
+    bench.db = db;
+    H.series([set, get, getBulk, scan, remove], function(err) {
+      bench.db = null;
+      db.close(function(closeErr) {
+        done(err || closeErr);
+      });
+    });
+  });
+
+  function set(next) {
+    bench.measure('set', ops, function(i, next) {
+      db.set(key(i), value, next);
+    }, next);
+  }
+
+  function get(next) {
+    bench.measure('get', ops, function(i, next) {
+      db.get(key(rand.int(ops)), next);
+    }, next);
+  }
+
+  function getBulk(next) {
+    var batches = Math.max(1, Math.floor(ops / BULK));
+
+    bench.measure('getBulk', batches, function(i, next) {
+      var keys = [];
+      for (var j = 0; j < BULK; j++)
+        keys.push(key(rand.int(ops)));
+      db.getBulk(keys, next);
+    }, { batch: BULK }, next);
+  }
+
+  function scan(next) {
+    bench.measure('scan', SCANS, function(i, next) {
+      db.each(next, function(val, key) {});
+    }, { records: ops }, next);
+  }
+
+  function remove(next) {
+    bench.measure('remove', ops, function(i, next) {
+      db.remove(key(i), next);
+    }, next);
+  }
+}
+
+function key(i) {
+  var str = String(i);
+  return 'key' + '0000000000'.substr(str.length) + str;
+}
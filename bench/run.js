@@ -0,0 +1,114 @@
+// Run the benchmarks and write one JSON object per line: a header
+// describing the run, then a result for each case. For example:
+//
+//     node bench/run.js --ops 20000 --suite kyoto --target kct > after.json
+//
+// Options:
+//
+//   --ops N        Operations per case (default: 10000)
+//   --queries N    Queries per query case (default: 500)
+//   --seed N       Seed for generated data (default: 1)
+//   --dir PATH     Folder for database files (default: /tmp/toji-bench)
+//   --suite LIST   Comma-separated suites: kyoto, storage, avro
+//   --target LIST  Comma-separated targets, e.g. -,+,kch,kct
+
+var H = require('./harness'),
+    Package = JSON.parse(require('fs').readFileSync(__dirname + '/../package.json', 'utf8'));
+
+var SUITES = [
+  require('./kyoto'),
+  require('./storage'),
+  require('./avro')
+];
+
+var DEFAULTS = {
+  ops: 10000,
+  queries: 500,
+  seed: 1,
+  dir: '/tmp/toji-bench',
+  suite: null,
+  target: null
+};
+
+function main(argv) {
+  var options = parseArgs(argv),
+      bench = new H.Bench(options),
+      runs = [];
+
+  H.mkdir(options.dir);
+
+  SUITES.forEach(function(suite) {
+    if (!selected(options.suite, suite.name))
+      return;
+
+    var targets = suite.targets(options);
+    for (var name in targets) {
+      if (selected(options.target, name))
+        runs.push(runner(suite, name, targets[name]));
+    }
+  });
+
+  bench.header({
+    bench: Package.name,
+    version: Package.version,
+    node: process.version,
+    platform: process.platform,
+    date: (new Date()).toISOString(),
+    ops: options.ops,
+    queries: options.queries,
+    seed: options.seed
+  });
+
+  H.series(runs, function(err) {
+    if (err) {
+      console.error(err.stack || err);
+      process.exit(1);
+    }
+  });
+
+  function runner(suite, name, target) {
+    return function(next) {
+      bench.suite = suite.name;
+      bench.target = name;
+      suite.run(bench, target, next);
+    };
+  }
+}
+
+function parseArgs(argv) {
+  var options = {}, name, value;
+
+  for (name in DEFAULTS)
+    options[name] = DEFAULTS[name];
+
+  for (var i = 0, l = argv.length; i < l; i += 2) {
+    name = argv[i].replace(/^--/, '');
+    value = argv[i + 1];
+
+    if (!(name in DEFAULTS) || value === undefined)
+      usage('bad option: ' + argv[i]);
+    else if (typeof DEFAULTS[name] == 'number') {
+      options[name] = parseInt(value, 10);
+      if (!(options[name] > 0))
+        usage('expected a positive number: ' + argv[i]);
+    }
+    else if (DEFAULTS[name] === null)
+      options[name] = value.split(',');
+    else
+      options[name] = value;
+  }
+
+  return options;
+}
+
+function selected(list, name) {
+  return !list || list.indexOf(name) >= 0;
+}
+
+function usage(message) {
+  console.error(message);
+  console.error('usage: node bench/run.js [--ops N] [--queries N] [--seed N] [--dir PATH] [--suite LIST] [--target LIST]');
+  process.exit(2);
+}
+
+main(process.argv.slice(2));
@@ -0,0 +1,143 @@
+var Path = require('path'),
+    Toji = require('../lib/index'),
+    H = require('./harness');
+
+exports.name = 'storage';
+exports.targets = targets;
+exports.run = run;
+
+
+// ## Storage ##
+
+// Indexed writes and queries through the global `Storage`. Storage
+// always uses a tree database, so the targets are a memory tree and
+// a file tree.
+
+var BenchUser = Toji.type('BenchUser', {
+  name: Toji.ObjectId,
+  email: String
+});
+
+var BenchTicket = Toji.type('BenchTicket', {
+  id: Toji.ObjectId,
+  status: String,
+  priority: String,
+  owner: Toji.ref(BenchUser),
+  title: String,
+  score: Number
+})
+.addIndex('status')
+.addIndex('priority')
+.addOrderedIndex('score');
+
+var USERS = 100,
+    STATUS = ['new', 'open', 'closed', 'blocked'],
+    PRIORITY = ['low', 'normal', 'high'],
+    PAGE = 20;
+
+function targets(options) {
+  return {
+    memory: '*memory*',
+    file: H.mkdir(Path.join(options.dir, 'storage'))
+  };
+}
+
+function run(bench, folder, done) {
+  var ops = bench.options.ops,
+      queries = bench.options.queries,
+      rand = new H.Random(bench.options.seed),
+      users = [],
+      tickets = [],
+      db;
+
+  for (var i = 0; i < USERS; i++)
+    users.push(new BenchUser({ name: 'user' + i, email: 'user' + i + '@example.com' }));
+
+  db = Toji.open(folder, { mode: 'w+' }, function(err) {
+    if (err) return done(err);
+
+    bench.db = db.db;
+    H.series([
+      loadUsers, create, replace,
+      filter, intersect, order, range, include,
+      remove
+    ], function(err) {
+      bench.db = null;
+      db.close(function(closeErr) {
+        done(err || closeErr);
+      });
+    });
+  });
+
+  function loadUsers(next) {
+    db.load(next, users);
+  }
+
+  function create(next) {
+    bench.measure('create', ops, function(i, next) {
+      var obj = new BenchTicket({
+        id: 'ticket' + i,
+        status: rand.pick(STATUS),
+        priority: rand.pick(PRIORITY),
+        owner: rand.pick(users),
+        title: rand.string(40),
+        score: rand.int(1000)
+      });
+      tickets.push(obj);
+      obj.save(next);
+    }, next);
+  }
+
+  function replace(next) {
+    bench.measure('replace', ops, function(i, next) {
+      var obj = tickets[i];
+      obj.status = rand.pick(STATUS);
+      obj.score = rand.int(1000);
+      obj.save(next);
+    }, next);
+  }
+
+  function filter(next) {
+    query('query filter', function() {
+      return BenchTicket.find({ status: rand.pick(STATUS) });
+    }, next);
+  }
+
+  function intersect(next) {
+    query('query intersect', function() {
+      return BenchTicket.find({ status: rand.pick(STATUS), priority: rand.pick(PRIORITY) });
+    }, next);
+  }
+
+  function order(next) {
+    query('query order', function() {
+      return BenchTicket.find({ status: rand.pick(STATUS) }).order('-score');
+    }, next);
+  }
+
+  function range(next) {
+    query('query range', function() {
+      var low = rand.int(1000);
+      return BenchTicket.find({ score: { $gte: low, $lt: low + 50 } });
+    }, next);
+  }
+
+  function include(next) {
+    query('query include', function() {
+      return BenchTicket.find({ status: rand.pick(STATUS) }).include('owner');
+    }, next);
+  }
+
+  function remove(next) {
+    bench.measure('remove', ops, function(i, next) {
+      tickets[i].remove(next);
+    }, next);
+  }
+
+  // Each query reads one page of results.
+  function query(name, make, next) {
+    bench.measure(name, queries, function(i, next) {
+      make().limit(PAGE).all(next);
+    }, { page: PAGE }, next);
+  }
+}
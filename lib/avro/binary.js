@@ -0,0 +1,446 @@
+// # Binary Encoding #
+
+// Schema-driven binary serialization following the Avro 1.4.1 binary
+// encoding. Values are written from (and read back into) the same
+// JSON representation `dumpJSON()` produces and `loadJSON()` accepts,
+// so field-level conversions (references, nullable boxing, custom
+// types) work unchanged and only the bytes differ.
+//
+// There is one departure from the spec: every record starts with the
+// number of fields written. Fields appended to a record later are
+// read back as missing, so they get their default values. Removing or
+// reordering fields isn't supported.
+
+var Type = require('./type'),
+    Schema = require('./schema'),
+    Primitive = require('./primitive'),
+    Complex = require('./complex'),
+    U = require('./util');
+
+exports.Writer = Writer;
+exports.Reader = Reader;
+exports.encode = encode;
+exports.decode = decode;
+
+function encode(type, data) {
+  var out = new Writer();
+  type.writeBinary(out, data);
+  return out.result();
+}
+
+function decode(type, buf, pos) {
+  return type.readBinary(new Reader(buf, pos));
+}
+
+
+// ## Writer ##
+
+function Writer(size) {
+  this.buf = new Buffer(size || 256);
+  this.pos = 0;
+}
+
+Writer.prototype.result = function() {
+  return this.buf.slice(0, this.pos);
+};
+
+Writer.prototype.reserve = function(len) {
+  var need = this.pos + len,
+      size = this.buf.length,
+      buf;
+
+  if (need > size) {
+    while (size < need)
+      size *= 2;
+    buf = new Buffer(size);
+    this.buf.copy(buf, 0, 0, this.pos);
+    this.buf = buf;
+  }
+
+  return this;
+};
+
+Writer.prototype.byte = function(val) {
+  this.reserve(1);
+  this.buf[this.pos++] = val;
+  return this;
+};
+
+Writer.prototype.boolean = function(val) {
+  return this.byte(val ? 1 : 0);
+};
+
+// Integers are zig-zag encoded variable-length numbers. Javascript
+// numbers are exact up to 2^53, so longs beyond that lose precision
+// just like they do in JSON.
+Writer.prototype.long = function(val) {
+  var zz = (val >= 0) ? val * 2 : -val * 2 - 1,
+      buf, pos;
+
+  this.reserve(10);
+  buf = this.buf;
+  pos = this.pos;
+
+  if (zz < 0x80000000) {
+    while (zz > 0x7f) {
+      buf[pos++] = (zz & 0x7f) | 0x80;
+      zz >>>= 7;
+    }
+  }
+  else {
+    while (zz > 0x7f) {
+      buf[pos++] = (zz % 0x80) | 0x80;
+      zz = Math.floor(zz / 0x80);
+    }
+  }
+
+  buf[pos++] = zz;
+  this.pos = pos;
+  return this;
+};
+
+Writer.prototype.int = Writer.prototype.long;
+
+Writer.prototype.float = function(val) {
+  this.reserve(4);
+  writeIEEE754(this.buf, this.pos, val, 23, 4);
+  this.pos += 4;
+  return this;
+};
+
+Writer.prototype.double = function(val) {
+  this.reserve(8);
+  writeIEEE754(this.buf, this.pos, val, 52, 8);
+  this.pos += 8;
+  return this;
+};
+
+Writer.prototype.string = function(val) {
+  var len = Buffer.byteLength(val);
+  this.long(len).reserve(len);
+  this.buf.write(val, this.pos);
+  this.pos += len;
+  return this;
+};
+
+
+// ## Reader ##
+
+function Reader(buf, pos) {
+  this.buf = buf;
+  this.pos = pos || 0;
+}
+
+Reader.prototype.byte = function() {
+  if (this.pos >= this.buf.length)
+    throw new Truncated(this.pos);
+  return this.buf[this.pos++];
+};
+
+Reader.prototype.boolean = function() {
+  return this.byte() !== 0;
+};
+
+Reader.prototype.long = function() {
+  var buf = this.buf,
+      pos = this.pos,
+      end = buf.length,
+      val = 0,
+      mul = 1,
+      b;
+
+  do {
+    if (pos >= end)
+      throw new Truncated(pos);
+    b = buf[pos++];
+    val += (b & 0x7f) * mul;
+    mul *= 0x80;
+  } while (b & 0x80);
+
+  this.pos = pos;
+  return (val % 2) ? -(val + 1) / 2 : val / 2;
+};
+
+Reader.prototype.int = Reader.prototype.long;
+
+Reader.prototype.float = function() {
+  var pos = this.skip(4);
+  return readIEEE754(this.buf, pos, 23, 4);
+};
+
+Reader.prototype.double = function() {
+  var pos = this.skip(8);
+  return readIEEE754(this.buf, pos, 52, 8);
+};
+
+Reader.prototype.string = function() {
+  var len = this.long(),
+      pos = this.skip(len);
+  return this.buf.toString('utf8', pos, pos + len);
+};
+
+Reader.prototype.skip = function(len) {
+  var pos = this.pos;
+  if (pos + len > this.buf.length)
+    throw new Truncated(pos);
+  this.pos += len;
+  return pos;
+};
+
+
+// ## Primitive Types ##
+
+function defBinary(name, write, read) {
+  Primitive.TYPES[name].extend({
+    writeBinary: write,
+    readBinary: read
+  });
+}
+
+defBinary('null',
+  function(out, val) {},
+  function(input) { return null; });
+
+['boolean', 'int', 'long', 'float', 'double', 'string'].forEach(function(name) {
+  defBinary(name,
+    function(out, val) { out[name](val); },
+    function(input) { return input[name](); });
+});
+
+
+// ## Complex Types ##
+
+// Arrays and maps are written as a single block followed by the
+// empty block that ends them. Readers also accept several blocks and
+// blocks with a negative count (followed by a byte size), as the
+// spec allows.
+
+Complex.ArrayType.extend({
+  writeBinary: function(out, obj) {
+    var items = this.__items__,
+        len = obj.length;
+
+    if (len > 0) {
+      out.long(len);
+      for (var i = 0; i < len; i++)
+        items.writeBinary(out, obj[i]);
+    }
+
+    out.long(0);
+  },
+
+  readBinary: function(input) {
+    var items = this.__items__,
+        result = [],
+        count;
+
+    while ((count = readBlock(input)) > 0) {
+      while (count--)
+        result.push(items.readBinary(input));
+    }
+
+    return result;
+  }
+});
+
+Complex.MapType.extend({
+  writeBinary: function(out, obj) {
+    var values = this.__values__,
+        keys = Object.keys(obj),
+        len = keys.length;
+
+    if (len > 0) {
+      out.long(len);
+      for (var i = 0; i < len; i++) {
+        out.string(keys[i]);
+        values.writeBinary(out, obj[keys[i]]);
+      }
+    }
+
+    out.long(0);
+  },
+
+  readBinary: function(input) {
+    var values = this.__values__,
+        result = {},
+        count, key;
+
+    while ((count = readBlock(input)) > 0) {
+      while (count--) {
+        key = input.string();
+        result[key] = values.readBinary(input);
+      }
+    }
+
+    return result;
+  }
+});
+
+// Unions are written as the index of the member followed by the
+// value. Dumped union values are boxed, so reading boxes them again.
+
+Complex.UnionType.extend({
+  writeBinary: function(out, obj) {
+    return this.scan(obj, function(val, member) {
+      out.long(this.__members__.indexOf(member));
+      member.writeBinary(out, val);
+    });
+  },
+
+  readBinary: function(input) {
+    var index = input.long(),
+        member = this.__members__[index];
+
+    if (!member)
+      throw new Complex.Invalid(this, 'no union member', index);
+
+    return this.box(memberKey(this, index), member.readBinary(input));
+  }
+});
+
+Complex.RecordType.extend({
+  writeBinary: function(out, obj) {
+    var fields = this.__fields__ || [],
+        len = fields.length,
+        field;
+
+    out.long(len);
+    for (var i = 0; i < len; i++) {
+      field = fields[i];
+      field.type.writeBinary(out, obj[field.name]);
+    }
+  },
+
+  readBinary: function(input) {
+    var fields = this.__fields__ || [],
+        count = input.long(),
+        result = {},
+        field;
+
+    if (count > fields.length)
+      throw new Complex.Invalid(this, 'too many fields', count);
+
+    for (var i = 0; i < count; i++) {
+      field = fields[i];
+      result[field.name] = field.type.readBinary(input);
+    }
+
+    return result;
+  }
+});
+
+function readBlock(input) {
+  var count = input.long();
+  if (count < 0) {
+    count = -count;
+    input.long();
+  }
+  return count;
+}
+
+// The name a union member is boxed with, see `UnionType.box()`.
+function memberKey(union, index) {
+  var keys = union.hasOwnProperty('__memberKeys__') && union.__memberKeys__;
+  if (!keys)
+    keys = union.__memberKeys__ = union.__schema__.map(Schema.memberName);
+  return keys[index];
+}
+
+
+// ## IEEE 754 ##
+
+// Buffers don't read or write floating point numbers, so pack them by
+// hand (little-endian). `mLen` is the mantissa length in bits.
+
+function writeIEEE754(buf, pos, val, mLen, nBytes) {
+  var eLen = nBytes * 8 - mLen - 1,
+      eMax = (1 << eLen) - 1,
+      eBias = eMax >> 1,
+      rt = (mLen === 23) ? Math.pow(2, -24) - Math.pow(2, -77) : 0,
+      sign = (val < 0 || (val === 0 && 1 / val < 0)) ? 1 : 0,
+      e, m, c, i = 0;
+
+  val = Math.abs(val);
+
+  if (isNaN(val) || val === Infinity) {
+    m = isNaN(val) ? 1 : 0;
+    e = eMax;
+  }
+  else {
+    e = Math.floor(Math.log(val) / Math.LN2);
+    if (val * (c = Math.pow(2, -e)) < 1) {
+      e--;
+      c *= 2;
+    }
+
+    val += (e + eBias >= 1) ? rt / c : rt * Math.pow(2, 1 - eBias);
+    if (val * c >= 2) {
+      e++;
+      c /= 2;
+    }
+
+    if (e + eBias >= eMax) {
+      m = 0;
+      e = eMax;
+    }
+    else if (e + eBias >= 1) {
+      m = (val * c - 1) * Math.pow(2, mLen);
+      e = e + eBias;
+    }
+    else {
+      m = val * Math.pow(2, eBias - 1) * Math.pow(2, mLen);
+      e = 0;
+    }
+  }
+
+  for (; mLen >= 8; mLen -= 8) {
+    buf[pos + i++] = m & 0xff;
+    m /= 256;
+  }
+
+  e = (e << mLen) | m;
+  for (eLen += mLen; eLen > 0; eLen -= 8) {
+    buf[pos + i++] = e & 0xff;
+    e /= 256;
+  }
+
+  buf[pos + i - 1] |= sign * 128;
+}
+
+function readIEEE754(buf, pos, mLen, nBytes) {
+  var eLen = nBytes * 8 - mLen - 1,
+      eMax = (1 << eLen) - 1,
+      eBias = eMax >> 1,
+      nBits = -7,
+      i = nBytes - 1,
+      sign = buf[pos + i--],
+      e, m;
+
+  e = sign & ((1 << -nBits) - 1);
+  sign >>= -nBits;
+  for (nBits += eLen; nBits > 0; nBits -= 8)
+    e = e * 256 + buf[pos + i--];
+
+  m = e & ((1 << -nBits) - 1);
+  e >>= -nBits;
+  for (nBits += mLen; nBits > 0; nBits -= 8)
+    m = m * 256 + buf[pos + i--];
+
+  if (e === 0)
+    e = 1 - eBias;
+  else if (e === eMax)
+    return m ? NaN : (sign ? -Infinity : Infinity);
+  else {
+    m = m + Math.pow(2, mLen);
+    e = e - eBias;
+  }
+
+  return (sign ? -1 : 1) * m * Math.pow(2, e - mLen);
+}
+
+
+// ## Errors ##
+
+var Truncated = exports.Truncated = U.defError(function Truncated(pos) {
+  return 'unexpected end of data at byte ' + pos;
+});
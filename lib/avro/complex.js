@@ -10,6 +10,7 @@ exports.MapType = MapType;
 exports.UnionType = UnionType;
 exports.RecordType = RecordType;
 exports.Field = Field;
+exports.compileCodecs = compileCodecs;
 
 function defComplex(name, ctor) {
   return (exports.TYPES[name] = Type.create(ctor));
@@ -258,10 +259,36 @@ UnionType.extend({
       return simplify(type.__schema__);
     });
 
+    type.__dispatch__ = nativeDispatch(names);
+
     return type;
   }
 });
 
+// Strings, numbers and booleans are matched to the member named by
+// their constructor. Which member that is depends only on `typeof`,
+// so it's looked up once here instead of for every value. The names
+// are the Avro names of String, Number and Boolean (see `ALIASES` in
+// schema.js); `Schema.memberName()` can't be asked here because it
+// only knows them once the primitive types are registered.
+
+var NATIVE_NAMES = {
+  'string': 'string',
+  'number': 'double',
+  'boolean': 'boolean'
+};
+
+function nativeDispatch(names) {
+  var dispatch = {};
+
+  for (var kind in NATIVE_NAMES) {
+    if (NATIVE_NAMES[kind] in names)
+      dispatch[kind] = NATIVE_NAMES[kind];
+  }
+
+  return dispatch;
+}
+
 // Manipulation
 
 UnionType.extend({
@@ -313,6 +340,9 @@ UnionType.extend({
         type = member = this.__memberNames__[name];
         obj = val;
       });
+    // Native type with a matching member.
+    else if ((name = this.__dispatch__[typeof obj]))
+      type = member = this.__memberNames__[name];
     // Native type scenario.
     else {
       type = Type.of(obj);
@@ -439,6 +469,21 @@ RecordType.extend({
 
   defaultValue: function(obj) {
     return this.constructFrom(obj, 'defaultValue');
+  },
+
+  // Load only the fields named in `names`; the rest are left unset.
+  loadFields: function(obj, names) {
+    var type = this,
+        result = new type(),
+        field;
+
+    this.assertValid(obj);
+    for (var i = 0, l = names.length; i < l; i++) {
+      if ((field = this.field(names[i])))
+        field.loadJSON(obj, result);
+    }
+
+    return result;
   }
 });
 
@@ -507,7 +552,7 @@ RecordType.extend({
       return field.schema;
     });
 
-    return this;
+    return this.resetCodecs();
   },
 
   modifyField: function(name, next) {
@@ -563,6 +608,9 @@ RecordType.extend({
   foldRecursive: function(obj, method, seed) {
     seed = seed || {};
 
+    if (COMPILE)
+      return this.codec(method)(obj, seed);
+
     this.eachField(function(field) {
       field[method](obj, seed);
     });
@@ -571,12 +619,81 @@ RecordType.extend({
   },
 
   eachRecursive: function(obj, method) {
+    if (COMPILE) {
+      this.codec(method)(obj);
+      return this;
+    }
+
     return this.eachField(function(field) {
       field[method](obj);
     });
   }
 });
 
+// ### Codecs ###
+
+// Instead of looping over its fields for every object, a record type
+// generates a function per method (`dumpJSON`, `validate`, etc.) the
+// first time it's used. The function calls each field in turn, so
+// every call site only ever sees one field, and uses the field's
+// `specialize()`d version of the method when it has one. Changing the
+// fields (see `rebuildSchema()`) throws the functions away.
+
+var COMPILE = true;
+
+// Turn generated codecs on or off, for comparing them with the
+// interpreted loops.
+function compileCodecs(enabled) {
+  COMPILE = !!enabled;
+}
+
+RecordType.extend({
+  codec: function(method) {
+    var codecs = this.__codecs__;
+
+    if (!codecs) {
+      codecs = {};
+      Object.defineProperty(this, '__codecs__', {
+        value: codecs,
+        writable: true,
+        configurable: true,
+        enumerable: false
+      });
+    }
+
+    return codecs[method] || (codecs[method] = generateCodec(this, method));
+  },
+
+  resetCodecs: function() {
+    if (this.__codecs__)
+      this.__codecs__ = null;
+    return this;
+  }
+});
+
+function generateCodec(type, method) {
+  var params = [],
+      values = [],
+      body = [],
+      call = '[' + JSON.stringify(method) + ']';
+
+  type.eachField(function(field) {
+    var name = 'f' + params.length,
+        fast = field.specialize(method);
+
+    params.push(name);
+    values.push(fast || field);
+    body.push('  ' + name + (fast ? '' : call) + '(obj, seed);');
+  });
+
+  var make = new Function(params.join(', '),
+    'return function ' + method + '(obj, seed) {\n'
+    + body.join('\n')
+    + '\n  return seed;\n};');
+
+  return make.apply(null, values);
+}
+
 
 // ## Field ##
 
@@ -704,6 +821,12 @@ Field.include({
     return this.dumpJSONValue(val);
   },
 
+  // A function(obj, seed) that does the same as `this[method]` but
+  // faster, for generated codecs (see `RecordType.codec()`), or null.
+  specialize: function(method) {
+    return null;
+  },
+
   invoke: function(method, val) {
     try {
       return this.type[method](val);
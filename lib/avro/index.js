@@ -4,6 +4,7 @@ var Reg = require('./registry'),
     Schema = require('./schema'),
     Type = require('./type'),
     Complex = require('./complex'),
+    Binary = require('./binary'),
     U = require('./util');
 
 exports.type = type;
@@ -17,6 +18,11 @@ exports.nameOf = Type.nameOf;
 exports.dumpJSON = dumpJSON;
 exports.loadJSON = loadJSON;
 exports.exportJSON = exportJSON;
+exports.dumpBinary = dumpBinary;
+exports.loadBinary = loadBinary;
+exports.isBinary = isBinary;
+exports.load = load;
+exports.loadFields = loadFields;
 
 exports.ArrayType = Complex.ArrayType;
 exports.MapType = Complex.MapType;
@@ -25,6 +31,7 @@ exports.RecordType = Complex.RecordType;
 exports.Field = Complex.Field;
 exports.Invalid = Complex.Invalid;
 exports.InvalidField = Complex.InvalidField;
+exports.compileCodecs = Complex.compileCodecs;
 
 
 // ## Global Registry ##
@@ -68,4 +75,61 @@ function exportJSON(obj) {
 
 function loadJSON(type, data) {
   return type.loadJSON(JSON.parse(data));
-}
\ No newline at end of file
+}
+
+// Binary documents start with a byte that can't start a JSON document
+// and a format version. See `./binary` for the encoding.
+
+var BINARY_MARKER = 0x00,
+    BINARY_VERSION = 0x01;
+
+function dumpBinary(obj) {
+  var type = Type.of(obj),
+      out = new Binary.Writer();
+
+  out.byte(BINARY_MARKER).byte(BINARY_VERSION);
+  type.writeBinary(out, type.dumpJSON(obj));
+  return out.result();
+}
+
+function loadBinary(type, data) {
+  if (data[1] !== BINARY_VERSION)
+    throw new Type.ValueError('unsupported binary version', data[1]);
+  return type.loadJSON(Binary.decode(type, data, 2));
+}
+
+function isBinary(data) {
+  return Buffer.isBuffer(data) && data.length > 0 && data[0] === BINARY_MARKER;
+}
+
+// Load a stored document in either format. Documents read as Buffers
+// may still be JSON.
+function load(type, data) {
+  if (isBinary(data))
+    return loadBinary(type, data);
+  else if (typeof data != 'string')
+    data = data.toString();
+  else if (data.charCodeAt(0) === BINARY_MARKER)
+    throw new Type.ValueError('binary document read as a string', type.__name__);
+  return loadJSON(type, data);
+}
+
+// Like `load()`, but only the fields named in `names` are set (see
+// `RecordType.loadFields()`).
+function loadFields(type, data, names) {
+  var json;
+
+  if (isBinary(data)) {
+    if (data[1] !== BINARY_VERSION)
+      throw new Type.ValueError('unsupported binary version', data[1]);
+    json = Binary.decode(type, data, 2);
+  }
+  else if (typeof data != 'string')
+    json = JSON.parse(data.toString());
+  else if (data.charCodeAt(0) === BINARY_MARKER)
+    throw new Type.ValueError('binary document read as a string', type.__name__);
+  else
+    json = JSON.parse(data);
+
+  return type.loadFields(json, names);
+}
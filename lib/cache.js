@@ -0,0 +1,104 @@
+var LRUCache = require('./lru').LRUCache;
+
+exports.ObjectCache = ObjectCache;
+
+
+// ## Object Cache ##
+
+// A least-recently-used cache of stored documents, bounded by the
+// number of entries and by their size. Storage keeps the data rather
+// than loaded objects, so every reader loads its own object and one
+// reader's changes can't leak to another.
+//
+// Writes bump the cache's `epoch`, so a read that started before a
+// write can't put a stale document back after the write invalidated it.
+//
+// Options:
+//
+//   + entries - Number of documents to keep (default: 1000)
+//   + bytes   - Number of stored bytes to keep (default: 16MB)
+
+var ENTRIES = 1000,
+    BYTES = 16 * 1024 * 1024;
+
+function ObjectCache(options) {
+  options = options || {};
+
+  this.maxEntries = options.entries || ENTRIES;
+  this.maxBytes = options.bytes || BYTES;
+  this.lru = new LRUCache(this.maxEntries);
+  this.bytes = 0;
+  this.epoch = 0;
+
+  this.hits = 0;
+  this.misses = 0;
+  this.evictions = 0;
+}
+
+// Look up a document. Returns undefined on a miss.
+ObjectCache.prototype.get = function(key) {
+  var entry = this.lru.get(key);
+
+  if (entry === undefined) {
+    this.misses++;
+    return undefined;
+  }
+
+  this.hits++;
+  return entry.data;
+};
+
+// Add a document of `size` bytes. Nothing is added if the cache was
+// invalidated since `epoch`.
+ObjectCache.prototype.put = function(key, data, size, epoch) {
+  if (epoch !== undefined && epoch !== this.epoch)
+    return this;
+  else if (size > this.maxBytes)
+    return this;
+
+  this.drop(key);
+  this.evicted(this.lru.put(key, { data: data, size: size }));
+  this.bytes += size;
+
+  while (this.bytes > this.maxBytes)
+    this.evicted(this.lru.shift());
+
+  return this;
+};
+
+// Forget a document, usually because it's about to change.
+ObjectCache.prototype.remove = function(key) {
+  this.epoch++;
+  this.drop(key);
+  return this;
+};
+
+ObjectCache.prototype.clear = function() {
+  this.epoch++;
+  this.lru.removeAll();
+  this.bytes = 0;
+  return this;
+};
+
+ObjectCache.prototype.stats = function() {
+  return {
+    entries: this.lru.size,
+    bytes: this.bytes,
+    hits: this.hits,
+    misses: this.misses,
+    evictions: this.evictions
+  };
+};
+
+ObjectCache.prototype.drop = function(key) {
+  var entry = this.lru.remove(key);
+  if (entry)
+    this.bytes -= entry.size;
+};
+
+ObjectCache.prototype.evicted = function(removed) {
+  if (removed) {
+    this.bytes -= removed.value.size;
+    this.evictions++;
+  }
+};
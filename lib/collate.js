@@ -0,0 +1,565 @@
+var Fs = require('fs'),
+    Kyoto = require('./kyoto'),
+    Binary = require('./avro/binary');
+
+exports.sort = sort;
+exports.Sort = Sort;
+exports.TopK = TopK;
+exports.makeCmp = makeCmp;
+exports.cmpValues = cmpValues;
+exports.valueTag = valueTag;
+exports.parseTerm = parseTerm;
+exports.sortKey = sortKey;
+exports.encodeValue = encodeValue;
+exports.decodeValue = decodeValue;
+exports.successor = successor;
+
+
+// ## Sort ##
+
+// Sort the objects produced by a generator (see `Query.order()`).
+//
+// Up to `budget` objects are sorted in memory. Past that, objects are
+// spilled to a temporary tree database under a key that sorts the same
+// way they do, so Kyoto Cabinet orders them off the event loop and
+// they're read back in order by scanning the tree. When there's a
+// `limit`, only that many objects are kept in a heap instead.
+//
+// Options:
+//
+//   + limit  - Number of objects needed (optional)
+//   + budget - Number of objects to keep in memory (default: 10000)
+
+var BUDGET = 10000;
+
+function sort(store, iter, order, options) {
+  return new Sort(store, iter, order, options);
+}
+
+function Sort(store, iter, order, options) {
+  options = options || {};
+
+  this.store = store;
+  this.iter = iter;
+  this.order = order;
+  this.cmp = makeCmp(order);
+  this.budget = options.budget || BUDGET;
+
+  this.heap = null;
+  if (options.limit !== undefined && options.limit <= this.budget)
+    this.heap = new TopK(options.limit, this.cmp);
+
+  this.buffer = [];
+  this.index = 0;
+  this.seq = 0;
+  this.spill = null;
+  this.output = null;
+
+  this.resume = undefined;
+  this.draining = false;
+  this.finished = false;
+
+  var self = this;
+  iter.then(function(done) {
+    self._done = done;
+    return function(err) {
+      return self.done(err);
+    };
+  });
+}
+
+Sort.prototype.then = function(callback) {
+  this._done = callback(this._done);
+  return this;
+};
+
+Sort.prototype.done = function(err) {
+  if (err || this.draining)
+    this.finish(err);
+  else
+    this.drain();
+  return this;
+};
+
+Sort.prototype.next = function(fn) {
+  if (!this.draining) {
+    this.resume = fn;
+    return this.read();
+  }
+
+  if (this.output)
+    return this.readSpilled(fn);
+
+  var self = this,
+      buffer = this.buffer;
+
+  if (this.index >= buffer.length)
+    this.iter.done();
+  else
+    process.nextTick(function() {
+      fn(buffer[self.index++]);
+    });
+
+  return this;
+};
+
+Sort.prototype.read = function() {
+  var self = this,
+      iter = this.iter,
+      heap = this.heap;
+
+  iter.next(accumulate);
+
+  function accumulate(obj) {
+    if (heap)
+      heap.push(obj);
+    else if (self.buffer.push(obj) >= self.budget)
+      return self.spillBuffer(function(err) {
+        err ? iter.done(err) : iter.next(accumulate);
+      });
+    iter.next(accumulate);
+  }
+
+  return this;
+};
+
+Sort.prototype.drain = function() {
+  var self = this;
+
+  this.draining = true;
+
+  if (!this.resume) {
+    this.iter.done();
+    return this;
+  }
+
+  if (this.spill)
+    return this.spillBuffer(function(err) {
+      if (err)
+        return self.finish(err);
+      self.output = self.spill.generateRange({ asBuffer: self.store.binary }, function(err) {
+        self.finish(err);
+      });
+      self.next(self.resume);
+    });
+
+  try {
+    if (this.heap)
+      this.buffer = this.heap.sorted();
+    else
+      this.buffer.sort(this.cmp);
+  } catch (x) {
+    this.iter.done(x);
+    return this;
+  }
+
+  this.next(this.resume);
+
+  return this;
+};
+
+Sort.prototype.finish = function(err) {
+  var self = this,
+      spill = this.spill,
+      path = this.spillPath;
+
+  if (this.finished)
+    return this;
+
+  this.finished = true;
+  this.buffer = null;
+
+  if (!spill)
+    return this._done(err);
+
+  this.spill = this.output = null;
+  spill.close(function(closeErr) {
+    if (path == '+')
+      self._done(err || closeErr);
+    else
+      Fs.unlink(path, function() {
+        self._done(err || closeErr);
+      });
+  });
+
+  return this;
+};
+
+// Write the buffered objects to the spill database. It's opened the
+// first time this is called.
+Sort.prototype.spillBuffer = function(next) {
+  var self = this,
+      store = this.store,
+      buffer = this.buffer,
+      items = {},
+      obj;
+
+  if (!this.spill) {
+    this.spillPath = store.tempPath('sort');
+    this.spill = Kyoto.open(this.spillPath, 'w+', function(err) {
+      if (err) {
+        self.spill = null;
+        next(err);
+      }
+      else
+        self.spillBuffer(next);
+    });
+    return this;
+  }
+
+  try {
+    for (var i = 0, l = buffer.length; i < l; i++) {
+      obj = buffer[i];
+      items[sortKey(this.order, obj) + seqKey(this.seq++) + ' ' + obj.__key__(false, store.keyFormat)] = store.dump(obj);
+    }
+  } catch (x) {
+    next(x);
+    return this;
+  }
+
+  this.buffer = [];
+  this.spill.setBulk(items, false, function(err) {
+    next(err);
+  });
+
+  return this;
+};
+
+Sort.prototype.readSpilled = function(fn) {
+  var self = this,
+      store = this.store;
+
+  this.output.next(function(data, key) {
+    store.decode(data, key.substr(key.indexOf(' ') + 1), function(err, obj) {
+      err ? self.output.done(err) : fn(obj);
+    });
+  });
+
+  return this;
+};
+
+function seqKey(seq) {
+  var hex = seq.toString(16);
+  return '000000000000'.substr(hex.length) + hex;
+}
+
+
+// ## Top K ##
+
+// Keep the `size` smallest objects seen, in a heap with the largest
+// on top. Ties go to the object seen first.
+
+function TopK(size, cmp) {
+  this.size = size;
+  this.cmp = cmp;
+  this.items = [];
+  this.seq = 0;
+}
+
+TopK.prototype.push = function(obj) {
+  var items = this.items,
+      entry = { obj: obj, seq: this.seq++ };
+
+  if (items.length < this.size) {
+    items.push(entry);
+    this.up(items.length - 1);
+  }
+  else if (items.length > 0 && this.compare(entry, items[0]) < 0) {
+    items[0] = entry;
+    this.down(0);
+  }
+
+  return this;
+};
+
+TopK.prototype.sorted = function() {
+  var self = this;
+
+  return this.items
+    .sort(function(a, b) { return self.compare(a, b); })
+    .map(function(entry) { return entry.obj; });
+};
+
+TopK.prototype.compare = function(a, b) {
+  return this.cmp(a.obj, b.obj) || (a.seq - b.seq);
+};
+
+TopK.prototype.up = function(pos) {
+  var items = this.items,
+      entry = items[pos],
+      parent;
+
+  while (pos > 0) {
+    parent = (pos - 1) >> 1;
+    if (this.compare(entry, items[parent]) <= 0)
+      break;
+    items[pos] = items[parent];
+    pos = parent;
+  }
+
+  items[pos] = entry;
+};
+
+TopK.prototype.down = function(pos) {
+  var items = this.items,
+      len = items.length,
+      entry = items[pos],
+      child;
+
+  while ((child = 2 * pos + 1) < len) {
+    if (child + 1 < len && this.compare(items[child + 1], items[child]) > 0)
+      child++;
+    if (this.compare(items[child], entry) <= 0)
+      break;
+    items[pos] = items[child];
+    pos = child;
+  }
+
+  items[pos] = entry;
+};
+
+
+// ## Comparison ##
+
+// An order is a list of field names, each optionally prefixed with
+// `+` (ascending, the default) or `-` (descending).
+
+function makeCmp(order) {
+  if (!order || order.length === 0)
+    return cmpStable;
+
+  var cmp = compileCmp(order[0]);
+  for (var i = 1, l = order.length; i < l; i++)
+    cmp = chainCmp(cmp, compileCmp(order[i]));
+
+  return cmp;
+}
+
+function cmpStable() {
+  return 0;
+}
+
+function chainCmp(cmp1, cmp2) {
+  return function(a, b) {
+    return cmp1(a, b) || cmp2(a, b);
+  };
+}
+
+function compileCmp(expr) {
+  var term = parseTerm(expr);
+  return CMP[term.op](term.name);
+}
+
+function parseTerm(expr) {
+  var probe = expr.match(/^([\-\+])?(.*)$/);
+  return { op: probe[1] || '+', name: probe[2] };
+}
+
+var CMP = {
+  '+': function ascending(name) {
+    return function(a, b) {
+      return cmpValues(a[name], b[name]);
+    };
+  },
+
+  '-': function descending(name) {
+    return function(a, b) {
+      return cmpValues(b[name], a[name]);
+    };
+  }
+};
+
+// Compare two values the way their `encodeValue()` keys compare, so
+// a sort in memory agrees with one spilled to disk or read from an
+// ordered index (see Sort Keys below).
+function cmpValues(a, b) {
+  a = sortable(a);
+  b = sortable(b);
+
+  var ta = sortableTag(a),
+      tb = sortableTag(b);
+
+  if (ta !== tb)
+    return (ta < tb) ? -1 : 1;
+  else if (ta == TAGS.string)
+    return cmpUtf8(a, b);
+  return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+// A value as `encodeValue()` sees it: null, a boolean, a number or a
+// String.
+function sortable(val) {
+  if (val === null || val === undefined)
+    return null;
+  else if (val instanceof Date)
+    return val.getTime();
+
+  var type = typeof val;
+  return (type == 'boolean' || type == 'number') ? val : String(val);
+}
+
+// The type a value sorts by, see `TAGS`.
+function valueTag(val) {
+  return sortableTag(sortable(val));
+}
+
+function sortableTag(val) {
+  return TAGS[val === null ? 'null' : typeof val];
+}
+
+// Strings compare by UTF-8 bytes. That's the same as comparing UTF-16
+// code units unless there are surrogates.
+var SURROGATE = /[\ud800-\udfff]/;
+
+function cmpUtf8(a, b) {
+  if (SURROGATE.test(a) || SURROGATE.test(b)) {
+    a = new Buffer(a, 'utf8');
+    b = new Buffer(b, 'utf8');
+    for (var i = 0, l = Math.min(a.length, b.length); i < l; i++) {
+      if (a[i] !== b[i])
+        return (a[i] < b[i]) ? -1 : 1;
+    }
+    a = a.length;
+    b = b.length;
+  }
+  return (a < b) ? -1 : (a > b) ? 1 : 0;
+}
+
+
+// ## Sort Keys ##
+
+// Encode the ordered fields of an object as a String that compares
+// (bytewise) the way `makeCmp(order)` compares objects. Each value is
+// a type tag followed by hex digits, so the encoding is
+// self-delimiting and fields can simply be concatenated. Descending
+// fields complement every digit.
+//
+// Values of different types sort by type: null, booleans, numbers,
+// then strings. Dates sort as numbers and other objects as their
+// String value. Strings compare by UTF-8 bytes (see `cmpValues()`).
+
+var TAGS = { 'null': 1, 'boolean': 2, 'number': 3, 'string': 4 };
+
+function sortKey(order, obj) {
+  var key = '', term;
+
+  for (var i = 0, l = order.length; i < l; i++) {
+    term = parseTerm(order[i]);
+    key += encodeValue(obj[term.name], term.op == '-');
+  }
+
+  return key;
+}
+
+function encodeValue(val, desc) {
+  var type, digits;
+
+  if (val === null || val === undefined)
+    type = 'null';
+  else {
+    if (val instanceof Date)
+      val = val.getTime();
+    else if (typeof val == 'object')
+      val = String(val);
+    type = typeof val;
+  }
+
+  switch (type) {
+  case 'null':
+    digits = '';
+    break;
+  case 'boolean':
+    digits = val ? '1' : '0';
+    break;
+  case 'number':
+    // -0 is stored as 0, so it has to be indexed as 0 too.
+    digits = numberHex(val === 0 ? 0 : val);
+    break;
+  default:
+    type = 'string';
+    digits = bytesHex(new Buffer(String(val), 'utf8'));
+  }
+
+  if (!desc)
+    return TAGS[type] + digits + (type == 'string' ? '.' : '');
+  return (9 - TAGS[type]) + complement(digits) + (type == 'string' ? '~' : '');
+}
+
+// The value of an ascending `encodeValue()`. Dates come back as
+// their time in milliseconds.
+function decodeValue(str) {
+  var digits = str.substr(1);
+
+  switch (Number(str.charAt(0))) {
+  case TAGS['null']:
+    return null;
+  case TAGS['boolean']:
+    return digits == '1';
+  case TAGS['number']:
+    return hexNumber(digits);
+  default:
+    return (new Buffer(hexBytes(digits.replace(/\.$/, '')))).toString('utf8');
+  }
+}
+
+// Big-endian IEEE 754 with the sign bit flipped (and every other bit
+// flipped for negative numbers) sorts like the numbers do.
+function numberHex(val) {
+  var buf = (new Binary.Writer(8)).double(val).result(),
+      bytes = [];
+
+  for (var i = 7; i >= 0; i--)
+    bytes.push(buf[i]);
+
+  if (bytes[0] & 0x80)
+    bytes = bytes.map(function(b) { return 0xff - b; });
+  else
+    bytes[0] |= 0x80;
+
+  return bytesHex(bytes);
+}
+
+function hexNumber(hex) {
+  var bytes = hexBytes(hex),
+      buf = new Buffer(8);
+
+  if (bytes[0] & 0x80)
+    bytes[0] &= 0x7f;
+  else
+    bytes = bytes.map(function(b) { return 0xff - b; });
+
+  for (var i = 0; i < 8; i++)
+    buf[i] = bytes[7 - i];
+
+  return (new Binary.Reader(buf)).double();
+}
+
+function bytesHex(bytes) {
+  var hex = '', b;
+  for (var i = 0, l = bytes.length; i < l; i++) {
+    b = bytes[i];
+    hex += (b < 16 ? '0' : '') + b.toString(16);
+  }
+  return hex;
+}
+
+function hexBytes(hex) {
+  var bytes = [];
+  for (var i = 0, l = hex.length; i < l; i += 2)
+    bytes.push(parseInt(hex.substr(i, 2), 16));
+  return bytes;
+}
+
+// The smallest String greater than every String that starts with
+// `str`, for encoded values which never end in the highest character.
+function successor(str) {
+  var last = str.length - 1;
+  return str.substr(0, last) + String.fromCharCode(str.charCodeAt(last) + 1);
+}
+
+function complement(hex) {
+  var result = '';
+  for (var i = 0, l = hex.length; i < l; i++)
+    result += (15 - parseInt(hex.charAt(i), 16)).toString(16);
+  return result;
+}
@@ -4,6 +4,7 @@ exports.TakeWhile = TakeWhile;
 exports.Filter = Filter;
 exports.AMap = AMap;
 exports.Sort = Sort;
+exports.Window = Window;
 
 
 // ## Each ##
@@ -242,3 +243,107 @@ Sort.prototype.drain = function() {
 
   return this;
 };
+
+
+// ## Window ##
+
+// Like AMap, but `map(items, next)` is called with up to `size`
+// items at a time and passes back an Array of results, so work can
+// be shared across neighbouring items. A short window is mapped when
+// the iterator finishes.
+
+function Window(iter, size, map) {
+  this.iter = iter;
+  this.size = size;
+  this.map = map;
+
+  this.resume = undefined;
+  this.filling = false;
+  this.ended = false;
+  this._pending = [];
+  this._ready = [];
+
+  var self = this;
+  iter.then(function(done) {
+    self._done = done;
+    return function(err) {
+      return self.done(err);
+    };
+  });
+}
+
+Window.prototype.then = function(callback) {
+  this._done = callback(this._done);
+  return this;
+};
+
+Window.prototype.done = function(err) {
+  if (err || this.ended || !this.filling)
+    this._done(err);
+  else {
+    this.filling = false;
+    this.ended = true;
+    this.release();
+  }
+  return this;
+};
+
+Window.prototype.next = function(fn) {
+  var ready = this._ready;
+
+  if (ready.length > 0)
+    process.nextTick(function() {
+      fn(ready.shift());
+    });
+  else if (this.ended)
+    this._done();
+  else
+    this.fill(fn);
+
+  return this;
+};
+
+Window.prototype.fill = function(fn) {
+  var self = this,
+      iter = this.iter,
+      pending = this._pending;
+
+  this.resume = fn;
+  this.filling = true;
+  iter.next(accumulate);
+
+  function accumulate(obj) {
+    pending.push(obj);
+    if (pending.length < self.size)
+      iter.next(accumulate);
+    else {
+      self.filling = false;
+      self.release();
+    }
+  }
+
+  return this;
+};
+
+Window.prototype.release = function() {
+  var self = this,
+      items = this._pending,
+      fn = this.resume;
+
+  this._pending = [];
+  this.resume = undefined;
+
+  if (items.length === 0)
+    return this._done();
+
+  this.map(items, function(err, results) {
+    if (err)
+      self.ended ? self._done(err) : self.iter.done(err);
+    else {
+      self._ready = results;
+      self.next(fn);
+    }
+  });
+
+  return this;
+};
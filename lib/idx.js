@@ -5,6 +5,7 @@ var Assert = require('assert'),
     Kyoto = require('./kyoto'),
     Key = require('./key'),
     Gen = require('./generators'),
+    Collate = require('./collate'),
     U = require('./util');
 
 exports.IndexSet = IndexSet;
@@ -21,7 +22,8 @@ Type.create(IndexSet);
 function IndexSet(type) {
   this.type = type;
   this.indicies = null;
-  this._match = new RegExp('^%' + Type.name(type) + '\\.([^{]+)');
+  this._layout = undefined;
+  this._layoutFormat = undefined;
 }
 
 // ### Index Declaration ###
@@ -43,6 +45,7 @@ IndexSet.include({
       throw new Error('Duplicate index: ' + index.name);
 
     this.indicies[index.name] = index;
+    this._layout = undefined;
     return this;
   },
 
@@ -52,6 +55,38 @@ IndexSet.include({
 
   addUnique: function(name, message, value) {
     return this.add(new Unique(this.type, name, message, value));
+  },
+
+  addOrdered: function(name, message, value) {
+    return this.add(new Ordered(this.type, name, message, value));
+  }
+});
+
+// ### Layout ###
+
+// Where every index finds its value in a stored JSON document, so
+// native code can work out a record's index entries without loading
+// it (see `PolyDB.replaceDiffed()`). It's null if some index can't be
+// described this way because it derives its value or isn't on a
+// nullable primitive field. Prefixes are in the database's key
+// `format`, so it's remade for a database with another one.
+
+IndexSet.include({
+  layout: function(format) {
+    if (this._layout !== undefined && this._layoutFormat === format)
+      return this._layout;
+
+    var layout = [];
+    this.each(function(idx) {
+      var item = idx.layout(format);
+      if (!item)
+        layout = null;
+      else if (layout)
+        layout.push(item);
+    });
+
+    this._layoutFormat = format;
+    return (this._layout = layout);
   }
 });
 
@@ -63,34 +98,37 @@ IndexSet.include({
     return this;
   },
 
-  calculate: function(obj, key) {
+  calculate: function(obj, key, format) {
     if (!this.indicies)
       return null;
 
     var values = {};
     this.each(function(idx) {
-      idx.calculate(obj, key, values);
+      idx.calculate(obj, key, values, format);
     });
 
     return values;
   },
 
-  addErrors: function(invalid, obj) {
+  addErrors: function(invalid, obj, format) {
     if (!this.indicies)
       return obj;
 
     var self = this;
     U.each(invalid, function(val, name) {
-      var probe = self.matchIndex(name);
+      var probe = self.matchIndex(name, format);
       (probe || self).addError(val, name, obj);
     });
 
     return obj;
   },
 
-  matchIndex: function(name) {
-    var probe = name.match(this._match);
-    return probe && this.get(probe[1]);
+  matchIndex: function(name, format) {
+    var fullName = Key.indexName(name, format),
+        prefix = Type.name(this.type) + '.';
+    if (!fullName || fullName.substr(0, prefix.length) != prefix)
+      return undefined;
+    return this.get(fullName.substr(prefix.length));
   },
 
   addError: function(val, name, obj) {
@@ -136,21 +174,60 @@ Index.extend({
 });
 
 Index.include({
-  prefix: function(val) {
-    var prefix = '%' + this.fullName + '{';
+  unique: false,
+
+  // Entry keys are spelled in the database's key `format`.
+  prefix: function(val, format) {
+    var prefix = Key.indexPrefix(this.fullName, format) + '{';
     if (val !== undefined)
       prefix += val + '}';
     return prefix;
   },
 
-  key: function(obj, key, val) {
-    return this.prefix(val) + key;
+  key: function(obj, key, val, format) {
+    return this.prefix(val, format) + key;
+  },
+
+  // The prefix of the entries for objects with this value.
+  valuePrefix: function(value, format) {
+    return this.prefix(generateValue(this, value), format);
+  },
+
+  // A prefix, the path to the value and a mode, see `IndexSet.layout()`.
+  layout: function(format) {
+    var field = this.field,
+        primary = field.primaryType && field.primaryType();
+
+    if (this.deriveValue || !primary || !LAYOUT_TYPES[Schema.name(primary)])
+      return null;
+
+    return [
+      this.prefix(undefined, format),
+      [JSON.stringify(field.name), JSON.stringify(Schema.memberName(Schema.schema(primary)))],
+      this.mode()
+    ];
+  },
+
+  mode: function() {
+    return this.ordered ? LAYOUT.ORDERED : this.unique ? LAYOUT.UNIQUE : LAYOUT.PLAIN;
+  },
+
+  // The value `obj` is indexed under, or a nullish value if it has
+  // no entry.
+  value: function(obj, key, format) {
+    return deriveValue(this, obj, key, format);
   },
 
-  calculate: function(obj, key, values) {
-    var val = deriveValue(this, obj, key);
+  // The value of a group counted natively from the entries (see
+  // `PolyDB.aggregate()`): plain entries hold the value's text.
+  groupValue: function(text) {
+    return text;
+  },
+
+  calculate: function(obj, key, values, format) {
+    var val = deriveValue(this, obj, key, format);
     if (!U.isNullish(val)) {
-      values[this.key(obj, key, val)] = key;
+      values[this.key(obj, key, val, format)] = key;
     }
   },
 
@@ -166,12 +243,11 @@ Index.include({
 
     var prefix;
     if (value === undefined)
-      prefix = this.prefix();
+      prefix = this.prefix(undefined, store.keyFormat);
     else
-      prefix = this.prefix(generateValue(this, value));
+      prefix = this.valuePrefix(value, store.keyFormat);
 
-    var iter = store.db.generate(prefix, done);
-    return new Gen.TakeWhile(iter, prefixMatches(prefix));
+    return store.db.generateRange({ prefix: prefix }, done);
   },
 
   each: function(store, done, fn) {
@@ -185,6 +261,9 @@ Index.include({
   }
 });
 
+var LAYOUT = { PLAIN: 0, UNIQUE: 1, ORDERED: 2 },
+    LAYOUT_TYPES = { 'string': true, 'boolean': true, 'int': true, 'long': true, 'float': true, 'double': true };
+
 function prefixRegExp(prefix) {
   var regexp = new RegExp('^' + U.escapeRegExp(prefix));
   return function match(val, key) {
@@ -192,13 +271,7 @@ function prefixRegExp(prefix) {
   };
 }
 
-function prefixMatches(prefix) {
-  return function match(val, key) {
-    return U.startsWith(key, prefix);
-  };
-}
-
-function deriveValue(index, obj, key) {
+function deriveValue(index, obj, key, format) {
   var field = index.field;
 
   if (!index.deriveValue)
@@ -208,7 +281,7 @@ function deriveValue(index, obj, key) {
 
   // A special case for self-references.
   if (val === obj)
-    val = Key.parse(key).id;
+    val = Key.parse(key, format).id;
   else if (!U.isPrimitiveJSON(val))
     val = index.field.indexValue(obj[field.name]);
 
@@ -238,11 +311,92 @@ Unique.extend({
 });
 
 Unique.include({
-  key: function(obj, key, val) {
-    return this.prefix(val);
+  unique: true,
+
+  key: function(obj, key, val, format) {
+    return this.prefix(val, format);
   }
 });
 
+
+// ## Ordered Index ##
+
+// Like a plain index, but values are encoded so their entries are in
+// value order (see `Collate.encodeValue()`): numbers sort as numbers
+// and strings by their UTF-8 bytes. That lets an ordered index answer
+// range queries and walk objects in order. Objects without a value
+// are indexed under `null`, which sorts first, so every object of the
+// type is in the index.
+
+Type.create(Ordered, Index);
+function Ordered(type, name, message, value) {
+  if (typeof message == 'function') {
+    value = message;
+    message = undefined;
+  }
+  Index.call(this, type, name, message, value);
+}
+
+Ordered.include({
+  ordered: true,
+
+  prefix: function(val, format) {
+    var prefix = Key.indexPrefix(this.fullName, format) + '<';
+    if (val !== undefined)
+      prefix += Collate.encodeValue(val);
+    return prefix;
+  },
+
+  calculate: function(obj, key, values, format) {
+    var val = deriveValue(this, obj, key, format);
+    values[this.key(obj, key, U.isNullish(val) ? null : val, format)] = key;
+  },
+
+  groupValue: function(text) {
+    return Collate.decodeValue(text);
+  },
+
+  // The key range holding entries with values between the bounds of
+  // `range`, an Object with any of `$gt`, `$gte`, `$lt` and `$lte`.
+  // With only one bound, the range stops at values of another type.
+  keyRange: function(range, format) {
+    var prefix = this.prefix(undefined, format),
+        lower = firstDefined(range.$gt, range.$gte),
+        upper = firstDefined(range.$lt, range.$lte),
+        start, end;
+
+    if (lower !== undefined) {
+      start = prefix + Collate.encodeValue(lower);
+      if (range.$gt !== undefined)
+        start = Collate.successor(start);
+    }
+    else if (upper !== undefined)
+      start = prefix + typeTag(upper);
+
+    if (upper !== undefined) {
+      end = prefix + Collate.encodeValue(upper);
+      if (range.$lt === undefined)
+        end = Collate.successor(end);
+    }
+    else if (lower !== undefined)
+      end = Collate.successor(prefix + typeTag(lower));
+
+    return { prefix: prefix, start: start, end: end };
+  },
+
+  generateRange: function(store, range, done) {
+    return store.db.generateRange(this.keyRange(range || {}, store.keyFormat), done);
+  }
+});
+
+function typeTag(val) {
+  return Collate.encodeValue(val).charAt(0);
+}
+
+function firstDefined(a, b) {
+  return (a !== undefined) ? a : b;
+}
+
 
 // ## Transaction ##
 
@@ -258,7 +412,7 @@ Manager.include({
   mergeErrors: function(err, obj, key, next) {
     if (err && err.invalid) {
       var type = Type.of(obj);
-      type.addIndexErrors(err.invalid, obj);
+      type.addIndexErrors(err.invalid, obj, this.store.keyFormat);
       if (err.message == 'index-error') {
         err = type.firstError(obj) || err;
       }
@@ -273,7 +427,7 @@ Manager.include({
 
     this.withLock(key, done, function(unlock) {
       done = unlock;
-      store.get(key, existing);
+      store.fetch(key, existing);
     });
 
     function existing(err, orig) {
@@ -284,7 +438,7 @@ Manager.include({
         done(duprec(key));
       }
       else {
-        next(type.calculateIndex(obj, key), done);
+        next(type.calculateIndex(obj, key, store.keyFormat), done);
       }
     }
 
@@ -298,7 +452,7 @@ Manager.include({
 
     this.withLock(key, done, function(unlock) {
       done = unlock;
-      store.get(key, existing);
+      store.fetch(key, existing);
     });
 
     function existing(err, orig) {
@@ -309,7 +463,7 @@ Manager.include({
         done(norec(key));
       }
       else {
-        var newIdx = type.calculateIndex(obj, key);
+        var newIdx = type.calculateIndex(obj, key, store.keyFormat);
         next(newIdx, self.diffIndex(newIdx, orig, key), done);
       }
     }
@@ -324,7 +478,7 @@ Manager.include({
 
     this.withLock(key, done, function(unlock) {
       done = unlock;
-      store.get(key, existing);
+      store.fetch(key, existing);
     });
 
     function existing(err, orig) {
@@ -335,7 +489,7 @@ Manager.include({
         done(norec(key));
       }
       else {
-        var oldIdx = type.calculateIndex(orig, key),
+        var oldIdx = type.calculateIndex(orig, key, store.keyFormat),
             removeKeys = oldIdx && Object.keys(oldIdx);
         next(removeKeys, done);
       }
@@ -345,17 +499,7 @@ Manager.include({
   },
 
   diffIndex: function(index, obj, key) {
-    var other = Type.of(obj).calculateIndex(obj, key),
-        diff = null;
-
-    for (var name in other) {
-      if (!index.hasOwnProperty(name)) {
-        if (!diff) diff = [];
-        diff.push(name);
-      }
-    }
-
-    return diff;
+    return removedEntries(index, Type.of(obj).calculateIndex(obj, key, this.store.keyFormat));
   },
 
   // Validate that any index changes about to be made for `obj` will
@@ -365,39 +509,42 @@ Manager.include({
   // validation-time and save-time.
   validate: function(obj, next) {
     var type = Type.of(obj),
-        set = type.indicies;
+        set = type.indicies,
+        format = this.store.keyFormat;
 
     if (set.isEmpty()) {
       next(null, obj);
       return this;
     }
 
-    var key = obj.__hasKey__() ? obj.__key__() : undefined,
-        expect = {};
+    var key = obj.__hasKey__() ? obj.__key__(false, format) : undefined,
+        expect = {},
+        names;
 
     set.each(function(idx) {
       if (Type.isInstance(idx, Unique)) {
         var name = idx.name;
         if (name && !(name in obj.errors))
-          idx.calculate(obj, key, expect);
+          idx.calculate(obj, key, expect, format);
       }
     });
 
     // !! Accesssing lower-level db here
-    this.store.db.getBulk(Object.keys(expect), true, function(err, data) {
+    names = Object.keys(expect);
+    this.store.db.getList(names, true, function(err, data) {
       err ? next(err, obj) : verify(data);
     });
 
     function verify(snapshot) {
       var invalid = {};
 
-      for (var key in snapshot) {
-        if (expect[key] != snapshot[key]) {
-          invalid[key] = snapshot[key];
+      for (var i = 0, l = names.length; i < l; i++) {
+        if (snapshot[i] !== undefined && expect[names[i]] != snapshot[i]) {
+          invalid[names[i]] = snapshot[i];
         }
       }
 
-      type.addIndexErrors(invalid, obj);
+      type.addIndexErrors(invalid, obj, format);
       next(null, obj);
     }
 
@@ -405,6 +552,340 @@ Manager.include({
   }
 });
 
+// ### Writing ###
+
+// Index entries removed by a write are the stored record's entries
+// that the new version doesn't have. When the type's indicies have a
+// layout and documents are JSON, native code finds them inside the
+// write's transaction, so nothing is read beforehand and no lock is
+// needed. Otherwise the original is fetched under the key's lock and
+// diffed here.
+
+Manager.include({
+  replace: function(obj, key, data, done) {
+    var self = this,
+        layout = this.layout(obj);
+
+    if (!layout)
+      return this.replaceLocked(obj, key, data, done);
+
+    this.store.db.replaceDiffed(key, data, Type.of(obj).calculateIndex(obj, key, this.store.keyFormat), layout, function(err) {
+      if (err && err.message == 'index-unreadable')
+        self.replaceLocked(obj, key, data, done);
+      else
+        done(err);
+    });
+
+    return this;
+  },
+
+  remove: function(obj, key, done) {
+    var self = this,
+        layout = this.layout(obj);
+
+    if (!layout)
+      return this.removeLocked(obj, key, done);
+
+    this.store.db.removeDiffed(key, layout, function(err) {
+      if (err && err.message == 'index-unreadable')
+        self.removeLocked(obj, key, done);
+      else
+        done(err);
+    });
+
+    return this;
+  },
+
+  replaceLocked: function(obj, key, data, done) {
+    var db = this.store.db;
+
+    return this.prepareReplace(obj, key, done, function(newIdx, removeKeys, next) {
+      db.replaceIndexed(key, data, newIdx, removeKeys, next);
+    });
+  },
+
+  removeLocked: function(obj, key, done) {
+    var db = this.store.db;
+
+    return this.prepareRemove(obj, key, done, function(removeKeys, next) {
+      db.removeIndexed(key, removeKeys, next);
+    });
+  },
+
+  // Read, change and replace a record while holding its lock, so
+  // other locked writers of `key` wait for it. `change` receives the
+  // stored object, changes it and calls back with an error or its new
+  // serialized form; `done` receives the changed object.
+  modify: function(key, change, next) {
+    var store = this.store,
+        obj, oldIdx, done;
+
+    this.withLock(key, finish, function(unlock) {
+      done = unlock;
+      store.fetch(key, existing);
+    });
+
+    function existing(err, orig) {
+      if (err) {
+        done(err);
+      }
+      else if (!orig) {
+        done(norec(key));
+      }
+      else {
+        obj = orig;
+        oldIdx = Type.of(obj).calculateIndex(obj, key, store.keyFormat);
+        change(obj, changed);
+      }
+    }
+
+    function changed(err, data) {
+      if (err)
+        return done(err);
+
+      var newIdx = Type.of(obj).calculateIndex(obj, key, store.keyFormat);
+      store.db.replaceIndexed(key, data, newIdx, removedEntries(newIdx, oldIdx), done);
+    }
+
+    function finish(err) {
+      next(err, obj);
+    }
+
+    return this;
+  },
+
+  layout: function(obj) {
+    return this.store.binary ? null : Type.of(obj).indicies.layout(this.store.keyFormat);
+  }
+});
+
+// ### Maintenance ###
+
+// Build an index over objects stored before it was declared, or check
+// an index against its objects, while the database stays in use.
+// Records are read and repaired in native batches (see
+// `KyotoDB.buildIndex()`); documents native code can't read, and
+// indicies without a layout, are loaded and handled here instead. A
+// repairing run saves its position after each batch, so starting it
+// again continues where it stopped. With compact keys, the tags of
+// the index's entries and marker are saved before the first batch
+// (see `Storage.saveTags()`).
+//
+// Options:
+//
+//   + batch    - Number of records per batch (default: 1000)
+//   + repair   - Boolean add or remove entries (default: true)
+//   + restart  - Boolean ignore a saved position (optional)
+//   + progress - Function(Object report) called after each batch
+//
+// The callback receives a report with `scanned` and `changed` counts
+// and a list of `conflicts`: pairs of an entry key that a build
+// couldn't add and the key of the record holding it.
+
+var MAINTENANCE_BATCH = 1000;
+
+Manager.include({
+  build: function(type, name, options, next) {
+    return this.maintain('build', type, name, options, next);
+  },
+
+  check: function(type, name, options, next) {
+    return this.maintain('check', type, name, options, next);
+  },
+
+  maintain: function(job, type, name, options, next) {
+    var self = this,
+        store = this.store,
+        db = store.db,
+        format = store.keyFormat,
+        index = type.indicies.get(name),
+        report = { scanned: 0, changed: 0, conflicts: [] },
+        repair, layout, range, marker;
+
+    if (typeof options == 'function') {
+      next = options;
+      options = undefined;
+    }
+
+    options = options || {};
+    repair = (options.repair !== false);
+
+    if (!index) {
+      next(new Error(job + ': ' + Type.name(type) + ' has no index `' + name + '`.'));
+      return this;
+    }
+
+    layout = store.binary ? null : index.layout(format);
+    marker = Key.indexPrefix(index.fullName, format) + '#' + job;
+    range = {
+      prefix: (job == 'build') ? Key.prefix(type, format) : index.prefix(undefined, format),
+      limit: options.batch || MAINTENANCE_BATCH
+    };
+
+    if (!repair)
+      start(null);
+    else
+      store.saveTags(function(err) {
+        if (err)
+          next(err);
+        else if (options.restart)
+          start(null);
+        else
+          db.get(marker, function(err, val) {
+            err ? next(err) : start(val);
+          });
+      });
+
+    function start(resume) {
+      range.start = resume || range.prefix;
+      batch();
+    }
+
+    function batch() {
+      if (layout)
+        db[job + 'Index'](range, [layout], repair, batched);
+      else
+        db.scanRange(U.extend({ keysOnly: true }, range), function(err, vals, keys, more) {
+          batched(err, {
+            scanned: keys && keys.length,
+            next: more ? keys[keys.length - 1] + '\0' : null,
+            changed: [],
+            conflicts: [],
+            unreadable: keys
+          });
+        });
+    }
+
+    function batched(err, result) {
+      if (err)
+        return next(err);
+
+      report.scanned += result.scanned;
+      report.changed += result.changed.length;
+      report.conflicts.push.apply(report.conflicts, result.conflicts);
+
+      self[job + 'Loaded'](index, result.unreadable, repair, report, function(err) {
+        if (err)
+          next(err);
+        else if (options.progress && options.progress(report) === false)
+          next(null, report);
+        else if (result.next === null)
+          finish();
+        else if (!repair)
+          resume(result.next);
+        else
+          db.set(marker, result.next, function(err) {
+            err ? next(err) : resume(result.next);
+          });
+      });
+    }
+
+    function resume(key) {
+      range.start = key;
+      batch();
+    }
+
+    function finish() {
+      if (!repair)
+        return next(null, report);
+
+      db.remove(marker, function(err) {
+        (err && err.code != Kyoto.NOREC) ? next(err) : next(null, report);
+      });
+    }
+
+    return this;
+  },
+
+  // Add the entries of objects that native code couldn't read.
+  buildLoaded: function(index, keys, repair, report, next) {
+    var store = this.store,
+        db = store.db;
+
+    U.aEach(keys, next, function(key, _, next) {
+      store.fetch(key, function(err, obj) {
+        var entries = {};
+
+        if (err || !obj)
+          return next(err);
+
+        index.calculate(obj, key, entries, store.keyFormat);
+        U.aEach(Object.keys(entries), next, function(entry, _, next) {
+          db.get(entry, function(err, holder) {
+            if (err)
+              next(err);
+            else if (holder !== undefined && holder != key)
+              conflict(entry, holder, next);
+            else if (holder !== undefined)
+              next();
+            else if (!repair)
+              next(null, report.changed++);
+            else
+              add(entry, key, next);
+          });
+        });
+      });
+    });
+
+    function add(entry, key, next) {
+      store.saveTags(function(err) {
+        if (err)
+          return next(err);
+
+        db.add(entry, key, function(err) {
+          if (err && err.code == Kyoto.DUPREC)
+            db.get(entry, function(err, holder) {
+              err ? next(err) : conflict(entry, holder, next);
+            });
+          else
+            next(err, report.changed++);
+        });
+      });
+    }
+
+    function conflict(entry, holder, next) {
+      report.conflicts.push([entry, holder]);
+      next();
+    }
+
+    return this;
+  },
+
+  // Remove index entries whose objects couldn't be read natively and
+  // don't have them anymore.
+  checkLoaded: function(index, entries, repair, report, next) {
+    var store = this.store,
+        db = store.db;
+
+    U.aEach(entries, next, function(entry, _, next) {
+      db.get(entry, function(err, key) {
+        if (err || key === undefined)
+          return next(err);
+
+        store.fetch(key, function(err, obj) {
+          var expect = {};
+
+          if (err)
+            return next(err);
+          else if (obj)
+            index.calculate(obj, key, expect, store.keyFormat);
+
+          if (expect[entry] == key)
+            next();
+          else if (!repair)
+            next(null, report.changed++);
+          else
+            db.remove(entry, function(err) {
+              (err && err.code != Kyoto.NOREC) ? next(err) : next(null, report.changed++);
+            });
+        });
+      });
+    });
+
+    return this;
+  }
+});
+
 // ### Locking ###
 
 // Each key has a wait-queue so write-operations against the same key
@@ -454,6 +935,20 @@ Manager.include({
 
 // ## Helpers ##
 
+// The entries in `other` that aren't in `index`, or null.
+function removedEntries(index, other) {
+  var diff = null;
+
+  for (var name in other) {
+    if (!index.hasOwnProperty(name)) {
+      if (!diff) diff = [];
+      diff.push(name);
+    }
+  }
+
+  return diff;
+}
+
 function pushInto(obj, key, value) {
   var queue = obj[key];
   if (!queue)
@@ -480,7 +975,7 @@ function duprec(key) {
   return KyotoError(Kyoto.DUPREC, 'duplicate record', key);
 }
 
-function duprec(key) {
+function norec(key) {
   return KyotoError(Kyoto.NOREC, 'no record', key);
 }
 
@@ -8,13 +8,38 @@ exports.ObjectId = ObjectId;
 exports.RandomId = RandomId;
 exports.make = make;
 exports.parse = parse;
+exports.prefix = prefix;
+exports.indexPrefix = indexPrefix;
+exports.indexName = indexName;
+exports.PlainFormat = PlainFormat;
+exports.CompactFormat = CompactFormat;
+
+// Keys are spelled in the format of the database they belong to (see
+// `Storage.keyFormat`). Without one, they're plain.
 
 function make(type, id) {
   return Key.make(type, id);
 }
 
-function parse(key) {
-  return Key.parse(key);
+function parse(key, format) {
+  return Key.parse(key, format);
+}
+
+// The prefix of every key of `type`.
+function prefix(type, format) {
+  return (format || PLAIN).typePrefix(Avro.name(type));
+}
+
+// The prefix of every key that belongs to an index, followed by "{"
+// for plain entries, "<" for ordered ones and "#" for maintenance
+// markers (see idx.js).
+function indexPrefix(fullName, format) {
+  return (format || PLAIN).indexPrefix(fullName);
+}
+
+// The full name of the index an entry key belongs to, or null.
+function indexName(key, format) {
+  return (format || PLAIN).indexName(key);
 }
 
 Type.create(Key);
@@ -28,17 +53,17 @@ Key.extend({
     return (new Key(Avro.name(type), id));
   },
 
-  parse: function(str) {
-    var parts = str.toString().split('/');
-    if (parts.length != 2)
-      throw new Avro.ValueError('Badly formatted key', data);
+  parse: function(str, format) {
+    var parts = (format || PLAIN).split(str.toString());
+    if (!parts)
+      throw new Avro.ValueError('Badly formatted key', str);
     return new Key(parts[0], parts[1]);
   }
 });
 
 Key.include({
-  toString: function() {
-    return this.kind + '/' + this.id;
+  toString: function(format) {
+    return (format || PLAIN).typePrefix(this.kind) + this.id;
   },
 
   type: function() {
@@ -48,6 +73,149 @@ Key.include({
   }
 });
 
+
+
+// ## Key Formats ##
+
+// How names are spelled in keys. Each database has its own format,
+// chosen when it's opened.
+
+// ### Plain Keys ###
+
+// Names are spelled out: objects are keyed `Type/id` and index
+// entries start with `%Type.field`.
+
+function PlainFormat() {
+}
+
+PlainFormat.prototype.compact = false;
+
+PlainFormat.prototype.typePrefix = function(name) {
+  return name + '/';
+};
+
+PlainFormat.prototype.indexPrefix = function(fullName) {
+  return '%' + fullName;
+};
+
+PlainFormat.prototype.split = function(str) {
+  var parts = str.split('/');
+  return (parts.length == 2) ? parts : null;
+};
+
+PlainFormat.prototype.indexName = function(key) {
+  var probe = key.match(/^%([^{<#]+)/);
+  return probe && probe[1];
+};
+
+// ### Compact Keys ###
+
+// Type and index names are replaced by numeric tags, so an object is
+// keyed by its type's tag and id and an index entry starts with the
+// index's tag. Tags are numbers from 1, written as a varint of 6-bit
+// digits, most significant first: the last digit is a character
+// below "@" and the others are "@" and above. That takes one
+// character for the first 63 names and no tag is a prefix of
+// another, so keys of a type or index still share a prefix and keep
+// the order they had after it.
+//
+// Tags are assigned as names are first used. `tags` holds the ones
+// already saved; new ones wait in `unsaved` until `takeUnsaved()`
+// hands them over to be written.
+
+function CompactFormat(tags) {
+  this.tags = {};
+  this.names = {};
+  this.codes = {};
+  this.last = 0;
+  this.unsaved = null;
+
+  for (var name in (tags || {}))
+    this.assign(name, tags[name]);
+}
+
+CompactFormat.prototype.compact = true;
+
+CompactFormat.prototype.assign = function(name, tag) {
+  this.tags[name] = tag;
+  this.names[tag] = name;
+  this.codes[name] = encodeTag(tag);
+  this.last = Math.max(this.last, tag);
+  return this.codes[name];
+};
+
+// The encoded tag of a name, assigning one if it's new.
+CompactFormat.prototype.code = function(name) {
+  var code = this.codes[name];
+  if (code === undefined) {
+    code = this.assign(name, this.last + 1);
+    (this.unsaved || (this.unsaved = {}))[name] = this.tags[name];
+  }
+  return code;
+};
+
+// The tags assigned since the last call, or null.
+CompactFormat.prototype.takeUnsaved = function() {
+  var tags = this.unsaved;
+  this.unsaved = null;
+  return tags;
+};
+
+// Tags from `takeUnsaved()` that couldn't be written.
+CompactFormat.prototype.returnUnsaved = function(tags) {
+  for (var name in tags)
+    (this.unsaved || (this.unsaved = {}))[name] = tags[name];
+  return this;
+};
+
+CompactFormat.prototype.typePrefix = function(name) {
+  return this.code(name);
+};
+
+CompactFormat.prototype.indexPrefix = function(fullName) {
+  return this.code(fullName);
+};
+
+CompactFormat.prototype.split = function(str) {
+  var probe = decodeTag(str),
+      name = probe && this.names[probe.tag];
+  return name ? [name, str.substr(probe.length)] : null;
+};
+
+CompactFormat.prototype.indexName = function(key) {
+  var probe = decodeTag(key);
+  return (probe && this.names[probe.tag]) || null;
+};
+
+function encodeTag(tag) {
+  var code = String.fromCharCode(tag & 0x3f);
+  while ((tag = Math.floor(tag / 64)) > 0)
+    code = String.fromCharCode(0x40 | (tag & 0x3f)) + code;
+  return code;
+}
+
+// The tag at the start of `str` and the number of characters it
+// takes, or null.
+function decodeTag(str) {
+  var tag = 0, c;
+
+  for (var i = 0, l = str.length; i < l; i++) {
+    c = str.charCodeAt(i);
+    if (c >= 0x80)
+      return null;
+    tag = tag * 64 + (c & 0x3f);
+    if (c < 0x40)
+      return { tag: tag, length: i + 1 };
+  }
+
+  return null;
+}
+
+var PLAIN = new PlainFormat();
+
+
+// ## Ids ##
+
 function ObjectId() {
   var buf = new Buffer(7);
   U.writeInt(Math.floor(Date.now() / 1000), buf, 0, 4);
@@ -1,4 +1,5 @@
 var K = require('../build/default/_kyoto'),
+    ReadStream = require('./stream').ReadStream,
     NOREC = K.PolyDB.NOREC;
 
 exports.open = open;
@@ -52,8 +53,17 @@ function open(path, mode, next) {
 
 function KyotoDB() {
   this.db = null;
+  this.inMemory = false;
+  this.commitOptions = null;
+  this.poolThreads = 0;
 }
 
+// Paths of the on-memory database types. Point operations on them
+// take a few microseconds, less than a trip through the thread pool,
+// so they're run synchronously (see `getSync()`). Callbacks are still
+// called on a later tick.
+var MEMORY_PATH = /^[\-\+:\*%](#|$)/;
+
 // Open a database.
 //
 // The type of database is determined by the extension of `path`:
@@ -111,11 +121,17 @@ KyotoDB.prototype.open = function(path, mode, next) {
   }
 
   var db = new K.PolyDB();
+  if (this.poolThreads > 0)
+    db.workerPool(this.poolThreads);
+
   db.open(path, omode, function(err) {
     if (err)
       next.call(self, err);
     else {
       self.db = db;
+      self.inMemory = MEMORY_PATH.test(path);
+      if (self.commitOptions)
+        self.groupCommit(self.commitOptions);
       next.call(self, null);
     }
   });
@@ -159,22 +175,137 @@ KyotoDB.prototype.closeSync = function() {
   return this;
 };
 
+// Configure group commit for indexed writes. Indexed writes are
+// queued and applied together, one transaction per batch. A batch is
+// written once `maxOps` writes are waiting or `window` milliseconds
+// after the first one was queued. Writes queued while a batch is
+// being written always wait for the next batch.
+//
+// Settings may be given before the database is opened.
+//
+// + options - Object settings, or `false` to turn grouping off.
+//   + window - Number milliseconds (optional, default: 0)
+//   + maxOps - Number largest batch (optional, default: 128)
+//
+// Returns self.
+KyotoDB.prototype.groupCommit = function(options) {
+  if (options === false)
+    options = { maxOps: 0 };
+
+  this.commitOptions = options;
+  if (this.db !== null)
+    this.db.groupCommit(
+      options.window || 0,
+      (options.maxOps === undefined) ? 128 : options.maxOps
+    );
+
+  return this;
+};
+
+// Group commit statistics, useful for tuning `groupCommit()`. Times
+// are in milliseconds.
+//
+//   + batches      - Number of transactions committed.
+//   + operations   - Number of writes in them.
+//   + largestBatch - Number of writes in the largest batch.
+//   + meanBatch    - Average writes per batch.
+//   + latency      - Total time writes spent queued and committing.
+//   + meanLatency  - Average time per write.
+//   + maxLatency   - Longest time for one write.
+//   + commitTime   - Total time spent in transactions.
+//   + pending      - Number of writes waiting now.
+//
+// + reset - Boolean start counting again (optional)
+//
+// Returns stats Object or null if the database is closed.
+KyotoDB.prototype.writeStats = function(reset) {
+  if (this.db === null)
+    return null;
+
+  var stats = this.db.writeStats(!!reset);
+  stats.meanBatch = stats.batches ? stats.operations / stats.batches : 0;
+  stats.meanLatency = stats.operations ? stats.latency / stats.operations : 0;
+  return stats;
+};
+
+// Run this database's requests on a pool of its own threads instead
+// of the thread pool Node uses for file system calls, so neither can
+// starve the other. Point operations are taken ahead of bulk reads,
+// writes and scans. This must be set before the database is opened.
+//
+// + threads - Number of worker threads (0 to share Node's pool)
+//
+// Returns self.
+KyotoDB.prototype.workerPool = function(threads) {
+  if (this.db !== null)
+    throw new Error('workerPool: set this before opening the database.');
+  this.poolThreads = threads;
+  return this;
+};
+
+// Worker pool statistics, or null without a pool. For both the
+// `point` and `scan` lanes, there are `depth` (jobs waiting now),
+// `maxDepth`, `submitted` and `completed` counts. There are also the
+// number of `threads` and how many are `busy`.
+//
+// + reset - Boolean start counting again (optional)
+//
+// Returns stats Object or null.
+KyotoDB.prototype.poolStats = function(reset) {
+  return this.db && this.db.poolStats(!!reset);
+};
+
+// Counts and latencies for each native operation this database has
+// run, keyed by method name (cursor methods start with `cursor.`).
+// Every operation has:
+//
+//   + count    - Number of calls.
+//   + bytesIn  - Bytes of keys and values passed in.
+//   + bytesOut - Bytes of keys and values returned.
+//   + errors   - Number of failures, by Kyoto error name.
+//   + queue    - Time from the call until a thread ran it.
+//   + exec     - Time spent running it.
+//   + callback - Time spent in its callback.
+//   + total    - Time from the call until its callback returned.
+//
+// The four times are histograms with `count`, `mean`, `min`, `max`
+// and `p50`, `p90`, `p99` and `p999` percentiles, in milliseconds.
+// Percentiles are accurate to about 12%. Synchronous methods like
+// `getSync` don't queue or call back, so only `exec` applies.
+//
+// + reset - Boolean start counting again (optional)
+//
+// Returns stats Object or null if the database is closed.
+KyotoDB.prototype.stats = function(reset) {
+  return this.db && this.db.stats(!!reset);
+};
+
 // Get a value from the database.
 //
 // If the value does not exist, `next` is called with a `null` error
 // and an undefined `value`.
 //
-// + key  - String key.
-// + next - Function(Error, String value, String key) callback
+// + key      - String or Buffer key.
+// + asBuffer - Boolean read the value as a Buffer (optional)
+// + next     - Function(Error, String value, String key) callback
 //
 // Returns self.
-KyotoDB.prototype.get = function(key, next) {
+KyotoDB.prototype.get = function(key, asBuffer, next) {
   var self = this;
 
+  if (typeof asBuffer == 'function') {
+    next = asBuffer;
+    asBuffer = false;
+  }
+
   if (this.db === null)
     next.call(this, new Error('get: database is closed.'));
+  else if (this.inMemory)
+    callSync(this, this.db, next, function(db) {
+      return [db.getSync(key, !!asBuffer), key];
+    });
   else
-    this.db.get(key, function(err, val) {
+    this.db.get(key, !!asBuffer, function(err, val) {
       if (err && err.code == NOREC)
         next.call(self, null, undefined, key);
       else if (err)
@@ -186,18 +317,34 @@ KyotoDB.prototype.get = function(key, next) {
   return this;
 };
 
-KyotoDB.prototype.getBulk = function(keys, atomic, next) {
+// Get several values at once.
+//
+// + keys     - Array of String or Buffer keys.
+// + atomic   - Boolean read all values in one transaction (optional)
+// + asBuffer - Boolean read values as Buffers (optional)
+// + next     - Function(Error, Object items, Array keys) callback
+//
+// Returns self.
+KyotoDB.prototype.getBulk = function(keys, atomic, asBuffer, next) {
   var self = this;
 
   if (typeof atomic == 'function') {
     next = atomic;
-    atomic = undefined;
+    atomic = asBuffer = undefined;
+  }
+  else if (typeof asBuffer == 'function') {
+    next = asBuffer;
+    asBuffer = undefined;
   }
 
   if (this.db === null)
     next.call(this, new Error('getBulk: database is closed.'));
+  else if (this.inMemory)
+    callSync(this, this.db, next, function(db) {
+      return [db.getBulkSync(keys, !!atomic, !!asBuffer), keys];
+    });
   else
-    this.db.getBulk(keys, !!atomic, function(err, items) {
+    this.db.getBulk(keys, !!atomic, !!asBuffer, function(err, items) {
       if (err)
         next.call(self, err);
       else
@@ -207,10 +354,93 @@ KyotoDB.prototype.getBulk = function(keys, atomic, next) {
   return this;
 };
 
+// Get several values at once as an Array in the order of `keys`.
+// Keys that have no record get `undefined`. This is cheaper than
+// `getBulk()` for many keys since no Object is built.
+//
+// + keys     - Array of String or Buffer keys.
+// + atomic   - Boolean read all values in one transaction (optional)
+// + asBuffer - Boolean read values as Buffers (optional)
+// + next     - Function(Error, Array values, Array keys) callback
+//
+// Returns self.
+KyotoDB.prototype.getList = function(keys, atomic, asBuffer, next) {
+  var self = this;
+
+  if (typeof atomic == 'function') {
+    next = atomic;
+    atomic = asBuffer = undefined;
+  }
+  else if (typeof asBuffer == 'function') {
+    next = asBuffer;
+    asBuffer = undefined;
+  }
+
+  if (this.db === null)
+    next.call(this, new Error('getList: database is closed.'));
+  else if (this.inMemory)
+    callSync(this, this.db, next, function(db) {
+      return [db.getListSync(keys, !!atomic, !!asBuffer), keys];
+    });
+  else
+    this.db.getList(keys, !!atomic, !!asBuffer, function(err, vals) {
+      if (err)
+        next.call(self, err);
+      else
+        next.call(self, null, vals, keys);
+    });
+
+  return this;
+};
+
+// Set several values at once.
+//
+// + items  - Object of key/value pairs, values are Strings or Buffers.
+// + atomic - Boolean write all items in one transaction (optional)
+// + next   - Function(Error, Number count) callback
+//
+// Returns self.
+KyotoDB.prototype.setBulk = function(items, atomic, next) {
+  return this.modifyBulk('setBulk', items, atomic, next);
+};
+
+// Remove several keys at once. Keys that don't exist are skipped.
+//
+// + keys   - Array of String or Buffer keys.
+// + atomic - Boolean remove all keys in one transaction (optional)
+// + next   - Function(Error, Number count) callback
+//
+// Returns self.
+KyotoDB.prototype.removeBulk = function(keys, atomic, next) {
+  return this.modifyBulk('removeBulk', keys, atomic, next);
+};
+
+// A low-level helper method. See setBulk() or removeBulk().
+KyotoDB.prototype.modifyBulk = function(method, items, atomic, next) {
+  var self = this;
+
+  if (typeof atomic == 'function') {
+    next = atomic;
+    atomic = undefined;
+  }
+
+  if (!next)
+    next = noop;
+
+  if (this.db === null)
+    next.call(this, new Error(method + ': database is closed.'));
+  else
+    this.db[method](items, !!atomic, function(err, count) {
+      next.call(self, err, count);
+    });
+
+  return this;
+};
+
 // Set a value in the database.
 //
 // + key   - String key
-// + value - String value
+// + value - String or Buffer value
 // + next  - Function(Error, String value, String key) callback
 //
 // Returns self.
@@ -225,7 +455,7 @@ KyotoDB.prototype.set = function(key, val, next) {
 // with code `DUPREC` is raised.
 //
 // + key   - String key
-// + value - String value
+// + value - String or Buffer value
 // + next  - Function(Error, String value, String key) callback
 //
 // Returns self.
@@ -239,7 +469,7 @@ KyotoDB.prototype.add = function(key, val, next) {
 // database, raise an error with code `NOREC`.
 //
 // + key   - String key
-// + value - String value
+// + value - String or Buffer value
 // + next  - Function(Error, String value, String key) callback
 //
 // Returns self.
@@ -261,6 +491,12 @@ KyotoDB.prototype.remove = function(key, next) {
 
   if (this.db === null)
     next.call(this, new Error('remove: database is closed.'));
+  else if (this.inMemory)
+    callSync(this, this.db, next, function(db) {
+      if (!db.removeSync(key))
+        throw noRecord();
+      return [];
+    });
   else
     this.db.remove(key, function(err) {
       next.call(self, err);
@@ -269,6 +505,97 @@ KyotoDB.prototype.remove = function(key, next) {
   return this;
 };
 
+// Change a JSON record in place. Kyoto holds the record's lock while
+// the edits are made, so concurrent updates can't overwrite each
+// other. `edits` is an Array of:
+//
+//   + ['inc', path, Number] - add to the number at `path`
+//   + ['set', path, value]  - replace the value at `path`
+//   + ['push', path, value] - append to the array at `path`
+//
+// A path is an Array of member names, or a String naming a single
+// member. Missing or null members along it are filled in. Values are
+// encoded with `JSON.stringify()`. Edits are made in order and either
+// all of them are written or none are.
+//
+// If the record does not exist, `next` is called with a `null` error
+// and an undefined `value`. An edit that doesn't fit the record fails
+// with an "update-invalid" Error whose `position` is its index.
+//
+// + key      - String key
+// + edits    - Array of edits
+// + asBuffer - Boolean read the new value as a Buffer (optional)
+// + next     - Function(Error, String value, String key) callback
+//
+// Returns self.
+KyotoDB.prototype.update = function(key, edits, asBuffer, next) {
+  var self = this;
+
+  if (typeof asBuffer == 'function') {
+    next = asBuffer;
+    asBuffer = false;
+  }
+
+  if (this.db === null)
+    next.call(this, new Error('update: database is closed.'));
+  else
+    this.db.update(key, edits.map(encodeEdit), !!asBuffer, function(err, val) {
+      if (err && err.code == NOREC)
+        next.call(self, null, undefined, key);
+      else if (err)
+        next.call(self, err);
+      else
+        next.call(self, null, val, key);
+    });
+
+  return this;
+};
+
+// Replace a value only if it's currently `expected`. A missing
+// record never matches.
+//
+// + key      - String key
+// + expected - String or Buffer current value
+// + val      - String or Buffer new value
+// + next     - Function(Error, Boolean swapped, String key) callback
+//
+// Returns self.
+KyotoDB.prototype.cas = function(key, expected, val, next) {
+  var self = this;
+
+  if (!next)
+    next = noop;
+
+  if (this.db === null)
+    next.call(this, new Error('cas: database is closed.'));
+  else
+    this.db.update(key, [[SWAP, null, val, expected]], false, function(err) {
+      if (err && (err.code == NOREC || err.message == 'update-conflict'))
+        next.call(self, null, false, key);
+      else
+        next.call(self, err, !err, key);
+    });
+
+  return this;
+};
+
+var EDITS = { inc: 0, set: 1, push: 2 },
+    SWAP = 3;
+
+function encodeEdit(edit) {
+  var kind = EDITS[edit[0]],
+      path = (typeof edit[1] == 'string') ? [edit[1]] : edit[1];
+
+  if (kind === undefined)
+    throw new Error('update: unrecognized edit "' + edit[0] + '".');
+
+  return [
+    kind,
+    path.map(function(name) { return JSON.stringify(String(name)); }),
+    (kind == EDITS.inc) ? edit[2] : JSON.stringify(edit[2])
+  ];
+}
+
 KyotoDB.prototype.synchronize = function(hard, next) {
   var self = this;
 
@@ -290,6 +617,99 @@ KyotoDB.prototype.synchronize = function(hard, next) {
   return this;
 };
 
+// Write every record to a snapshot file. Writes wait until the
+// snapshot is finished, so it's consistent.
+//
+// Options:
+//
+//   + compress - Boolean deflate the file (optional)
+//   + progress - Function(Number done, Number total) called now and
+//                then while the snapshot is written (optional)
+//
+// + path    - String file name
+// + options - Object (optional)
+// + next    - Function(Error) callback
+//
+// Returns self.
+KyotoDB.prototype.dumpSnapshot = function(path, options, next) {
+  var self = this;
+
+  if (typeof options == 'function') {
+    next = options;
+    options = undefined;
+  }
+
+  options = options || {};
+  next = next || noop;
+
+  if (this.db === null)
+    next.call(this, new Error('dumpSnapshot: database is closed.'));
+  else
+    this.db.dumpSnapshot(path, !!options.compress, options.progress || null, function(err) {
+      next.call(self, err);
+    });
+
+  return this;
+};
+
+// Add every record in a snapshot file written by `dumpSnapshot()`,
+// compressed or not. Records already in the database are kept unless
+// the snapshot has the same key. The `progress` option is the same
+// as for `dumpSnapshot()`, except `total` is -1 if it's not known.
+//
+// + path    - String file name
+// + options - Object (optional)
+// + next    - Function(Error) callback
+//
+// Returns self.
+KyotoDB.prototype.loadSnapshot = function(path, options, next) {
+  var self = this;
+
+  if (typeof options == 'function') {
+    next = options;
+    options = undefined;
+  }
+
+  options = options || {};
+  next = next || noop;
+
+  if (this.db === null)
+    next.call(this, new Error('loadSnapshot: database is closed.'));
+  else
+    this.db.loadSnapshot(path, options.progress || null, function(err) {
+      next.call(self, err);
+    });
+
+  return this;
+};
+
+// Write records in ascending key order, after every key already in
+// the database, without a transaction. This is the fastest way to
+// fill a tree database from sorted data. A key that isn't greater
+// than the one before it fails with a "load-unsorted" Error whose
+// `position` is its index; the records before it are written.
+//
+// + keys - Array of String keys, in byte order
+// + vals - Array of String or Buffer values
+// + next - Function(Error, Number count) callback
+//
+// Returns self.
+KyotoDB.prototype.appendSorted = function(keys, vals, next) {
+  var self = this;
+
+  if (!next)
+    next = noop;
+
+  if (this.db === null)
+    next.call(this, new Error('appendSorted: database is closed.'));
+  else
+    this.db.appendSorted(keys, vals, function(err, count) {
+      next.call(self, err, count);
+    });
+
+  return this;
+};
+
 // A low-level helper method. See add() or set().
 KyotoDB.prototype.modify = function(method, key, val, next) {
   var self = this;
@@ -299,6 +719,11 @@ KyotoDB.prototype.modify = function(method, key, val, next) {
 
   if (this.db === null)
     next.call(this, new Error(method + ': database is closed.'));
+  else if (this.inMemory && method == 'set')
+    callSync(this, this.db, next, function(db) {
+      db.setSync(key, val);
+      return [val, key];
+    });
   else
     this.db[method](key, val, function(err) {
       next.call(self, err, val, key);
@@ -307,6 +732,43 @@ KyotoDB.prototype.modify = function(method, key, val, next) {
   return this;
 };
 
+// ### Synchronous Methods ###
+
+// These return their results and throw errors instead of taking a
+// callback. They're meant for memory databases; on a file database
+// they block the event loop while Kyoto does I/O.
+
+// Returns the value or undefined if there isn't one.
+KyotoDB.prototype.getSync = function(key, asBuffer) {
+  return this.sync('get').getSync(key, !!asBuffer);
+};
+
+KyotoDB.prototype.setSync = function(key, val) {
+  this.sync('set').setSync(key, val);
+  return this;
+};
+
+// Returns false if there was no value to remove.
+KyotoDB.prototype.removeSync = function(key) {
+  return this.sync('remove').removeSync(key);
+};
+
+// Returns an Object of the values found.
+KyotoDB.prototype.getBulkSync = function(keys, atomic, asBuffer) {
+  return this.sync('getBulk').getBulkSync(keys, !!atomic, !!asBuffer);
+};
+
+// Returns an Array of values, see `getList()`.
+KyotoDB.prototype.getListSync = function(keys, atomic, asBuffer) {
+  return this.sync('getList').getListSync(keys, !!atomic, !!asBuffer);
+};
+
+KyotoDB.prototype.sync = function(method) {
+  if (this.db === null)
+    throw new Error(method + 'Sync: database is closed.');
+  return this.db;
+};
+
 KyotoDB.prototype.addIndexed = function(key, val, newIdx, next) {
   var self = this;
 
@@ -323,6 +785,33 @@ KyotoDB.prototype.addIndexed = function(key, val, newIdx, next) {
   return this;
 };
 
+// Add many records with their index entries in one transaction. The
+// arguments are parallel arrays; `newIdx` items may be `null`. If any
+// record fails, nothing is written and the error has a `position`
+// property with the offset of the failed record.
+//
+// + keys   - Array of String keys
+// + vals   - Array of String or Buffer values
+// + newIdx - Array of index Objects
+// + next   - Function(Error) callback
+//
+// Returns self.
+KyotoDB.prototype.addIndexedBulk = function(keys, vals, newIdx, next) {
+  var self = this;
+
+  if (!next)
+    next = noop;
+
+  if (this.db === null)
+    next.call(this, new Error('addIndexedBulk: database is closed.'));
+  else
+    this.db.addIndexedBulk(keys, vals, newIdx, function(err) {
+      next.call(self, err);
+    });
+
+  return this;
+};
+
 KyotoDB.prototype.replaceIndexed = function(key, val, newIdx, removeKeys, next) {
   var self = this;
 
@@ -355,6 +844,77 @@ KyotoDB.prototype.removeIndexed = function(key, removeKeys, next) {
   return this;
 };
 
+// Like `replaceIndexed()` and `removeIndexed()`, but the index
+// entries to remove are found from the stored record using `layout`
+// (see `IndexSet.layout()`), inside the same transaction as the
+// write. Records the layout can't read fail with an
+// "index-unreadable" Error and aren't changed.
+KyotoDB.prototype.replaceDiffed = function(key, val, newIdx, layout, next) {
+  var self = this;
+
+  if (!next)
+    next = noop;
+
+  if (this.db === null)
+    next.call(this, new Error('replaceDiffed: database is closed.'));
+  else
+    this.db.replaceDiffed(key, val, newIdx, layout, function(err) {
+      next.call(self, err, val, key);
+    });
+
+  return this;
+};
+
+KyotoDB.prototype.removeDiffed = function(key, layout, next) {
+  var self = this;
+
+  if (!next)
+    next = noop;
+
+  if (this.db === null)
+    next.call(this, new Error('removeDiffed: database is closed.'));
+  else
+    this.db.removeDiffed(key, layout, function(err) {
+      next.call(self, err);
+    });
+
+  return this;
+};
+
+// Compare a batch of records with one index and optionally repair
+// it (see `PolyDB.buildIndex()` in _kyoto.cc). `buildIndex()` reads
+// documents under `range.prefix` and adds their missing entries;
+// `checkIndex()` reads the index's entries and removes the ones that
+// no longer belong to a record. Both start at `range.start` and read
+// at most `range.limit` records.
+//
+// + range  - Object with `prefix`, `start` and `limit`
+// + layout - Array with one index layout (see `IndexSet.layout()`)
+// + repair - Boolean write the changes found
+// + next   - Function(Error, Object report) callback
+//
+// Returns self.
+KyotoDB.prototype.buildIndex = function(range, layout, repair, next) {
+  return this.maintainIndex('buildIndex', range, layout, repair, next);
+};
+
+KyotoDB.prototype.checkIndex = function(range, layout, repair, next) {
+  return this.maintainIndex('checkIndex', range, layout, repair, next);
+};
+
+KyotoDB.prototype.maintainIndex = function(method, range, layout, repair, next) {
+  var self = this;
+
+  if (this.db === null)
+    next.call(this, new Error(method + ': database is closed.'));
+  else
+    this.db[method](range.prefix, range.start || range.prefix, layout, range.limit || 0, !!repair, function(err, report) {
+      next.call(self, err, report);
+    });
+
+  return this;
+};
+
 KyotoDB.prototype.modifyIndexed = function(method, key, val, newIdx, removeKeys, next) {
   var self = this;
 
@@ -371,6 +931,45 @@ KyotoDB.prototype.modifyIndexed = function(method, key, val, newIdx, removeKeys,
   return this;
 };
 
+// Find the suffixes of keys that start with every one of several
+// prefixes. Index entries are keyed by `prefix + primary key`, so
+// for index prefixes this is the primary keys matching all of them.
+// Cursors leapfrog each other natively, starting with the prefix
+// that has the fewest keys, so the larger postings are mostly
+// skipped. Like `scanRange()`, this only makes sense for tree
+// databases.
+//
+// The range options are:
+//
+//   + start - String first suffix (optional)
+//   + limit - Number of suffixes to find (optional, default: all)
+//
+// + prefixes - Array of String prefixes
+// + range    - Object range (optional)
+// + next     - Function(Error, Array suffixes, Boolean more)
+//
+// Returns self.
+KyotoDB.prototype.intersect = function(prefixes, range, next) {
+  var self = this;
+
+  if (typeof range == 'function') {
+    next = range;
+    range = {};
+  }
+
+  if (this.db === null)
+    next.call(this, new Error('intersect: database is closed.'));
+  else
+    this.db.intersect(prefixes, range.start || '', range.limit || 0, function(err, keys, more) {
+      if (err)
+        next.call(self, err);
+      else
+        next.call(self, null, keys, more);
+    });
+
+  return this;
+};
+
 // Create a cursor to iterate over items in the database.
 //
 // Returns Cursor instance.
@@ -382,12 +981,172 @@ KyotoDB.prototype.generate = function(jumpTo, done) {
   return new Generator(this, jumpTo, done);
 };
 
+// Generate the items in a key range. See `scanRange()` for the
+// `range` options.
+KyotoDB.prototype.generateRange = function(range, done) {
+  return new RangeGenerator(scanner(this.db, range), done);
+};
+
+// Generate the items whose keys follow every one of several prefixes
+// (see `intersect()`). Values are read in batches with `getBulk()`.
+//
+// + prefixes - Array of String key prefixes
+// + options  - Object with an `asBuffer` Boolean (optional)
+// + done     - Function(Error) called at the end
+KyotoDB.prototype.generateIntersection = function(prefixes, options, done) {
+  if (typeof options == 'function') {
+    done = options;
+    options = {};
+  }
+  return new RangeGenerator(intersecter(this.db, prefixes, !!options.asBuffer), done);
+};
+
+// A readable Stream of the database's items, or of a key range when
+// `start`, `end` or `prefix` is given (see `scanRange()`). Items are
+// read in batches of `highWaterMark` records and the stream reads at
+// most one batch ahead, so piping it to a slow destination doesn't
+// buffer the database in memory.
+//
+// Each `data` event is an Object with `key` and `value`, or just the
+// key or value with `keysOnly` or `valuesOnly`.
+//
+// Options:
+//
+//   + start         - String first key (optional)
+//   + end           - String stop before this key (optional)
+//   + prefix        - String only keys starting with this (optional)
+//   + limit         - Number of items to read (optional)
+//   + keysOnly      - Boolean emit keys, don't read values (optional)
+//   + valuesOnly    - Boolean emit values (optional)
+//   + asBuffer      - Boolean read values as Buffers (optional)
+//   + highWaterMark - Number of records per batch (default: 128)
+//
+// Returns a ReadStream.
+KyotoDB.prototype.createReadStream = function(options) {
+  var db = this.db,
+      size = (options = options || {}).highWaterMark,
+      ranged = options.start || options.end || options.prefix || options.limit,
+      format = options.keysOnly ? keyOf : options.valuesOnly ? valueOf : item;
+
+  return new ReadStream(function(done) {
+    var fetch = (db === null) ? closed : ranged ? scanner(db, options) : walker(db, options);
+    return new RangeGenerator(fetch, done, size);
+  }, format);
+
+  function closed(limit, maxBytes, next) {
+    next(new Error('createReadStream: database is closed.'));
+  }
+
+  function item(val, key) {
+    return { key: key, value: val };
+  }
+
+  function keyOf(val, key) {
+    return key;
+  }
+
+  function valueOf(val) {
+    return val;
+  }
+};
+
+// Read the items in a key range with one native request. This only
+// makes sense for tree databases, which keep keys in order.
+//
+// The range is given as an object:
+//
+//   + start    - String first key (default: `prefix` or the first key)
+//   + end      - String stop before this key (optional)
+//   + prefix   - String only keys starting with this (optional)
+//   + limit    - Number of items to read (optional, default: all)
+//   + keysOnly - Boolean don't read values (optional)
+//   + asBuffer - Boolean read values as Buffers (optional)
+//   + project  - Array of member names; JSON object values are cut
+//                down to these members natively (optional)
+//
+// + range - Object range
+// + next  - Function(Error, Array values, Array keys, Boolean more)
+//
+// Returns self.
+KyotoDB.prototype.scanRange = function(range, next) {
+  var self = this;
+
+  if (this.db === null)
+    next.call(this, new Error('scanRange: database is closed.'));
+  else
+    scan(this.db, range, range.start || range.prefix || '', range.limit || 0,
+      function(err, vals, keys, more) {
+        if (err && err.code == NOREC)
+          next.call(self, null, [], [], false);
+        else if (err)
+          next.call(self, err);
+        else
+          next.call(self, null, vals, keys, more);
+      });
+
+  return this;
+};
+
+// Fold the items in a key range natively, without reading them into
+// Javascript (see `RangeAggregate` in _kyoto.cc). Like `scanRange()`,
+// this only makes sense for tree databases. The range is given by
+// `start`, `end` and `prefix` as for `scanRange()`.
+//
+// The operations are:
+//
+//   + count - count the items
+//   + sum   - add up the number at `arg`, an Array path of member
+//             names, in each JSON value; nulls are skipped
+//   + min   - the smallest number at `arg`
+//   + max   - the largest number at `arg`
+//   + group - count index entries by value; `arg` is the index's
+//             layout mode (see `IndexSet.layout()`)
+//
+// + range - Object range
+// + op    - String operation
+// + arg   - Array path or Number mode (optional)
+// + next  - Function(Error, Object report) callback; the report has
+//           `count` (items), `values` (numbers folded), `value` (the
+//           result or null), `groups` (Object of counts by value) and
+//           `unreadable` (items that couldn't be folded)
+//
+// Returns self.
+KyotoDB.prototype.aggregate = function(range, op, arg, next) {
+  var self = this,
+      code = AGGREGATES[op];
+
+  if (code === undefined)
+    throw new Error('aggregate: unrecognized operation "' + op + '".');
+  else if (arg instanceof Array)
+    arg = arg.map(function(name) { return JSON.stringify(String(name)); });
+
+  if (this.db === null)
+    next.call(this, new Error('aggregate: database is closed.'));
+  else
+    this.db.aggregate(
+      range.start || range.prefix || '',
+      range.end || null,
+      range.prefix || '',
+      code,
+      (arg === undefined) ? null : arg,
+      function(err, report) {
+        next.call(self, err, report);
+      });
+
+  return this;
+};
+
+var AGGREGATES = { count: 0, sum: 1, min: 2, max: 3, group: 4 };
+
 // Iterate over all items in the database in an async-each style.
 //
 // The `fn` iterator is called with each item in the database in the
 // context of a Cursor. It should handle the key/value pair and then
 // call `next`. To stop iterating, it could call `this.stop()`.
 //
+// Items are read from the database in batches (see `Prefetch`), so
+// most calls to `fn` don't wait on a native request.
+//
 // When an error is encountered or all items have been visited,
 // `done` is called.
 //
@@ -399,7 +1158,8 @@ KyotoDB.prototype.each = function(done, fn) {
   var self = this,
       wantsNext = false,
       finished = false,
-      cursor = this.cursor();
+      cursor = this.cursor(),
+      reader = Prefetch.cursor(cursor.cursor);
 
   if (!fn) {
     fn = done;
@@ -410,13 +1170,13 @@ KyotoDB.prototype.each = function(done, fn) {
   cursor.jump(step);
 
   function step(err) {
-    err ? finish(err) : cursor.get(true, dispatch);
+    err ? finish(err) : reader.take(dispatch);
   }
 
   function dispatch(err, val, key) {
     if (err)
       finish(err);
-    else if (val === undefined)
+    else if (key === undefined)
       finish(err);
     else
       try {
@@ -442,6 +1202,7 @@ KyotoDB.prototype.each = function(done, fn) {
 
 function Generator(db, jumpTo, done) {
   this.cursor = new K.Cursor(db.db);
+  this.reader = Prefetch.cursor(this.cursor);
   this.started = false;
   this.jumpTo = jumpTo;
   this.done = done;
@@ -480,7 +1241,7 @@ Generator.prototype.next = function(fn) {
   }
 
   function step() {
-    cursor.get(true, emit);
+    self.reader.take(emit);
   }
 
   function emit(err, val, key) {
@@ -495,21 +1256,251 @@ Generator.prototype.next = function(fn) {
   return this;
 };
 
+
+// ## Range Generator ##
+
+// Like a Generator, but reads batches with a `fetch` function (see
+// Prefetch) and stops when it runs out without reading past the end.
+
+function RangeGenerator(fetch, done, size) {
+  this.reader = new Prefetch(fetch, size);
+  this.done = done;
+}
+
+RangeGenerator.prototype.then = Generator.prototype.then;
+
+RangeGenerator.prototype.next = function(fn) {
+  var self = this;
+
+  this.reader.take(function(err, val, key) {
+    if (err)
+      self.done(err);
+    else if (key === undefined)
+      self.done();
+    else
+      fn.call(self, val, key);
+  });
+
+  return this;
+};
+
+
+// ## Prefetch ##
+
+// Read records in batches. As soon as a batch is handed over, the
+// next one is requested so the native read overlaps with Javascript
+// consuming the current batch. Only one request is outstanding at a
+// time.
+//
+// The `fetch` function reads a batch:
+//
+//     fetch(limit, maxBytes, function(err, vals, keys, end) { ... })
+//
+// `vals` may be `null` when only keys are read.
+
+var BATCH_SIZE = 128,
+    BATCH_BYTES = 1024 * 1024;
+
+function Prefetch(fetch, size, maxBytes) {
+  this.fetch = fetch;
+  this.size = size || BATCH_SIZE;
+  this.maxBytes = maxBytes || BATCH_BYTES;
+
+  this.vals = this.keys = null;
+  this.index = 0;
+  this.ahead = null;
+  this.waiting = null;
+  this.fetching = false;
+  this.ended = false;
+  this.error = null;
+}
+
+// Read batches with `getBatch()` from a native cursor.
+Prefetch.cursor = function(cursor, size, maxBytes, asBuffer) {
+  asBuffer = !!asBuffer;
+  return new Prefetch(function(limit, maxBytes, next) {
+    cursor.getBatch(limit, maxBytes, true, asBuffer, next);
+  }, size, maxBytes);
+};
+
+// Call `fn(err, val, key)` with the next record. At the end, `fn` is
+// called without a key.
+Prefetch.prototype.take = function(fn) {
+  if ((!this.keys || this.index >= this.keys.length) && this.ahead) {
+    this.vals = this.ahead.vals;
+    this.keys = this.ahead.keys;
+    this.index = 0;
+    this.ahead = null;
+    this.fill();
+  }
+
+  if (this.keys && this.index < this.keys.length) {
+    var idx = this.index++;
+    fn(null, this.vals ? this.vals[idx] : undefined, this.keys[idx]);
+  }
+  else if (this.error)
+    fn(this.error);
+  else if (this.ended && !this.fetching)
+    fn(null);
+  else {
+    this.waiting = fn;
+    this.fill();
+  }
+
+  return this;
+};
+
+Prefetch.prototype.fill = function() {
+  var self = this;
+
+  if (this.fetching || this.ended || this.ahead || this.error)
+    return this;
+
+  this.fetching = true;
+  this.fetch(this.size, this.maxBytes, function(err, vals, keys, end) {
+    self.fetching = false;
+
+    if (err && err.code != NOREC)
+      self.error = err;
+    else if (err || end || keys.length === 0) {
+      self.ended = true;
+      if (keys && keys.length > 0)
+        self.ahead = { vals: vals, keys: keys };
+    }
+    else
+      self.ahead = { vals: vals, keys: keys };
+
+    var waiting = self.waiting;
+    if (waiting) {
+      self.waiting = null;
+      self.take(waiting);
+    }
+  });
+
+  return this;
+};
+
+// Page through a key range with `scanRange()`. Each page continues
+// just after the last key of the previous one.
+function scanner(db, range) {
+  var start = range.start || range.prefix || '',
+      remaining = range.limit;
+
+  return function fetch(limit, maxBytes, next) {
+    if (remaining !== undefined)
+      limit = Math.min(limit, remaining);
+
+    scan(db, range, start, limit, function(err, vals, keys, more) {
+      if (err)
+        return next(err);
+
+      if (keys.length > 0)
+        start = keys[keys.length - 1] + '\u0000';
+      if (remaining !== undefined)
+        remaining -= keys.length;
+
+      next(null, vals, keys, !more || remaining === 0);
+    });
+  };
+}
+
+// Read one page of `range` from `start` with the native `scanRange()`,
+// or `scanProject()` when values are projected.
+function scan(db, range, start, limit, next) {
+  var end = range.end || null,
+      prefix = range.prefix || null;
+
+  if (range.project)
+    db.scanProject(start, end, prefix, limit, range.project.map(function(name) {
+      return JSON.stringify(name);
+    }), next);
+  else
+    db.scanRange(start, end, prefix, limit, !!range.keysOnly, !!range.asBuffer, next);
+}
+
+// Page through the whole database with a cursor, in the order of the
+// database (key order for trees, no particular order for hashes).
+function walker(db, options) {
+  var cursor = new K.Cursor(db),
+      asBuffer = !!options.asBuffer,
+      jumped = false;
+
+  return function fetch(limit, maxBytes, next) {
+    if (jumped)
+      return cursor.getBatch(limit, maxBytes, true, asBuffer, next);
+
+    jumped = true;
+    cursor.jump(function(err) {
+      err ? next(err) : fetch(limit, maxBytes, next);
+    });
+  };
+}
+
+// Page through the intersection of several prefixes, reading the
+// values of each page with `getList()`. Keys that have no value, like
+// index entries left behind by a crash, are skipped.
+function intersecter(db, prefixes, asBuffer) {
+  var start = '';
+
+  return function fetch(limit, maxBytes, next) {
+    db.intersect(prefixes, start, limit, function(err, keys, more) {
+      if (err)
+        return next(err);
+      else if (keys.length === 0)
+        return next(null, [], [], true);
+
+      start = keys[keys.length - 1] + '\u0000';
+      db.getList(keys, false, asBuffer, function(err, items) {
+        if (err)
+          return next(err);
+
+        var vals = [], found = [];
+        for (var i = 0, l = keys.length; i < l; i++) {
+          if (items[i] !== undefined) {
+            vals.push(items[i]);
+            found.push(keys[i]);
+          }
+        }
+
+        if (found.length === 0 && more)
+          fetch(limit, maxBytes, next);
+        else
+          next(null, vals, found, !more);
+      });
+    });
+  };
+}
+
+
 
 // ## Cursor ##
 
 function Cursor(db) {
   this.db = db;
   this.cursor = new K.Cursor(db.db);
+  this.inMemory = db.inMemory;
 }
 
-Cursor.prototype.get = function(step, next) {
-  if (typeof step == 'function') {
-    next = step;
-    step = false;
+// Values (and keys, for `getKey`) are read as Strings unless
+// `asBuffer` is given.
+//
+// + step     - Boolean step past the item (optional, default: false)
+// + asBuffer - Boolean read the value as a Buffer (optional)
+// + next     - Function(Error, value, String key) callback
+//
+// Returns self.
+Cursor.prototype.get = function(step, asBuffer, next) {
+  var args = readArgs(step, asBuffer, next);
+
+  next = args.next;
+  if (this.inMemory) {
+    callSync(null, this.cursor, next, function(cursor) {
+      return cursor.getSync(args.step, args.asBuffer) || [];
+    });
+    return this;
   }
 
-  this.cursor.get(step, function(err, val, key) {
+  this.cursor.get(args.step, args.asBuffer, function(err, val, key) {
     if (err && err.code == NOREC)
       next(null);
     else if (err)
@@ -521,13 +1512,11 @@ Cursor.prototype.get = function(step, next) {
   return this;
 };
 
-Cursor.prototype.getKey = function(step, next) {
-  if (typeof step == 'function') {
-    next = step;
-    step = false;
-  }
+Cursor.prototype.getKey = function(step, asBuffer, next) {
+  var args = readArgs(step, asBuffer, next);
 
-  this.cursor.getKey(step, function(err, key) {
+  next = args.next;
+  this.cursor.getKey(args.step, args.asBuffer, function(err, key) {
     if (err && err.code == NOREC)
       next(null);
     else if (err)
@@ -539,13 +1528,11 @@ Cursor.prototype.getKey = function(step, next) {
   return this;
 };
 
-Cursor.prototype.getValue = function(step, next) {
-  if (typeof step == 'function') {
-    next = step;
-    step = false;
-  }
+Cursor.prototype.getValue = function(step, asBuffer, next) {
+  var args = readArgs(step, asBuffer, next);
 
-  this.cursor.getValue(step, function(err, val) {
+  next = args.next;
+  this.cursor.getValue(args.step, args.asBuffer, function(err, val) {
     if (err && err.code == NOREC)
       next(null);
     else if (err)
@@ -557,6 +1544,43 @@ Cursor.prototype.getValue = function(step, next) {
   return this;
 };
 
+// Read up to `limit` items in one request. Reading stops early once
+// `maxBytes` of keys and values have been read (zero for no limit).
+//
+// + limit    - Number of items
+// + maxBytes - Number of bytes (optional, default: 0)
+// + step     - Boolean step past the last item (optional, default: true)
+// + asBuffer - Boolean read values as Buffers (optional)
+// + next     - Function(Error, Array values, Array keys, Boolean end)
+//
+// Returns self.
+Cursor.prototype.getBatch = function(limit, maxBytes, step, asBuffer, next) {
+  if (typeof maxBytes == 'function') {
+    next = maxBytes;
+    maxBytes = 0;
+    step = true;
+  }
+  else if (typeof step == 'function') {
+    next = step;
+    step = true;
+  }
+  else if (typeof asBuffer == 'function') {
+    next = asBuffer;
+    asBuffer = false;
+  }
+
+  this.cursor.getBatch(limit, maxBytes || 0, step, !!asBuffer, function(err, vals, keys, end) {
+    if (err && err.code == NOREC)
+      next(null, [], [], true);
+    else if (err)
+      next(err);
+    else
+      next(null, vals, keys, end);
+  });
+
+  return this;
+};
+
 Cursor.prototype.jump = function(to, next) {
   if (typeof to == 'function') {
     next = to;
@@ -580,6 +1604,15 @@ Cursor.prototype.jumpBack = function(to, next) {
 };
 
 Cursor.prototype.step = function(next) {
+  if (this.inMemory) {
+    callSync(null, this.cursor, next, function(cursor) {
+      if (!cursor.stepSync())
+        throw noRecord();
+      return [];
+    });
+    return this;
+  }
+
   this.cursor.step(next);
   return this;
 };
@@ -589,6 +1622,17 @@ Cursor.prototype.stepBack = function(next) {
   return this;
 };
 
+// Like `get()`, but returns `[value, key]` (or undefined at the end)
+// instead of taking a callback. See `KyotoDB.getSync()`.
+Cursor.prototype.getSync = function(step, asBuffer) {
+  return this.cursor.getSync(!!step, !!asBuffer);
+};
+
+// Returns false at the end.
+Cursor.prototype.stepSync = function() {
+  return this.cursor.stepSync();
+};
+
 
 // ## Constants ##
 
@@ -605,6 +1649,29 @@ function noop(err) {
   if (err) throw err;
 }
 
+// Call a synchronous native method, `fn(target)`, and pass its results
+// to `next` on the next tick the way an asynchronous request would.
+function callSync(self, target, next, fn) {
+  var results;
+
+  try {
+    results = [null].concat(fn(target));
+  } catch (x) {
+    results = [x];
+  }
+
+  process.nextTick(function() {
+    next.apply(self, results);
+  });
+}
+
+// The error a missing record gets from an asynchronous request.
+function noRecord() {
+  var err = new Error('no record');
+  err.code = NOREC;
+  return err;
+}
+
 function parseMode(mode) {
 
   if (typeof mode == 'number')
@@ -622,4 +1689,18 @@ function parseMode(mode) {
   default:
     return null;
   }
-}
\ No newline at end of file
+}
+// Sort out the optional `step` and `asBuffer` arguments of the cursor
+// getters.
+function readArgs(step, asBuffer, next) {
+  if (typeof step == 'function') {
+    next = step;
+    step = asBuffer = false;
+  }
+  else if (typeof asBuffer == 'function') {
+    next = asBuffer;
+    asBuffer = false;
+  }
+
+  return { step: !!step, asBuffer: !!asBuffer, next: next };
+}
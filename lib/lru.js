@@ -43,12 +43,10 @@ LRUCache.prototype.put = function(key, value) {
   }
   // add new entry to the end of the linked list -- it's now the freshest entry.
   this.tail = entry;
-  if (this.size === this.limit) {
+  this.size++;
+  if (this.size > this.limit) {
     // we hit the limit -- remove the head
     return this.shift();
-  } else {
-    // increase the size counter
-    this.size++;
   }
 }
 
@@ -74,13 +72,14 @@ LRUCache.prototype.shift = function() {
       this.head = this.head.newer;
       this.head.older = undefined;
     } else {
-      this.head = undefined;
+      this.head = this.tail = undefined;
     }
     // Remove last strong reference to <entry> and remove links from the purged
     // entry being returned:
     entry.newer = entry.older = undefined;
     // delete is slow, but we need to do this to avoid uncontrollable growth:
     delete this._keymap[entry.key];
+    this.size--;
   }
   return entry;
 }
@@ -168,7 +167,12 @@ LRUCache.prototype.remove = function(key) {
     entry.older.newer = undefined;
     // link the newer entry to head
     this.tail = entry.older;
+  } else {
+    // this was the only entry
+    this.head = this.tail = undefined;
   }
+  entry.newer = entry.older = undefined;
+  this.size--;
   return entry.value;
 }
 
@@ -49,6 +49,11 @@ Model.include({
     return this;
   },
 
+  update: function(changes, next) {
+    this.defaultStore().update(this, changes, next);
+    return this;
+  },
+
   resolve: function() {
     console.warn('#resolve is deprecated, use #include.');
     return this.include.apply(this, arguments);
@@ -114,7 +119,7 @@ Model.extend({
     if (this.hasField(f.name))
       throw new Avro.Invalid(this, 'duplicate field', field);
     this.__virtual__[f.name] = f;
-    return this;
+    return this.resetCodecs();
   }
 });
 
@@ -224,7 +229,8 @@ Model.include({
     return !!this.__pk__();
   },
 
-  __key__: function(create) {
+  // The key in the database's key `format` (see `Key.make()`).
+  __key__: function(create, format) {
     var type = Type.of(this),
         pk = this.__pk__() || (create && makeKey(this));
 
@@ -233,7 +239,7 @@ Model.include({
       throw new Type.ValueError('Missing `' + name + '`, cannot make a key for: ', this);
    }
 
-    return Key.make(type, pk).toString();
+    return Key.make(type, pk).toString(format);
   }
 });
 
@@ -413,6 +419,29 @@ NullableField.include({
     return this.exportJSONValue(val);
   },
 
+  // A field of a primitive type has its value boxed and unboxed
+  // inline, see `Avro.Field.specialize()`. Anything unusual, such as
+  // an invalid value, goes through the regular method.
+  specialize: function(method) {
+    var type = this.type,
+        primary = this.primaryType(),
+        plain = Avro.Field.fn;
+
+    if (!(type.box && primary && Schema.isPrimitive(Schema.schema(primary))))
+      return null;
+    else if (method == 'dumpJSON' && this.dumpJSON === plain.dumpJSON
+             && this.dumpJSONValue === NullableField.fn.dumpJSONValue)
+      return dumpPrimitive(this, primary);
+    else if (method == 'loadJSON' && this.loadJSON === plain.loadJSON
+             && this.loadJSONValue === plain.loadJSONValue)
+      return loadPrimitive(this, primary);
+    else if (method == 'validate' && this.validate === NullableField.fn.validate
+             && this.validateValue === plain.validateValue)
+      return validatePrimitive(this, primary);
+
+    return null;
+  },
+
   maybeScan: function(obj, method) {
     // Double check that this is still a union in case "null" was
     // removed by .requirePresenseOf()
@@ -457,6 +486,71 @@ NullableField.include({
   }
 });
 
+function isNative(val) {
+  var kind = typeof val;
+  return kind == 'string' || kind == 'number' || kind == 'boolean';
+}
+
+function dumpPrimitive(field, primary) {
+  var name = field.name,
+      member = Schema.memberName(Schema.schema(primary));
+
+  return function(obj, json) {
+    var val = obj[name], boxed;
+
+    if (val === undefined || val === null)
+      json[name] = null;
+    else if (isNative(val)) {
+      boxed = {};
+      boxed[member] = primary.dumpJSON(val);
+      json[name] = boxed;
+    }
+    else
+      field.dumpJSON(obj, json);
+  };
+}
+
+function loadPrimitive(field, primary) {
+  var name = field.name,
+      member = Schema.memberName(Schema.schema(primary));
+
+  return function(json, obj) {
+    var val = json[name], inner;
+
+    if (val === undefined)
+      val = field.makeDefault(val);
+
+    if (val === undefined || val === null)
+      obj[name] = null;
+    else if (U.isPlainObject(val) && isNative(inner = val[member])
+             && onlyKey(val, member) && primary.isValid(inner))
+      obj[name] = inner;
+    else
+      field.loadJSON(json, obj);
+  };
+}
+
+function validatePrimitive(field, primary) {
+  var name = field.name;
+
+  return function(obj) {
+    var val = obj[name];
+
+    if (isNative(val))
+      primary.validate(val);
+    else if (val !== undefined && val !== null)
+      field.validate(obj);
+  };
+}
+
+function onlyKey(obj, name) {
+  for (var key in obj) {
+    if (key !== name)
+      return false;
+  }
+  return true;
+}
+
 function nullUnion(type) {
   if (!Schema.isUnion(type))
     type = [type, null];
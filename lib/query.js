@@ -1,8 +1,11 @@
 var U = require('./util'),
     Avro = require('./avro'),
     Type = require('./avro/type'),
+    Schema = require('./avro/schema'),
     Key = require('./key'),
-    Gen = require('./generators');
+    Gen = require('./generators'),
+    Collate = require('./collate'),
+    ReadStream = require('./stream').ReadStream;
 
 exports.Query = Query;
 exports.resolveRefs = resolveRefs;
@@ -28,6 +31,11 @@ Query.prototype.filter = function(query) {
   if (U.isEmpty(query))
     return this;
 
+  if (typeof query == 'function')
+    this._opaque = true;
+  else
+    this._filtered = U.extend(this._filtered || [], Object.keys(query));
+
   var prev = this._filter,
       fn = compileFilter(query);
 
@@ -79,15 +87,36 @@ Query.prototype.include = function() {
   return this;
 };
 
+// Load only the named fields of each object. Fields used by `filter`,
+// `order` and `include` are loaded too. The results are partial: they
+// can be read and encoded, but not saved.
+Query.prototype.select = function() {
+  var type = this.type;
+
+  U.toArray(arguments).forEach(function(name) {
+    if (!type.hasField(name))
+      throw new Error('No field called `' + name + '`.');
+  });
+
+  this._select = U.extend(this._select || [], arguments);
+  return this;
+};
+
 Query.prototype.generate = function(done) {
-  var seed = this.seed || generateType,
+  var seed = this.seed || orderedSeed(this) || generateType,
       iter = seed(this, done);
 
+  if (this._select && seed !== generateType)
+    iter = narrow(iter, this.store, selected(this));
+
   if (this._filter)
     iter = new Gen.Filter(iter, this._filter);
 
-  if (this._order)
-    iter = new Gen.Sort(iter, makeCmp(this._order));
+  if (this._order && !inOrder(seed, this._order))
+    iter = Collate.sort(this.store, iter, this._order, {
+      limit: sortLimit(this),
+      budget: this.store.sortBuffer
+    });
 
   if (this._offset !== undefined)
     iter = offset(iter, this._offset);
@@ -96,7 +125,7 @@ Query.prototype.generate = function(done) {
     iter = limit(iter, this._limit);
 
   if (this._include)
-    iter = new Gen.AMap(iter, resolver(this));
+    iter = new Gen.Window(iter, includeWindow(this), resolver(this));
 
   if (this._json)
     iter = new Gen.AMap(iter, jsonEncoder);
@@ -138,6 +167,20 @@ Query.prototype.all = function(done) {
 
 Query.prototype.then = Query.prototype.all;
 
+// A readable Stream of the results (see `ReadStream`), read as they're
+// consumed instead of collected first. After `json()`, each `data`
+// event is a line of JSON text, so results can be piped straight to a
+// file or socket:
+//
+//     Data.find({ status: 'open' }).json().stream().pipe(response);
+Query.prototype.stream = function() {
+  var self = this;
+
+  return new ReadStream(function(done) {
+    return self.generate(done);
+  }, this._json ? jsonLine : undefined);
+};
+
 Query.prototype.one = function(done) {
   var found;
 
@@ -155,6 +198,42 @@ Query.prototype.one = function(done) {
 
 Query.prototype.get = Query.prototype.one;
 
+
+// ## Aggregates ##
+
+// Fold a query's objects into one result. When the database can
+// answer the query by itself (no filters it can't check, see
+// `nativeRange()`), the keys are folded natively and no object is
+// loaded. Otherwise only the fields involved are loaded (see
+// `select()`), one at a time, and none are kept.
+
+Query.prototype.count = function(done) {
+  return aggregate(this, 'count', undefined, done);
+};
+
+// The sum of a numeric field; objects without a value are skipped.
+Query.prototype.sum = function(name, done) {
+  return aggregate(this, 'sum', name, done);
+};
+
+// The smallest value of a numeric, string or Date field, or null if
+// no object has one. Strings are compared by Javascript's `<`; only
+// numbers can be folded natively.
+Query.prototype.min = function(name, done) {
+  return aggregate(this, 'min', name, done);
+};
+
+Query.prototype.max = function(name, done) {
+  return aggregate(this, 'max', name, done);
+};
+
+// An Object counting objects by the value of a field. With an index
+// on the field, the counts are read from its entries. Objects without
+// a value aren't counted.
+Query.prototype.countBy = function(name, done) {
+  return aggregate(this, 'group', name, done);
+};
+
 
 // ## Seeding ##
 
@@ -172,31 +251,138 @@ function reSeed(query, params) {
   if (query.seed)
     return query.seed;
 
-  var name, value, index;
+  // A unique index finds at most one object, so it's used by itself.
+  // Otherwise every plain index in the query is used: their postings
+  // are intersected natively and only the objects in all of them are
+  // read. Without those, a range on an ordered index is scanned.
+  // Anything else is left for the filter.
+  var name, value, index, indexes = [], values = [], range;
   for (name in params) {
-    if (U.isNullish(value = params[name]))
+    if (U.isNullish(value = params[name]) || value instanceof RegExp)
       continue;
     else if ((index = type.getIndex(name))) {
-      delete params[name];
-      return seedFromIndex(index, value);
+      if (isRange(value)) {
+        if (index.ordered && !range)
+          range = { index: index, bounds: value };
+      }
+      else if (index.unique) {
+        delete params[name];
+        return seedFromIndex(index, value);
+      }
+      else {
+        indexes.push(index);
+        values.push(value);
+      }
     }
+  }
 
+  indexes.forEach(function(index) {
+    delete params[index.name];
+  });
+
+  if (indexes.length > 1)
+    return seedFromIntersection(indexes, values);
+  else if (indexes.length == 1)
+    return seedFromIndex(indexes[0], values[0]);
+  else if (range) {
+    delete params[range.index.name];
+    return seedFromRange(range.index, range.bounds);
   }
 
   return undefined;
 }
 
+// Without a better seed, a query sorted by a field with an ordered
+// index reads the index in order.
+function orderedSeed(query) {
+  var order = query._order,
+      term, index;
+
+  if (!order || order.length != 1)
+    return undefined;
+
+  term = Collate.parseTerm(order[0]);
+  index = query.type.getIndex(term.name);
+  if (term.op == '+' && index && index.ordered)
+    return seedFromRange(index, {});
+
+  return undefined;
+}
+
+function inOrder(seed, order) {
+  var term = (order.length == 1) && Collate.parseTerm(order[0]);
+  return term && term.op == '+' && term.name === seed.orderedBy;
+}
+
 function seedFromIndex(index, value) {
-  return function generateIndex(query, done) {
+  function generateIndex(query, done) {
     var store = query.store;
     return deref(index.generate(store, value, done), store);
+  }
+  generateIndex.keyRange = function(query) {
+    return { prefix: index.valuePrefix(value, query.store.keyFormat) };
+  };
+  return generateIndex;
+}
+
+// Objects from an ordered index come in value order.
+function seedFromRange(index, bounds) {
+  function generateRange(query, done) {
+    var store = query.store;
+    return deref(index.generateRange(store, bounds, done), store);
+  }
+  generateRange.orderedBy = index.name;
+  generateRange.keyRange = function(query) {
+    return index.keyRange(bounds, query.store.keyFormat);
+  };
+  return generateRange;
+}
+
+function seedFromIntersection(indexes, values) {
+  return function generateIntersection(query, done) {
+    var prefixes = indexes.map(function(index, i) {
+      return index.valuePrefix(values[i], query.store.keyFormat);
+    });
+    return query.store.generateIntersection(prefixes, done);
   };
 }
 
 function generateType(query, done) {
-  var jumpTo = Type.name(query.type) + '/',
-      iter = query.store.generate(jumpTo, done);
-  return new Gen.TakeWhile(iter, matchType(query.type));
+  return query.store.generateRange(U.extend(generateType.keyRange(query), {
+    select: query._select && selected(query)
+  }), done);
+}
+
+generateType.keyRange = function(query) {
+  return { prefix: Key.prefix(query.type, query.store.keyFormat) };
+};
+
+// The fields a selecting query needs to load, or undefined when a
+// filter function could look at any of them.
+function selected(query) {
+  if (query._opaque)
+    return undefined;
+
+  var names = {},
+      type = query.type;
+
+  add(query._select);
+  add(query._filtered);
+  add((query._order || []).map(function(expr) {
+    return Collate.parseTerm(expr).name;
+  }));
+  add((query._include || []).map(function(path) {
+    return path.split('.')[0];
+  }));
+
+  function add(list) {
+    list && list.forEach(function(name) {
+      if (type.hasField(name))
+        names[name] = true;
+    });
+  }
+
+  return Object.keys(names);
 }
 
 function generateId(query, done) {
@@ -204,6 +390,145 @@ function generateId(query, done) {
 }
 
 
+function aggregate(query, op, name, done) {
+  if (name !== undefined && !query.type.hasField(name))
+    throw new Error('No field called `' + name + '`.');
+  else if (FOLDS[op] && !FOLDS[op][Schema.name(valueType(query.type, name))])
+    throw new Error(op + ': `' + name + '` can\'t be folded, it isn\'t a ' + (op == 'sum' ? 'number.' : 'number, string or Date.'));
+
+  var range = nativeRange(query, op, name);
+  if (!range)
+    return foldObjects(query, op, name, done);
+
+  query.store.db.aggregate(range, op, range.arg, function(err, report) {
+    if (err)
+      done(err);
+    else if (report.unreadable)
+      foldObjects(query, op, name, done);
+    else
+      done(null, foldReport(query, op, range, report));
+  });
+
+  return query;
+}
+
+// The key range to fold natively, with the `arg` of its operation,
+// or null. Counts can be read from any seed with a key range; the
+// others need the type's documents or an index on the field.
+function nativeRange(query, op, name) {
+  var seed = query.seed || generateType,
+      sliced = (query._offset !== undefined || query._limit !== undefined),
+      range, index;
+
+  if (query._filter || !seed.keyRange)
+    return null;
+
+  if (op == 'count')
+    return seed.keyRange(query);
+  else if (seed !== generateType || sliced)
+    return null;
+  else if (op == 'group') {
+    if (!(index = query.type.getIndex(name)))
+      return null;
+    range = { prefix: index.prefix(undefined, query.store.keyFormat), index: index, arg: index.mode() };
+  }
+  else if (!query.store.binary) {
+    range = seed.keyRange(query);
+    range.arg = numberPath(query.type, name);
+  }
+
+  return (range && range.arg !== null) ? range : null;
+}
+
+function foldReport(query, op, range, report) {
+  var result, count;
+
+  switch (op) {
+  case 'count':
+    count = Math.max(0, report.count - (query._offset || 0));
+    return (query._limit !== undefined) ? Math.min(count, query._limit) : count;
+  case 'sum':
+    return report.value || 0;
+  case 'group':
+    result = {};
+    U.each(report.groups, function(count, text) {
+      var val = range.index.groupValue(text);
+      if (!U.isNullish(val))
+        result[val] = (result[val] || 0) + count;
+    });
+    return result;
+  default:
+    return report.value;
+  }
+}
+
+// Load only what's needed to fold each object in Javascript. Order
+// only matters to a sliced query, and included objects not at all.
+// The query itself is left as it was.
+function foldObjects(query, op, name, done) {
+  var view = Object.create(query),
+      format = query.store.keyFormat,
+      index = (op == 'group') && query.type.getIndex(name),
+      result = (op == 'group') ? {} : (op == 'min' || op == 'max') ? null : 0;
+
+  // A derived index value may need any field.
+  if (index && index.deriveValue)
+    view._select = undefined;
+  else
+    view._select = (name === undefined) ? [] : [name];
+  view._include = view._json = undefined;
+  if (view._offset === undefined && view._limit === undefined)
+    view._order = undefined;
+
+  view.each(finished, function(obj) {
+    var val = index ? index.value(obj, obj.__key__(false, format), format) : obj[name];
+
+    if (op == 'count')
+      result += 1;
+    else if (U.isNullish(val))
+      return;
+    else if (op == 'group')
+      result[val] = (result[val] || 0) + 1;
+    else if (op == 'sum')
+      result += val;
+    else if (result === null || (op == 'min' ? val < result : val > result))
+      result = val;
+  });
+
+  function finished(err) {
+    err ? done(err) : done(null, result);
+  }
+
+  return query;
+}
+
+// The type of a field's values: the non-null member of a nullable
+// union, or the field's own type.
+function valueType(type, name) {
+  var field = type.field(name),
+      primary = field && field.primaryType && field.primaryType();
+  return primary || (field && field.type);
+}
+
+// The path to a numeric field's value in a stored JSON document, or
+// null if it isn't one. A union member is boxed by its name; a plain
+// field isn't boxed. Virtual fields aren't stored.
+function numberPath(type, name) {
+  var field = type.field(name),
+      primary = field && field.primaryType && field.primaryType(),
+      value = valueType(type, name);
+
+  if (!value || !NUMBERS[Schema.name(value)] || (type.__virtual__ && type.__virtual__[name]))
+    return null;
+
+  return primary ? [name, Schema.memberName(Schema.schema(primary))] : [name];
+}
+
+var NUMBERS = { 'int': true, 'long': true, 'float': true, 'double': true },
+    ORDERED = U.extend({ 'string': true, 'Date': true }, NUMBERS),
+    FOLDS = { sum: NUMBERS, min: ORDERED, max: ORDERED };
+
+
 // ## Generators ##
 
 function deref(iter, store) {
@@ -212,6 +537,14 @@ function deref(iter, store) {
   });
 }
 
+function narrow(iter, store, names) {
+  if (!names)
+    return iter;
+  return new Gen.AMap(iter, function(obj, next) {
+    next(null, store.partial(obj, names));
+  });
+}
+
 function offset(iter, offset) {
   return new Gen.Filter(iter, function() {
     if (offset <= 0)
@@ -286,6 +619,10 @@ function matchAll(params) {
         } catch (_) {
           return false;
         }
+      else if (isRange(val)) {
+        if (!inRange(obj[key], val))
+          return false;
+      }
       else if (obj[key] != params[key])
         return false;
     }
@@ -293,157 +630,212 @@ function matchAll(params) {
   };
 }
 
-function matchType(type) {
-  var name = Type.name(type);
-  return function match(obj) {
-    return Type.nameOf(obj) === name;
-  };
+// A range is given as an Object with any of `$gt`, `$gte`, `$lt` and
+// `$lte` bounds.
+function isRange(val) {
+  return U.isPlainObject(val)
+    && ('$gt' in val || '$gte' in val || '$lt' in val || '$lte' in val);
+}
+
+// Select values the way an ordered index's key range does (see
+// `Ordered.keyRange()` in idx.js): values compare in `encodeValue()`
+// order, `$gt` is used over `$gte` (and `$lt` over `$lte`), and with
+// only one bound the value must have the bound's type.
+function inRange(val, range) {
+  var lower = (range.$gt !== undefined) ? range.$gt : range.$gte,
+      upper = (range.$lt !== undefined) ? range.$lt : range.$lte,
+      cmp;
+
+  if (lower !== undefined) {
+    cmp = Collate.cmpValues(val, lower);
+    if (cmp < 0 || (cmp === 0 && range.$gt !== undefined))
+      return false;
+    else if (upper === undefined)
+      return Collate.valueTag(val) === Collate.valueTag(lower);
+  }
+
+  cmp = Collate.cmpValues(val, upper);
+  if (cmp > 0 || (cmp === 0 && range.$lt !== undefined))
+    return false;
+  return (lower !== undefined) || Collate.valueTag(val) === Collate.valueTag(upper);
 }
 
 
 // ## Reference Resolution ##
 
+// References are resolved for a window of results at a time. The
+// keys they name are collected, deduplicated and read with one
+// `Storage.getList()`, then the objects are put in their place. An
+// include path like `author.company` resolves `author` first, then
+// `company` for all of the authors found, with another read.
+
+var INCLUDE_WINDOW = 100;
+
+function includeWindow(query) {
+  var limit = query._limit;
+  return (limit > 0 && limit < INCLUDE_WINDOW) ? limit : INCLUDE_WINDOW;
+}
+
 function resolver(query) {
   if (!query._include)
     return dontResolve;
   return fieldResolver(query.store, query.type, query._include);
 }
 
-function dontResolve(obj, next) {
-  next(null, obj);
+function dontResolve(objs, next) {
+  next(null, objs);
 }
 
 function resolveRefs(store, obj, names, next) {
   var resolve = fieldResolver(store, Type.of(obj), names);
-  resolve(obj, next);
+  resolve([obj], function(err) {
+    err ? next(err) : next(null, obj);
+  });
   return obj;
 }
 
 function fieldResolver(store, type, names) {
+  var fields = compileFields(type, names);
+
+  return function resolve(objs, done) {
+    resolveFields(store, fields, objs, function(err) {
+      err ? done(err) : done(null, objs);
+    });
+  };
+}
+
+// Map each field named by `names` to the type it references and the
+// paths to include from the objects it references.
+function compileFields(type, names) {
   var fields = {};
 
-  names.forEach(function(name) {
-    fields[name] = Avro.type(type.schemaOf(name).references);
-  });
+  names.forEach(function(path) {
+    var parts = path.split('.'),
+        name = parts.shift(),
+        field = fields[name];
 
-  return resolveFields(store, fields);
-}
+    if (!field)
+      field = fields[name] = {
+        type: Avro.type(type.schemaOf(name).references),
+        include: []
+      };
 
-function resolveFields(store, fields) {
-  var val, cache = {};
+    if (parts.length > 0)
+      field.include.push(parts.join('.'));
+  });
 
-  return function resolve(obj, done) {
-    U.aEach(fields, finished, function(type, name, next) {
-      get(type, obj[name], function(err, result) {
-        if (err)
-          next(err);
-        else {
-          obj[name] = result;
-          next();
-        }
-      });
-    });
+  U.each(fields, function(field) {
+    field.fields = compileFields(field.type, field.include);
+  });
 
-    function finished(err) {
-      err ? done(err) : done(null, obj);
-    }
-  };
+  return fields;
+}
 
-  function get(type, val, next) {
-    if (!val)
-      next(null, val);
-    else if (U.isArray(val))
-      getAll(type, val, next);
-    else
-      getOne(type, val, next);
-  }
+function resolveFields(store, fields, objs, done) {
+  var format = store.keyFormat,
+      names = Object.keys(fields),
+      keys = [],
+      found = {},
+      included = {},
+      error;
 
-  function getAll(type, refs, done) {
-    var result = [];
+  if (names.length === 0 || objs.length === 0)
+    return done(null);
 
-    U.aEach(refs, finished, function(ref, _, next) {
-      getOne(type, ref, function(err, obj) {
-        if (err)
-          next(err);
-        else {
-          result.push(obj);
-          next();
-        }
+  try {
+    objs.forEach(function(obj) {
+      names.forEach(function(name) {
+        eachRef(fields[name].type, obj[name], format, function(key) {
+          if (!found.hasOwnProperty(key)) {
+            found[key] = undefined;
+            keys.push(key);
+          }
+        });
       });
     });
-
-    function finished(err) {
-      err ? done(err) : done(null, result);
-    }
+  } catch (x) {
+    return done(x);
   }
 
-  function getOne(type, ref, next) {
-    if (ref instanceof type)
-      return next(null, ref);
-    else if (typeof ref != 'string')
-      return next(new Avro.Invalid(type, 'bad reference', ref));
+  store.getList(keys, function(err, results) {
+    if (err)
+      return done(err);
 
-    var key = Key.make(type, ref),
-        probe = cache[key];
+    for (var i = 0, l = keys.length; i < l; i++)
+      found[keys[i]] = results[i];
 
-    if (probe)
-      next(null, probe);
-    else
-      store.get(key, function(err, obj) {
-        err ? next(err) : next(null, cache[key] = obj);
-      });
-  }
-}
+    names.forEach(function(name) {
+      var type = fields[name].type,
+          seen = {},
+          list = included[name] = [];
 
-
-// ## Sorting ##
+      objs.forEach(function(obj) {
+        obj[name] = stitch(type, obj[name], function(ref) {
+          var key = (ref instanceof type) ? undefined : Key.make(type, ref).toString(format),
+              result = (key === undefined) ? ref : found[key];
 
-function makeCmp(order) {
-  if (!order || order.length === 0)
-    return cmpStable;
+          if (result && (key === undefined || !seen.hasOwnProperty(key))) {
+            if (key !== undefined)
+              seen[key] = true;
+            list.push(result);
+          }
 
-  var cmp = compileCmp(order[0]);
-  for (var i = 1, l = order.length; i < l; i++)
-    cmp = chainCmp(cmp, compileCmp(order[i]));
+          return result;
+        });
+      });
+    });
 
-  return cmp;
+    U.aEach(names, done, function(name, _, next) {
+      resolveFields(store, fields[name].fields, included[name], next);
+    });
+  });
 }
 
-function cmpStable() {
-  return 0;
+// Call `fn` with the key of each reference in `val`, a reference or
+// an Array of them, in the key `format`. Objects that are already
+// loaded are skipped.
+function eachRef(type, val, format, fn) {
+  if (!val)
+    return;
+  else if (!U.isArray(val))
+    val = [val];
+
+  val.forEach(function(ref) {
+    if (ref instanceof type)
+      return;
+    else if (typeof ref != 'string')
+      throw new Avro.Invalid(type, 'bad reference', ref);
+    fn(Key.make(type, ref).toString(format));
+  });
 }
 
-function chainCmp(cmp1, cmp2) {
-  return function(a, b) {
-    return cmp1(a, b) || cmp2(a, b);
-  };
+// Replace each reference in `val` with `resolve(ref)`.
+function stitch(type, val, resolve) {
+  if (!val)
+    return val;
+  else if (U.isArray(val))
+    return val.map(resolve);
+  return resolve(val);
 }
 
-function compileCmp(expr) {
-  var probe = expr.match(/^([\-\+])?(.*)$/),
-      op = probe[1] || '+',
-      name = probe[2];
 
-  return CMP[op](name);
-}
+// ## Sorting ##
 
-var CMP = {
-  '+': function ascending(name) {
-    return function(a, b) {
-      return (a[name] < b[name]) ? -1 : (a[name] === b[name]) ? 0 : 1;
-    };
-  },
+// When only the first objects in order are needed, the sort can keep
+// just those.
+function sortLimit(query) {
+  if (query._limit === undefined)
+    return undefined;
+  return (query._offset || 0) + query._limit;
+}
 
-  '-': function descending(name) {
-    return function(a, b) {
-      return (a[name] > b[name]) ? -1 : (a[name] === b[name]) ? 0 : 1;
-    };
-  }
-};
 
-
 // ## Encoding ##
 
+function jsonLine(obj) {
+  return JSON.stringify(obj) + '\n';
+}
+
 function jsonEncoder(obj, next) {
   var data;
   try {
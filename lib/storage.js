@@ -3,9 +3,12 @@ var Assert = require('assert'),
     Kyoto = require('./kyoto'),
     Avro = require('./avro'),
     Type = require('./avro/type'),
-    Key = require('./key').Key,
+    Key = require('./key'),
     Query = require('./query').Query,
     Idx = require('./idx'),
+    Gen = require('./generators'),
+    ObjectCache = require('./cache').ObjectCache,
+    Update = require('./update'),
     U = require('./util');
 
 exports.open = open;
@@ -18,13 +21,23 @@ exports.Storage = Storage;
 
 var DB, AUTOCLOSING;
 
+// Open the global database. Instead of a `mode`, an options object
+// may be given; see `Storage`.
 function open(folder, mode, next) {
+  var options;
+
   if (arguments.length == 0) {
     if (!DB)
       throw new Error('No open() global database.');
     return DB;
   }
-  return (DB = new Storage(folder)).open(mode, next);
+
+  if (U.isPlainObject(mode)) {
+    options = mode;
+    mode = options.mode;
+  }
+
+  return (DB = new Storage(folder, options)).open(mode, next);
 }
 
 function close(next) {
@@ -59,22 +72,83 @@ function autoClose() {
 
 // ## Storage ##
 
-function Storage(folder) {
+// Options:
+//
+//   + format      - String document encoding for writes, `json`
+//                   (default) or `avro` for the binary Avro encoding.
+//                   Documents are marked so either format can be
+//                   read back.
+//   + groupCommit - Object group commit settings for indexed writes,
+//                   see `KyotoDB.groupCommit()`.
+//   + cache       - Object keep recently read documents in memory,
+//                   see `ObjectCache` for settings (or `true` for
+//                   defaults). Every read still gets its own object.
+//   + workers     - Number of threads for database requests, see
+//                   `KyotoDB.workerPool()` (default: share Node's).
+//   + sortBuffer  - Number of objects a query sorts in memory before
+//                   spilling them to a temporary database (default:
+//                   10000).
+//   + keys        - String key format for a new database, `plain`
+//                   (default) or `compact` for numeric tags instead
+//                   of type and index names (see `Key.CompactFormat`).
+//                   An existing database keeps the format it was
+//                   created with.
+
+var FORMATS = { json: true, avro: true },
+    KEY_FORMATS = { plain: true, compact: true };
+
+function Storage(folder, options) {
+  options = options || {};
+
   this.db = new Kyoto.KyotoDB();
   this.idxManager = new Idx.Manager(this);
 
+  this.format = options.format || 'json';
+  if (!(this.format in FORMATS))
+    throw new Error('Unrecognized format: `' + this.format + '`.');
+  this.binary = (this.format == 'avro');
+
+  if (options.groupCommit !== undefined)
+    this.db.groupCommit(options.groupCommit);
+
+  if (options.workers)
+    this.db.workerPool(options.workers);
+
+  this.cache = options.cache ? new ObjectCache(options.cache) : null;
+  this.sortBuffer = options.sortBuffer;
+
+  this.keys = options.keys || 'plain';
+  if (!(this.keys in KEY_FORMATS))
+    throw new Error('Unrecognized key format: `' + this.keys + '`.');
+  this.keyFormat = null;
+  this.savingTags = null;
+
   // Tuning parameters can be added by adding #n1=v1#n2=v2...
   var probe = folder.match(/^([^#]+)(#.*)?$/),
       name = probe[1],
       options = probe[2] || '';
 
-  if (name == '*memory*')
+  if (name == '*memory*') {
     // An on-memory tree database is indicated a "+".
+    this.folder = null;
     this.path = '+' + options;
-  else
+  }
+  else {
+    this.folder = name;
     this.path = Path.join(name, 'data.kct') + options;
+  }
 }
 
+// A path for a temporary tree database, next to the data file. Memory
+// databases get a memory tree.
+var TEMP_SEQ = 0;
+
+Storage.prototype.tempPath = function(name) {
+  if (!this.folder)
+    return '+';
+  return Path.join(this.folder, name + '-' + process.pid + '-' + (TEMP_SEQ++) + '.kct');
+};
+
 Storage.prototype.open = function(mode, next) {
   if (typeof mode == 'function') {
     next = mode;
@@ -82,17 +156,140 @@ Storage.prototype.open = function(mode, next) {
   }
   mode = mode || 'a+';
 
-  this.db.open(this.path, mode, next);
+  var self = this;
+  this.db.open(this.path, mode, function(err) {
+    if (err)
+      next && next.call(self, err);
+    else if (self.keyFormat)
+      next && next.call(self, null);
+    else
+      self.openKeys(next || function(err) { if (err) throw err; });
+  });
   return this;
 };
 
+// Compact keys need the tags assigned so far, which are kept under
+// "\0" + name (tag 0 is never assigned). A database with tags uses
+// compact keys; one with other keys uses plain keys. The format is
+// kept in `keyFormat` while the database is open, and every key this
+// store makes or reads is spelled in it.
+var TAG_PREFIX = '\u0000';
+
+Storage.prototype.openKeys = function(next) {
+  var self = this,
+      db = this.db;
+
+  db.scanRange({ prefix: TAG_PREFIX }, function(err, vals, keys) {
+    if (err)
+      return next(err);
+    else if (keys.length > 0)
+      return compact(vals, keys);
+    else if (self.keys == 'plain')
+      return plain();
+
+    db.scanRange({ limit: 1, keysOnly: true }, function(err, _, keys) {
+      if (err)
+        next(err);
+      else if (keys.length > 0)
+        next(new Error('open: compact keys need a new database.'));
+      else
+        compact([], []);
+    });
+  });
+
+  function plain() {
+    use('plain', new Key.PlainFormat());
+  }
+
+  function compact(vals, keys) {
+    var tags = {};
+
+    keys.forEach(function(key, i) {
+      tags[key.substr(TAG_PREFIX.length)] = Number(vals[i]);
+    });
+
+    use('compact', new Key.CompactFormat(tags));
+  }
+
+  function use(keys, format) {
+    self.keys = keys;
+    self.keyFormat = format;
+    next(null);
+  }
+};
+
+function releaseKeys(store) {
+  store.keyFormat = null;
+}
+
+// Write the compact key tags assigned since they were last saved. A
+// write calls this after making its keys and before it starts, so the
+// tags it uses are stored first; if they can't be, the write fails
+// with the error. Writes wait for tags that are still being saved.
+// Writers outside this file, like index maintenance, use the method.
+Storage.prototype.saveTags = function(next) {
+  saveTags(this, next);
+  return this;
+};
+
+function saveTags(store, next) {
+  var format = store.keyFormat,
+      tags, items;
+
+  if (store.savingTags)
+    return store.savingTags.push(next);
+  else if (!(format && format.compact && (tags = format.takeUnsaved())))
+    return next(null);
+
+  items = {};
+  for (var name in tags)
+    items[TAG_PREFIX + name] = String(tags[name]);
+
+  store.savingTags = [];
+  store.db.setBulk(items, true, function(err) {
+    var waiting = store.savingTags;
+
+    store.savingTags = null;
+    if (err)
+      format.returnUnsaved(tags);
+
+    next(err);
+    waiting.forEach(function(fn) {
+      err ? fn(err) : saveTags(store, fn);
+    });
+  });
+}
+
+// The key of an object about to be written. With compact keys, the
+// tags of its indicies are assigned now too, so they're saved with
+// the type's (see `saveTags()`).
+function writeKey(store, obj, create) {
+  var key = obj.__key__(create, store.keyFormat);
+
+  if (store.keys == 'compact')
+    Type.of(obj).indicies.each(function(idx) {
+      Key.indexPrefix(idx.fullName, store.keyFormat);
+    });
+
+  return key;
+}
+
 Storage.prototype.close = function(next) {
-  this.db.close(next);
+  var self = this;
+
+  this.db.close(function(err) {
+    if (!err)
+      releaseKeys(self);
+    if (next)
+      next.apply(this, arguments);
+  });
+
   return this;
 };
 
 Storage.prototype.closeSync = function() {
   this.db.closeSync();
+  releaseKeys(this);
   return this;
 };
 
@@ -100,47 +297,287 @@ Storage.prototype.type = function(name, fields) {
   return type(name, fields);
 };
 
+// Create many objects. They're validated one at a time, but written
+// in batches: each batch of documents and its index entries is added
+// in a single native transaction. If a batch can't be written (for
+// example, a duplicate key or a unique index conflict), its objects
+// are written one by one instead so each gets the usual error
+// handling.
+
+var LOAD_BATCH = 512;
+
 Storage.prototype.load = function(done, data) {
-  var self = this;
+  var self = this,
+      list = (typeof data.length == 'number') ? data : values(data),
+      index = 0;
+
+  loadBatch();
+
+  function loadBatch(err) {
+    if (err || index >= list.length)
+      done(err);
+    else
+      self.createBatch(list.slice(index, index += LOAD_BATCH), loadBatch);
+  }
+
+  return this;
+};
+
+// Create a list of objects in one transaction. If one of them isn't
+// valid, the objects before it are still created and `next` receives
+// the error.
+Storage.prototype.createBatch = function(objs, next) {
+  var self = this,
+      keys = [],
+      vals = [],
+      indexes = [],
+      pinned = [],
+      error, key;
 
-  U.aEach(data, done, function(obj, _, next) {
-    self.create(obj, next);
+  U.aEach(objs, write, function(obj, _, next) {
+    obj.dumpValid(self, true, function(err, data) {
+      if (err)
+        return next(err);
+
+      try {
+        pinned.push(!obj.__hasKey__());
+        key = writeKey(self, obj, true);
+      } catch (x) {
+        pinned.pop();
+        return next(x);
+      }
+
+      // Later objects in the batch may refer to this one, so it needs
+      // its key now rather than after it's written. A generated id is
+      // cleared again if the object isn't written with it.
+      obj.__pk__(Key.parse(key, self.keyFormat).id);
+
+      keys.push(key);
+      vals.push(data);
+      indexes.push(Type.of(obj).calculateIndex(obj, key, self.keyFormat) || null);
+      next();
+    });
   });
 
+  function write(err) {
+    error = err;
+    if (keys.length == 0)
+      next(error);
+    else
+      saveTags(self, function(err) {
+        if (err) {
+          objs.slice(0, keys.length).forEach(unpin);
+          return next(err);
+        }
+        self.db.addIndexedBulk(keys, vals, indexes, function(err) {
+          err ? oneByOne() : saved();
+        });
+      });
+  }
+
+  function unpin(obj, index) {
+    if (pinned[index])
+      clearKey(obj);
+  }
+
+  function saved() {
+    U.aEach(keys, finished, function(key, index, next) {
+      var obj = objs[index - 1];
+      invalidate(self, key);
+      associate(self, obj, key).afterSave(true, next);
+    });
+  }
+
+  // An object whose generated id is taken gets a new one; references
+  // to it from later objects in the batch keep the old one.
+  function oneByOne() {
+    var written = 0;
+
+    U.aEach(vals, inserted, function(data, index, next) {
+      insert(self, objs[index - 1], data, function(err) {
+        if (!err)
+          written++;
+        next(err);
+      }, pinned[index - 1]);
+    });
+
+    function inserted(err) {
+      if (err)
+        objs.slice(written, keys.length).forEach(function(obj, i) {
+          unpin(obj, written + i);
+        });
+      finished(err);
+    }
+  }
+
+  function finished(err) {
+    next(err || error);
+  }
+
   return this;
 };
 
-Storage.prototype.create = function(obj, next) {
-  var type = Type.of(obj),
-      tries = 0,
-      manager = this.idxManager,
-      db = this.db,
-      last, data, key;
+// Fill an empty database, for example when rebuilding one from an
+// export. Objects are validated and their index entries calculated as
+// usual, but nothing is read from the database: documents and index
+// entries are sorted together and appended in key order (see
+// `KyotoDB.appendSorted()`), which avoids the random inserts and
+// per-object transactions of `load()`. Everything is held in memory
+// until it's written, and `afterSave` listeners aren't called. A
+// duplicate key or unique index value fails with a "load-unsorted"
+// Error.
+
+var SORTED_BATCH = 4096;
+
+Storage.prototype.loadSorted = function(objs, next) {
+  var self = this,
+      list = (typeof objs.length == 'number') ? objs : values(objs),
+      keys = [],
+      records = [],
+      pinned = [],
+      start = 0;
+
+  prepareBatch();
+
+  // Objects are prepared in batches so a long list of synchronous
+  // validations doesn't overflow the stack.
+  function prepareBatch(err) {
+    if (err || start >= list.length)
+      write(err);
+    else
+      U.aEach(list.slice(start, start += SORTED_BATCH), function(err) {
+        err ? write(err) : process.nextTick(prepareBatch);
+      }, prepare);
+  }
+
+  function prepare(obj, _, next) {
+    obj.dumpValid(self, true, function(err, data) {
+      var key, idx;
+
+      if (err)
+        return next(err);
+
+      try {
+        key = writeKey(self, obj, true);
+      } catch (x) {
+        return next(x);
+      }
+
+      if (!obj.__hasKey__())
+        pinned.push(obj);
+      obj.__pk__(Key.parse(key, self.keyFormat).id);
+      keys.push(key);
+      records.push([key, data]);
+
+      idx = Type.of(obj).calculateIndex(obj, key, self.keyFormat);
+      for (var name in idx)
+        records.push([name, idx[name]]);
+      next();
+    });
+  }
+
+  // New key tags are sorted in with the records (see `saveTags()`).
+  function write(err) {
+    var index = 0,
+        tags = self.keyFormat && self.keyFormat.compact && self.keyFormat.takeUnsaved();
 
-  obj.dumpValid(this, true, function(err, val) {
     if (err)
-      next(err, obj);
-    else {
-      data = val;
-      attempt();
+      return failed(err);
+
+    for (var name in tags)
+      records.push([TAG_PREFIX + name, String(tags[name])]);
+
+    records.sort(byteOrder);
+    appendBatch();
+
+    function appendBatch(err) {
+      var batch;
+
+      if (err && tags)
+        self.keyFormat.returnUnsaved(tags);
+
+      if (err || index >= records.length)
+        return err ? failed(err) : saved();
+
+      batch = records.slice(index, index += SORTED_BATCH);
+      self.db.appendSorted(
+        batch.map(function(rec) { return rec[0]; }),
+        batch.map(function(rec) { return rec[1]; }),
+        appendBatch
+      );
+    }
+  }
+
+  // Generated ids aren't kept when the load fails.
+  function failed(err) {
+    pinned.forEach(clearKey);
+    next(err);
+  }
+
+  function saved() {
+    for (var i = 0, l = keys.length; i < l; i++) {
+      invalidate(self, keys[i]);
+      associate(self, list[i], keys[i]);
     }
+    next(null);
+  }
+
+  return this;
+};
+
+Storage.prototype.create = function(obj, next) {
+  var self = this;
+
+  obj.dumpValid(this, true, function(err, data) {
+    err ? next(err, obj) : insert(self, obj, data, next);
   });
 
+  return this;
+};
+
+// Add a validated, serialized object to the database under a new
+// key. Generated keys are retried a few times if they're taken; if
+// the object's id was `generated` before (see `createBatch()`), it's
+// tried first.
+function insert(store, obj, data, next, generated) {
+  var tries = 0,
+      manager = store.idxManager,
+      db = store.db,
+      last, key;
+
+  attempt();
+
   function attempt() {
-    if ((++tries == 5) || ((key = obj.__key__(true)) == last))
+    try {
+      key = writeKey(store, obj, true);
+    } catch (x) {
+      return next(x, obj);
+    }
+
+    if ((++tries == 5) || (key == last))
       fail();
-    else
-      prepare();
+    else {
+      last = key;
+      saveTags(store, prepare);
+    }
   }
 
-  function prepare() {
+  function prepare(err) {
+    if (err)
+      return next(err, obj);
+
     manager.prepareAdd(obj, key, added, function(newIdx, next) {
       db.addIndexed(key, data, newIdx, next);
     });
   }
 
   function added(err) {
-    if (err && err.code == Kyoto.DUPREC)
+    if (err && err.code == Kyoto.DUPREC && generated) {
+      generated = false;
+      clearKey(obj);
+      attempt();
+    }
+    else if (err && err.code == Kyoto.DUPREC)
       attempt();
     else if (err)
       manager.mergeErrors(err, obj, key, next);
@@ -149,7 +586,8 @@ Storage.prototype.create = function(obj, next) {
   }
 
   function success() {
-    associate(obj, key).afterSave(true, function(err) {
+    invalidate(store, key);
+    associate(store, obj, key).afterSave(true, function(err) {
       next(err, obj);
     });
   }
@@ -157,9 +595,7 @@ Storage.prototype.create = function(obj, next) {
   function fail() {
     next(new Type.ValueError('Duplicate key `' + key + '` (' + tries + ' attempts)', obj), obj);
   }
-
-  return this;
-};
+}
 
 Storage.prototype.save = function(obj, next) {
   var self = this,
@@ -167,7 +603,9 @@ Storage.prototype.save = function(obj, next) {
       manager = self.idxManager,
       data, key;
 
-  if (!obj.__loaded__)
+  if (obj.__partial__)
+    return next(new Error('save: this object was loaded with only some of its fields'), obj);
+  else if (!obj.__loaded__)
     return this.create(obj, next);
 
   obj.dumpValid(this, false, function(err, val) {
@@ -176,21 +614,23 @@ Storage.prototype.save = function(obj, next) {
     else {
       try {
         data = val;
-        key = obj.__key__();
+        key = writeKey(self, obj);
       } catch (x) {
         return next(x, obj);
       }
-      prepare();
+      invalidate(self, key);
+      saveTags(self, prepare);
     }
   });
 
-  function prepare() {
-    manager.prepareReplace(obj, key, replaced, function(newIdx, removeKeys, next) {
-      self.db.replaceIndexed(key, data, newIdx, removeKeys, next);
-    });
+  function prepare(err) {
+    if (err)
+      return next(err, obj);
+    manager.replace(obj, key, data, replaced);
   }
 
   function replaced(err) {
+    invalidate(self, key);
     if (err) {
       if (err.code == Kyoto.NOREC)
         err.message = "save: this object hasn't been created yet";
@@ -218,18 +658,18 @@ Storage.prototype.remove = function(obj, next) {
     if (err)
       next(err);
     else {
-      key = obj.__key__();
+      key = obj.__key__(false, self.keyFormat);
+      invalidate(self, key);
       prepare();
     }
   });
 
   function prepare() {
-    manager.prepareRemove(obj, key, removed, function(removeKeys, next) {
-      self.db.removeIndexed(key, removeKeys, next);
-    });
+    manager.remove(obj, key, removed);
   }
 
   function removed(err) {
+    invalidate(self, key);
     if (err) {
       if (err.code == Kyoto.NOREC)
         err.message = "remove: this object doesn't exist";
@@ -241,12 +681,116 @@ Storage.prototype.remove = function(obj, next) {
   return this;
 };
 
+// Change fields of a stored object, see `lib/update.js`. When it's
+// possible, the changes are made inside the database while it holds
+// the record's lock, so concurrent updates (e.g. to a counter) don't
+// overwrite each other. Otherwise the object is read, changed and
+// replaced while the index manager holds the key's lock, which orders
+// it with other updates, creates and removals; a `save()` that
+// replaces the record natively doesn't wait for it. `obj` only
+// provides the key; the callback receives the object as it was
+// stored.
+Storage.prototype.update = function(obj, changes, next) {
+  var self = this,
+      key, edits;
+
+  try {
+    key = writeKey(this, obj);
+    edits = this.binary ? null : Update.compile(Type.of(obj), changes);
+  } catch (x) {
+    return next(x, obj);
+  }
+
+  saveTags(this, function(err) {
+    if (err)
+      next(err, obj);
+    else if (!edits)
+      self.idxManager.modify(key, change, modified);
+    else
+      apply();
+  });
+
+  function apply() {
+    invalidate(self, key);
+    self.db.update(key, edits, function(err, data) {
+      invalidate(self, key);
+      if (err || !data)
+        next(err || missing(), obj);
+      else
+        load(self, data, key, next);
+    });
+  }
+
+  function change(current, next) {
+    try {
+      Update.apply(current, changes);
+    } catch (x) {
+      return next(x);
+    }
+    current.dumpValid(self, false, next);
+  }
+
+  function modified(err, current) {
+    invalidate(self, key);
+    if (err && err.code == Kyoto.NOREC)
+      next(missing(), obj);
+    else if (err)
+      self.idxManager.mergeErrors(err, current || obj, key, next);
+    else
+      current.afterSave(false, function(err) {
+        next(err, current);
+      });
+  }
+
+  function missing() {
+    var err = new Error("update: this object doesn't exist");
+    err.code = Kyoto.NOREC;
+    return err;
+  }
+
+  return this;
+};
+
+// Serialize an object in this database's format.
+Storage.prototype.dump = function(obj) {
+  return this.binary ? Avro.dumpBinary(obj) : Avro.dumpJSON(obj);
+};
+
+// Get an object by key. When there's a cache, it's checked first and
+// documents read from the database are added to it. A cached
+// document is loaded again for each caller, so callers can change
+// their objects without affecting anyone else.
 Storage.prototype.get = function(key, next) {
-  var error, data;
+  var self = this,
+      cache = this.cache,
+      epoch, data;
+
+  if (!cache)
+    return this.fetch(key, next);
+
+  key = keyString(this, key);
+  if ((data = cache.get(key)) !== undefined) {
+    process.nextTick(function() { load(self, data, key, next); });
+    return this;
+  }
+
+  epoch = cache.epoch;
+  return this.fetch(key, function(err, obj, size, data) {
+    if (obj)
+      cache.put(key, data, size, epoch);
+    next(err, obj);
+  });
+};
+
+// Read an object from the database, bypassing the cache. The
+// callback also receives the size of the stored data and the data.
+Storage.prototype.fetch = function(key, next) {
+  var self = this,
+      error, data;
 
   try {
     if (typeof key != 'string')
-      key = key.toString();
+      key = (key instanceof Key.Key) ? keyString(this, key) : key.toString();
   } catch (x) {
     error = x;
   }
@@ -254,13 +798,91 @@ Storage.prototype.get = function(key, next) {
   if (error)
     next(error);
   else
-    this.db.get(key, function(err, data) {
-      data ? load(data, key, next) : next(err);
+    this.db.get(key, this.binary, function(err, data) {
+      if (!data)
+        next(err);
+      else
+        load(self, data, key, function(err, obj) {
+          next(err, obj, data.length, data);
+        });
     });
 
   return this;
 };
 
+// Get the objects for several keys in one read. The callback
+// receives an Array in the order of `keys`, with undefined where
+// there's no object. Cached documents aren't read again, but each is
+// loaded into a new object.
+Storage.prototype.getList = function(keys, next) {
+  var self = this,
+      cache = this.cache,
+      epoch = cache && cache.epoch,
+      result = new Array(keys.length),
+      found = new Array(keys.length),
+      missing = [],
+      positions = [],
+      data;
+
+  keys = keys.map(function(key) { return keyString(self, key); });
+  for (var i = 0, l = keys.length; i < l; i++) {
+    if (cache && (data = cache.get(keys[i])) !== undefined)
+      found[i] = data;
+    else {
+      missing.push(keys[i]);
+      positions.push(i);
+    }
+  }
+
+  if (missing.length === 0) {
+    process.nextTick(loadAll);
+    return this;
+  }
+
+  this.db.getList(missing, false, this.binary, function(err, vals) {
+    if (err)
+      return next(err);
+
+    for (var i = 0, l = vals.length; i < l; i++) {
+      if ((data = vals[i]) !== undefined) {
+        found[positions[i]] = data;
+        if (cache)
+          cache.put(missing[i], data, data.length, epoch);
+      }
+    }
+
+    loadAll();
+  });
+
+  function loadAll() {
+    var index = 0;
+
+    U.aEach(found, finished, function(data, _, next) {
+      var i = index++;
+
+      if (data === undefined)
+        return next();
+
+      load(self, data, keys[i], function(err, obj) {
+        result[i] = obj;
+        next(err);
+      });
+    });
+  }
+
+  function finished(err) {
+    err ? next(err) : next(null, result);
+  }
+
+  return this;
+};
+
+// Load an object from stored data, see `dump()`.
+Storage.prototype.decode = function(data, key, next) {
+  load(this, data, key, next);
+  return this;
+};
+
 Storage.prototype.find = function(type, params, next) {
   if (typeof params == 'string' && next)
     return this.findById(type, params, next);
@@ -279,30 +901,127 @@ Storage.prototype.findById = function(type, id, next) {
 };
 
 Storage.prototype.generate = function(jumpTo, done) {
-  return new Generator(this.db.generate(jumpTo, done));
+  return this.generateRange({ start: jumpTo }, done);
+};
+
+// With a `select` Array of field names, only those fields are loaded
+// (see `partial()`). JSON documents are cut down to them natively.
+Storage.prototype.generateRange = function(range, done) {
+  var select = range.select;
+
+  if (this.binary)
+    range = U.extend({ asBuffer: true }, range);
+  else if (select)
+    range = U.extend({ project: select }, range);
+
+  return new Generator(this, this.db.generateRange(range, done), select);
+};
+
+// Generate the objects whose keys follow every one of several
+// prefixes, see `KyotoDB.intersect()`.
+Storage.prototype.generateIntersection = function(prefixes, done) {
+  var options = { asBuffer: this.binary };
+  return new Generator(this, this.db.generateIntersection(prefixes, options, done));
 };
 
 Storage.prototype.each = function(done, fn) {
+  var iter = this.generate(null, done);
+
   if (fn.length > 1)
-    this.db.each(done, function(data, key, next) {
-      load(data, key, function(err, obj) {
-        err ? next(err) : fn(obj, next);
+    iter.next(function step(obj) {
+      fn(obj, function(err) {
+        err ? iter.done(err) : iter.next(step);
       });
     });
   else
-    this.db.each(done, function(data, key) {
-      load(data, key, function(err, obj) {
-        err ? done(err) : fn(obj);
-      });
-    });
+    Gen.each(iter, fn);
+
   return this;
 };
 
+// Cache statistics (see `ObjectCache`), or null without a cache.
+Storage.prototype.cacheStats = function() {
+  return this.cache && this.cache.stats();
+};
+
+// Group commit statistics, see `KyotoDB.writeStats()`.
+Storage.prototype.writeStats = function(reset) {
+  return this.db.writeStats(reset);
+};
+
+// Per-operation counts and latencies, see `KyotoDB.stats()`.
+Storage.prototype.stats = function(reset) {
+  return this.db.stats(reset);
+};
+
 Storage.prototype.synchronize = function(hard, next) {
   this.db.synchronize(hard, next);
   return this;
 };
 
+// Write a snapshot of the database, see `KyotoDB.dumpSnapshot()`.
+Storage.prototype.dumpSnapshot = function(path, options, next) {
+  this.db.dumpSnapshot(path, options, next);
+  return this;
+};
+
+// Add the records in a snapshot, see `KyotoDB.loadSnapshot()`.
+Storage.prototype.loadSnapshot = function(path, options, next) {
+  var self = this;
+
+  if (typeof options == 'function') {
+    next = options;
+    options = undefined;
+  }
+
+  this.db.loadSnapshot(path, options, function(err) {
+    if (self.cache)
+      self.cache.clear();
+    next && next(err);
+  });
+
+  return this;
+};
+
+// Add the missing entries of an index declared after objects of
+// `type` were stored, see `Manager.maintain()` in idx.js.
+Storage.prototype.buildIndex = function(type, name, options, next) {
+  this.idxManager.build(type, name, options, next);
+  return this;
+};
+
+// Find and remove entries of an index that no longer belong to an
+// object, see `Manager.maintain()` in idx.js.
+Storage.prototype.checkIndex = function(type, name, options, next) {
+  this.idxManager.check(type, name, options, next);
+  return this;
+};
+
+// A copy of `obj` with only the fields named in `names`. Like objects
+// loaded with `select`, it's partial and can't be saved. Stored
+// fields are copied through their JSON form, so the copy shares no
+// Arrays or records with `obj`.
+Storage.prototype.partial = function(obj, names) {
+  var type = Type.of(obj),
+      result = new type(),
+      id = obj.__pk__(),
+      json = {};
+
+  names.forEach(function(name) {
+    var field = type.__fieldNames__[name];
+
+    if (field)
+      field.dumpJSON(obj, json).loadJSON(json, result);
+    else
+      result[name] = obj[name];
+  });
+
+  if (id)
+    result.__pk__(id);
+
+  return markPartial(result);
+};
+
 Storage.prototype.validateIndex = function(obj, next) {
   this.idxManager.validate(obj, next);
   return this;
@@ -311,8 +1030,10 @@ Storage.prototype.validateIndex = function(obj, next) {
 
 // ## Generator ##
 
-function Generator(iter) {
+function Generator(store, iter, select) {
+  this.store = store;
   this.iter = iter;
+  this.select = select;
 }
 
 Generator.prototype.then = function(callback) {
@@ -326,23 +1047,31 @@ Generator.prototype.done = function(err) {
 };
 
 Generator.prototype.next = function(fn) {
-  var iter = this.iter;
+  var store = this.store,
+      iter = this.iter,
+      select = this.select;
+
   iter.next(function(val, key) {
-    load(val, key, function(err, obj) {
-      err ? iter.done(err) : fn(obj);
-    });
+    if (select)
+      loadPartial(store, val, key, select, loaded);
+    else
+      load(store, val, key, loaded);
   });
+
+  function loaded(err, obj) {
+    err ? iter.done(err) : fn(obj);
+  }
 };
 
 
 // ## Helpers ##
 
-function load(data, key, next) {
+function load(store, data, key, next) {
   var obj;
 
   try {
-    key = (key instanceof Key) ? key : Key.parse(key);
-    obj = Avro.loadJSON(key.type(), data).__pk__(key.id);
+    key = (key instanceof Key.Key) ? key : Key.parse(key, store.keyFormat);
+    obj = Avro.load(key.type(), data).__pk__(key.id);
   } catch (x) {
     return next(x);
   }
@@ -357,8 +1086,66 @@ function load(data, key, next) {
   });
 };
 
-function associate(obj, key) {
-  key = (key instanceof Key) ? key : Key.parse(key);
+// Load the fields named in `names` from stored data. Partial objects
+// skip `afterLoad` listeners, which may expect the whole object.
+function loadPartial(store, data, key, names, next) {
+  var obj;
+
+  try {
+    key = (key instanceof Key.Key) ? key : Key.parse(key, store.keyFormat);
+    obj = Avro.loadFields(key.type(), data, names).__pk__(key.id);
+  } catch (x) {
+    return next(x);
+  }
+
+  next(null, markPartial(obj));
+}
+
+function markPartial(obj) {
+  U.setHidden(obj, '__loaded__', true);
+  U.setHidden(obj, '__partial__', true);
+  return obj;
+}
+
+// A key given as a `Key` is spelled in the store's key format.
+function keyString(store, key) {
+  return (key instanceof Key.Key) ? key.toString(store.keyFormat) : String(key);
+}
+
+function invalidate(store, key) {
+  if (store.cache)
+    store.cache.remove(keyString(store, key));
+}
+
+function clearKey(obj) {
+  obj[Type.of(obj).__pk__] = undefined;
+  return obj;
+}
+
+function associate(store, obj, key) {
+  key = (key instanceof Key.Key) ? key : Key.parse(key, store.keyFormat);
   U.setHidden(obj, '__loaded__', true);
   return obj.__pk__(key.id);
 }
+
+// Compare keys in the byte order of their UTF-8 encoding, which is
+// how Kyoto sorts them. That's code unit order except that surrogate
+// pairs come after everything else in the basic plane.
+function byteOrder(a, b) {
+  var x = a[0], y = b[0], l = Math.min(x.length, y.length), c, d;
+
+  for (var i = 0; i < l; i++) {
+    if ((c = x.charCodeAt(i)) != (d = y.charCodeAt(i)))
+      return utf8Rank(c) - utf8Rank(d);
+  }
+
+  return x.length - y.length;
+}
+
+function utf8Rank(code) {
+  return (code < 0xD800) ? code : (code < 0xE000) ? code + 0x2000 : code - 0x800;
+}
+
+function values(obj) {
+  return Object.keys(obj).map(function(key) { return obj[key]; });
+}
@@ -0,0 +1,128 @@
+var Stream = require('stream').Stream,
+    Util = require('util');
+
+exports.ReadStream = ReadStream;
+
+
+// ## Read Stream ##
+
+// A readable Stream over a generator (see `generators.js`). Each item
+// is emitted as a `data` event after passing through `format(val,
+// key)`, then `end` and `close` are emitted when the generator is
+// finished, or `error` and `close` if it fails.
+//
+// Items are only asked for while the stream is flowing. Database
+// generators read one batch ahead of what's been emitted (see
+// `Prefetch` in kyoto.js), so when a slow destination pauses the
+// stream the native scan stops after at most one more batch instead
+// of buffering the whole range.
+//
+// `make(done)` creates the generator; `done(err)` is its finished
+// callback.
+
+function ReadStream(make, format) {
+  Stream.call(this);
+
+  var self = this;
+
+  this.readable = true;
+  this.destroyed = false;
+  this.paused = false;
+  this.reading = false;
+  this.format = format || identity;
+  this.iter = make(function(err) {
+    self.finish(err);
+  });
+
+  process.nextTick(function() {
+    self.flow();
+  });
+}
+
+Util.inherits(ReadStream, Stream);
+
+ReadStream.prototype.pause = function() {
+  this.paused = true;
+  return this;
+};
+
+ReadStream.prototype.resume = function() {
+  var self = this;
+
+  this.paused = false;
+  process.nextTick(function() {
+    self.flow();
+  });
+
+  return this;
+};
+
+// Stop reading. Nothing more is emitted except `close`. The generator
+// is finished so its scan is released; if an item is being read, that
+// waits until it arrives so the generator isn't finished twice.
+ReadStream.prototype.destroy = function() {
+  if (this.readable) {
+    this.readable = false;
+    this.destroyed = true;
+    if (!this.reading)
+      this.iter.done();
+    this.emit('close');
+  }
+  return this;
+};
+
+// Emit items until the stream is paused or has to wait for the
+// generator. Generators may call back synchronously, so this loops
+// instead of recursing.
+ReadStream.prototype.flow = function() {
+  var self = this,
+      sync;
+
+  while (this.readable && !this.paused && !this.reading) {
+    this.reading = sync = true;
+    this.iter.next(emit);
+    sync = false;
+  }
+
+  function emit(val, key) {
+    var data;
+
+    self.reading = false;
+    if (!self.readable) {
+      if (self.destroyed)
+        self.iter.done();
+      return;
+    }
+
+    try {
+      data = self.format(val, key);
+    } catch (x) {
+      self.iter.done(x);
+      return self.finish(x);
+    }
+
+    self.emit('data', data);
+    if (!sync)
+      self.flow();
+  }
+
+  return this;
+};
+
+ReadStream.prototype.finish = function(err) {
+  if (!this.readable)
+    return this;
+
+  this.readable = false;
+  if (err)
+    this.emit('error', err);
+  else
+    this.emit('end');
+  this.emit('close');
+
+  return this;
+};
+
+function identity(val) {
+  return val;
+}
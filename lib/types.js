@@ -41,6 +41,15 @@ DateType.extend({
 
   exportJSON: function(obj) {
     return this.dumpJSON(obj);
+  },
+
+  // Dates are dumped as strings, not records.
+  writeBinary: function(out, data) {
+    out.string(String(data));
+  },
+
+  readBinary: function(input) {
+    return input.string();
   }
 });
 
@@ -0,0 +1,146 @@
+var Avro = require('./avro'),
+    Schema = require('./avro/schema'),
+    Type = require('./avro/type');
+
+exports.compile = compile;
+exports.apply = apply;
+
+
+// ## Updates ##
+
+// Changes to a stored object, written like this:
+//
+//     { $inc: { 'meta.votes': 1 }, $set: { title: 'New' }, $push: { tags: 'x' } }
+//
+// Nested fields are named with dots. `compile()` turns changes into
+// edits for `KyotoDB.update()`, which makes them in place inside the
+// database. That skips everything Javascript would do around a save,
+// so it's only possible when there's nothing to skip: documents are
+// stored as JSON, the changed fields aren't indexed or validated by
+// hooks, and the type has no save listeners. Otherwise `compile()`
+// returns null and the caller uses `apply()` on a loaded object and
+// saves it instead. Increments of `int` fields also go that way, so
+// validation catches a result outside 32 bits.
+
+var OPERATORS = { $inc: 'inc', $set: 'set', $push: 'push' },
+    NUMBERS = { 'double': true, 'float': true, 'int': true, 'long': true },
+    WHOLE = { 'int': true, 'long': true },
+    LISTENERS = ['beforeValidation', 'beforeSave', 'afterSave'];
+
+// Returns an Array of edits or null. Throws a ValueError if `changes`
+// don't fit the type.
+function compile(type, changes) {
+  var edits = [],
+      edit;
+
+  if (LISTENERS.some(function(name) { return type.__events__.listeners(name).length > 0; }))
+    return null;
+
+  for (var op in changes) {
+    if (!(op in OPERATORS))
+      throw new Type.ValueError('update: unrecognized operator', op);
+
+    for (var name in changes[op]) {
+      if (!(edit = compileEdit(type, OPERATORS[op], name, changes[op][name])))
+        return null;
+      edits.push(edit);
+    }
+  }
+
+  return edits;
+}
+
+function compileEdit(type, kind, name, val) {
+  var names = name.split('.'),
+      path = [],
+      field, primary, items;
+
+  if (indexed(type, names[0]))
+    return null;
+
+  for (var i = 0, l = names.length; i < l; i++) {
+    if (!type.field || !(field = type.field(names[i])))
+      throw new Type.ValueError('update: unrecognized field', name);
+    else if (hooked(type, names[i]) || !field.primaryType || !(primary = field.primaryType()))
+      return null;
+
+    path.push(names[i]);
+    if (i < l - 1 || kind != 'set')
+      path.push(boxName(primary));
+    type = primary;
+  }
+
+  switch (kind) {
+  case 'inc':
+    var number = Schema.name(primary);
+    if (!NUMBERS[number])
+      return null;
+    else if (typeof val != 'number')
+      throw new Type.ValueError('update: expected a number', val);
+    else if (WHOLE[number] && val % 1 !== 0)
+      throw new Type.ValueError('update: expected a whole number', val);
+    else if (number == 'int')
+      return null;
+    return ['inc', path, val];
+
+  case 'push':
+    if (!Type.isSubclass(primary, Avro.ArrayType)
+        || !Schema.isPrimitive(Schema.schema(items = primary.__items__)))
+      return null;
+    items.validate(val);
+    return ['push', path, items.dumpJSON(val)];
+
+  default:
+    var probe = {};
+    probe[field.name] = val;
+    field.validate(probe);
+    return ['set', path, field.dumpJSONValue(val)];
+  }
+}
+
+// Make `changes` to a loaded object.
+function apply(obj, changes) {
+  var names, target, last, val;
+
+  for (var op in changes) {
+    if (!(op in OPERATORS))
+      throw new Type.ValueError('update: unrecognized operator', op);
+
+    for (var name in changes[op]) {
+      names = name.split('.');
+      last = names.pop();
+      target = names.reduce(function(parent, name) {
+        return parent[name] || (parent[name] = {});
+      }, obj);
+      val = changes[op][name];
+
+      if (op == '$inc')
+        target[last] = (target[last] || 0) + val;
+      else if (op == '$push')
+        (target[last] || (target[last] = [])).push(val);
+      else
+        target[last] = val;
+    }
+  }
+
+  return obj;
+}
+
+function indexed(type, name) {
+  var result = false;
+
+  type.indicies.each(function(index) {
+    result = result || index.name == name || !!index.deriveValue;
+  });
+
+  return result;
+}
+
+function hooked(type, name) {
+  var hooks = type.validationHooks;
+  return !!(hooks && (hooks[name] || hooks['']));
+}
+
+function boxName(type) {
+  return Schema.memberName(Schema.schema(type));
+}
@@ -166,6 +166,11 @@ Model.Model.extend({
   addUniqueIndex: function(name, message, derive) {
     this.indicies.addUnique(name, message, derive);
     return this;
+  },
+
+  addOrderedIndex: function(name, message, derive) {
+    this.indicies.addOrdered(name, message, derive);
+    return this;
   }
 });
 
@@ -182,12 +187,12 @@ Model.Model.extend({
     return type;
   },
 
-  calculateIndex: function(obj, key) {
-    return this.indicies.calculate(obj, key);
+  calculateIndex: function(obj, key, format) {
+    return this.indicies.calculate(obj, key, format);
   },
 
-  addIndexErrors: function(invalid, obj) {
-    return this.indicies.addErrors(invalid, obj);
+  addIndexErrors: function(invalid, obj, format) {
+    return this.indicies.addErrors(invalid, obj, format);
   },
 
   firstError: function(obj) {
@@ -232,9 +237,9 @@ Model.Model.extend({
 
     function dump() {
       try {
-        data = Avro.dumpJSON(obj);
+        data = store.dump(obj);
       } catch (x) {
-        error = data;
+        error = x;
       }
 
       done(error, data);
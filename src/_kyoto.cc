@@ -1,6 +1,13 @@
 #include <v8.h>
 #include <node.h>
+#include <node_buffer.h>
 #include <kcpolydb.h>
+#include <pthread.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <deque>
+#include <fstream>
 
 using namespace std;
 using namespace node;
@@ -30,6 +37,9 @@ using namespace kyotocabinet;
 #define EQ_UTF8_BUF(utf, buf, bsiz)                                     \
   ((size_t)utf.length() == bsiz && strncmp(*utf, buf, bsiz) == 0)       \
 
+#define CURSOR_ERROR(cursor)                                            \
+  static_cast<PolyDB *>(cursor->db())->error().code()                   \
+
 #define DEFINE_FUNC(Name, Request)					\
   static Handle<Value> Name(const Arguments& args) {			\
     HandleScope scope;							\
@@ -38,10 +48,11 @@ using namespace kyotocabinet;
       return THROW_BAD_ARGS;						\
     }									\
 									\
+    static int op = Instruments::Register(Request::family(), #Name);	\
     Request* req = new Request(args);					\
+    req->op = op;							\
 									\
-    eio_custom(EIO_Exec##Name, EIO_PRI_DEFAULT, EIO_After##Name, req);	\
-    ev_ref(EV_DEFAULT_UC);						\
+    Schedule(req->pool(), req->lane(), EIO_Exec##Name, EIO_After##Name, req); \
 									\
     return args.This();							\
   }									\
@@ -49,7 +60,10 @@ using namespace kyotocabinet;
 #define DEFINE_EXEC(Name, Request)					\
   static int EIO_Exec##Name(eio_req *ereq) {				\
     Request* req = static_cast<Request *>(ereq->data);			\
-    return req->exec();							\
+    req->timing.started = ev_time();					\
+    int result = req->exec();						\
+    req->timing.finished = ev_time();					\
+    return result;							\
   }									\
 
 #define DEFINE_AFTER(Name, Request)					\
@@ -58,6 +72,7 @@ using namespace kyotocabinet;
     Request* req = static_cast<Request *>(ereq->data);			\
     ev_unref(EV_DEFAULT_UC);						\
     int result = req->after();						\
+    req->record();							\
     delete req;								\
     return result;							\
   }									\
@@ -67,6 +82,32 @@ using namespace kyotocabinet;
   DEFINE_EXEC(Name, Request)						\
   DEFINE_AFTER(Name, Request)
 
+// Like DEFINE_FUNC, but the request may join a group commit instead
+// of running as its own job (see `PolyDBWrap::queueWrite()`).
+#define DEFINE_QUEUED_FUNC(Name, Request)				\
+  static Handle<Value> Name(const Arguments& args) {			\
+    HandleScope scope;							\
+									\
+    if (!Request::validate(args)) {					\
+      return THROW_BAD_ARGS;						\
+    }									\
+									\
+    static int op = Instruments::Register(Request::family(), #Name);	\
+    Request* req = new Request(args);					\
+    req->op = op;							\
+									\
+    if (!req->enqueue()) {						\
+      Schedule(req->pool(), req->lane(), EIO_Exec##Name, EIO_After##Name, req); \
+    }									\
+									\
+    return args.This();							\
+  }									\
+
+#define DEFINE_QUEUED_METHOD(Name, Request)				\
+  DEFINE_QUEUED_FUNC(Name, Request)					\
+  DEFINE_EXEC(Name, Request)						\
+  DEFINE_AFTER(Name, Request)
+
 
 // ## Maps and Lists
 
@@ -84,15 +125,23 @@ void ObjToMap(const Local<Value> value, StringMap &result) {
 
   for (int i = 0; i < names_len; i++) {
     Local<Value> name = names->Get(Integer::New(i));
+    Local<Value> item = obj->Get(name);
     String::Utf8Value key(name);
-    String::Utf8Value val(obj->Get(name)->ToString());
     std::string std_key = std::string(*key, key.length());
-    std::string std_val = std::string(*val, val.length());
-    result.insert(MapItem(std_key, std_val));
+    if (Buffer::HasInstance(item)) {
+      Local<Object> buf = item->ToObject();
+      result.insert(MapItem(std_key, std::string(Buffer::Data(buf), Buffer::Length(buf))));
+    }
+    else {
+      String::Utf8Value val(item->ToString());
+      result.insert(MapItem(std_key, std::string(*val, val.length())));
+    }
   }
 }
 
-Local<Object> MapToObj(StringMap &map) {
+Local<Value> NewBuffer(const char* data, size_t size);
+
+Local<Object> MapToObj(StringMap &map, bool asBuffer = false) {
   HandleScope scope;
 
   MapIterator item = map.begin();
@@ -102,8 +151,12 @@ Local<Object> MapToObj(StringMap &map) {
   Local<Object> result = Object::New();
   while (item != end) {
     Local<String> key = String::New(item->first.c_str(), item->first.length());
-    Local<String> val = String::New(item->second.c_str(), item->second.length());
-    result->Set(key, val);
+    if (asBuffer) {
+      result->Set(key, NewBuffer(item->second.data(), item->second.size()));
+    }
+    else {
+      result->Set(key, String::New(item->second.c_str(), item->second.length()));
+    }
     ++item;
   }
 
@@ -120,264 +173,3787 @@ void MapKeys(const StringMap &map, StringList &keys) {
   }
 }
 
+size_t ListBytes(const StringList &list) {
+  size_t bytes = 0;
+  for (size_t i = 0; i < list.size(); i++) {
+    bytes += list[i].size();
+  }
+  return bytes;
+}
+
+Local<Array> ListToArray(const StringList &list) {
+  HandleScope scope;
+
+  Local<Array> result = Array::New(list.size());
+  for (size_t i = 0; i < list.size(); i++) {
+    result->Set(i, String::New(list[i].data(), list[i].size()));
+  }
+
+  return scope.Close(result);
+}
+
+size_t MapBytes(const StringMap &map) {
+  size_t bytes = 0;
+  MapIterator item = map.begin();
+  MapIterator end = map.end();
+  while (item != end) {
+    bytes += item->first.size() + item->second.size();
+    ++item;
+  }
+  return bytes;
+}
+
 void ArrayToList(const Local<Value> obj, StringList &result) {
   HandleScope scope;
 
   Local<Array> array = Local<Array>::Cast(obj);
   int alen = array->Length();
   for (int i = 0; i < alen; i++) {
-    String::Utf8Value val(array->Get(Integer::New(i))->ToString());
-    result.push_back(std::string(*val, val.length()));
+    Local<Value> item = array->Get(Integer::New(i));
+    if (Buffer::HasInstance(item)) {
+      Local<Object> buf = item->ToObject();
+      result.push_back(std::string(Buffer::Data(buf), Buffer::Length(buf)));
+    }
+    else {
+      String::Utf8Value val(item->ToString());
+      result.push_back(std::string(*val, val.length()));
+    }
   }
 }
 
-class PolyDBWrap: ObjectWrap {
+
+// ## Buffers ##
+
+// A key or value argument given as either a String or a Buffer. A
+// String is encoded as UTF-8. A Buffer is used in place, so it's kept
+// from being collected until the request is finished.
+
+class Bytes {
 private:
-  PolyDB* db;
+  String::Utf8Value* utf;
+  Persistent<Object> buffer;
+  const char* data;
+  size_t size;
 
 public:
+  static inline bool IsBytes(Handle<Value> val) {
+    return val->IsString() || Buffer::HasInstance(val);
+  }
 
-  // ## Initialization ##
+  explicit Bytes(Handle<Value> val):
+    utf(NULL)
+  {
+    if (Buffer::HasInstance(val)) {
+      Local<Object> obj = val->ToObject();
+      buffer = Persistent<Object>::New(obj);
+      data = Buffer::Data(obj);
+      size = Buffer::Length(obj);
+    }
+    else {
+      utf = new String::Utf8Value(val->ToString());
+      data = **utf;
+      size = utf->length();
+    }
+  }
 
-  static Persistent<FunctionTemplate> ctor;
+  ~Bytes() {
+    if (utf) delete utf;
+    if (!buffer.IsEmpty()) buffer.Dispose();
+  }
 
-  static void Init(Handle<Object> target) {
-    HandleScope scope;
+private:
+  Bytes(const Bytes&);
+  void operator=(const Bytes&);
 
-    Local<FunctionTemplate> tmpl = FunctionTemplate::New(New);
+public:
 
-    ctor = Persistent<FunctionTemplate>::New(tmpl);
-    ctor->InstanceTemplate()->SetInternalFieldCount(1);
-    ctor->SetClassName(String::NewSymbol("PolyDB"));
+  inline const char* operator*() const {
+    return data;
+  }
 
-    SET_CLASS_CONSTANT(ctor, PolyDB, OREADER);
-    SET_CLASS_CONSTANT(ctor, PolyDB, OWRITER);
-    SET_CLASS_CONSTANT(ctor, PolyDB, OCREATE);
-    SET_CLASS_CONSTANT(ctor, PolyDB, OTRUNCATE);
-    SET_CLASS_CONSTANT(ctor, PolyDB, OAUTOTRAN);
-    SET_CLASS_CONSTANT(ctor, PolyDB, OAUTOSYNC);
-    SET_CLASS_CONSTANT(ctor, PolyDB, ONOLOCK);
-    SET_CLASS_CONSTANT(ctor, PolyDB, OTRYLOCK);
-    SET_CLASS_CONSTANT(ctor, PolyDB, ONOREPAIR);
+  inline size_t length() const {
+    return size;
+  }
+};
 
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, SUCCESS);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, NOIMPL);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, INVALID);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, NOREPOS);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, NOPERM);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, BROKEN);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, DUPREC);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, NOREC);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, LOGIC);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, SYSTEM);
-    SET_CLASS_CONSTANT(ctor, PolyDB::Error, MISC);
+// Copy bytes into a new Buffer.
+Local<Value> NewBuffer(const char* data, size_t size) {
+  HandleScope scope;
+  Buffer* buf = Buffer::New(const_cast<char*>(data), size);
+  return scope.Close(Local<Object>::New(buf->handle_));
+}
 
-    NODE_SET_PROTOTYPE_METHOD(ctor, "open", Open);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "close", Close);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "closeSync", CloseSync);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "set", Set);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "add", Add);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "replace", Replace);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "get", Get);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "getBulk", GetBulk);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "remove", Remove);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "synchronize", Synchronize);
+// Records read from Kyoto are allocated with `new[]`. Hand one over to
+// a Buffer instead of copying it; the Buffer frees it when it's
+// collected. `data` may point inside the allocation that starts at
+// `base` (a value follows its key when both are read at once).
 
-    // Here are some non-standard methods.
-    NODE_SET_PROTOTYPE_METHOD(ctor, "addIndexed", AddIndexed);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "replaceIndexed", ReplaceIndexed);
-    NODE_SET_PROTOTYPE_METHOD(ctor, "removeIndexed", RemoveIndexed);
+static void FreeRecord(char* data, void* base) {
+  delete[] static_cast<char*>(base);
+}
 
-    target->Set(String::NewSymbol("PolyDB"), ctor->GetFunction());
-  }
+Local<Value> AdoptBuffer(char* base, const char* data, size_t size) {
+  HandleScope scope;
+  Buffer* buf = Buffer::New(const_cast<char*>(data), size, FreeRecord, base);
+  return scope.Close(Local<Object>::New(buf->handle_));
+}
 
-  // ## Construction ##
 
-  PolyDBWrap()  {
-    db = new PolyDB();
+// ## Record Lists ##
+
+// Records collected by a cursor during one job. Kyoto returns a key
+// and its value in a single allocation with the value following the
+// key, so only the key buffer is owned. When only keys are read,
+// `vbuf` is NULL.
+//
+// Reading values as Buffers hands the allocations over to them.
+
+struct Record {
+  char* kbuf;
+  size_t ksiz;
+  const char* vbuf;
+  size_t vsiz;
+};
+
+class RecordList {
+public:
+  std::vector<Record> items;
+  int64_t bytes;
+  bool adopted;
+
+  RecordList(): bytes(0), adopted(false) {}
+
+  ~RecordList() {
+    if (adopted) return;
+
+    std::vector<Record>::iterator item = items.begin();
+    std::vector<Record>::iterator end = items.end();
+    while (item != end) {
+      delete[] item->kbuf;
+      ++item;
+    }
   }
 
-  ~PolyDBWrap() {
-    delete db;
+  inline size_t size() const {
+    return items.size();
   }
 
-  static Handle<Value> New(const Arguments& args) {
+  inline void push(const Record& rec) {
+    items.push_back(rec);
+    bytes += rec.ksiz + rec.vsiz;
+  }
+
+  Local<Array> keys() {
     HandleScope scope;
-    PolyDBWrap* wrap = new PolyDBWrap();
-    wrap->Wrap(args.This());
-    return args.This();
+
+    int count = items.size();
+    Local<Array> result = Array::New(count);
+    for (int i = 0; i < count; i++) {
+      result->Set(i, String::New(items[i].kbuf, items[i].ksiz));
+    }
+
+    return scope.Close(result);
   }
 
-  
-  // ## Helpers ##
+  Local<Value> values(bool asBuffer) {
+    HandleScope scope;
 
-  DB::Cursor* cursor() {
-    return db->cursor();
+    int count = items.size();
+    if (count > 0 && !items[0].vbuf) {
+      return scope.Close(LNULL);
+    }
+
+    Local<Array> result = Array::New(count);
+    for (int i = 0; i < count; i++) {
+      Record& rec = items[i];
+      if (asBuffer) {
+	result->Set(i, AdoptBuffer(rec.kbuf, rec.vbuf, rec.vsiz));
+      }
+      else {
+	result->Set(i, String::New(rec.vbuf, rec.vsiz));
+      }
+    }
+    adopted = asBuffer;
+
+    return scope.Close(result);
   }
+};
 
-  
-  // ## Async Glue ##
+// Byte-wise comparison, the same order Kyoto's tree databases use by
+// default.
+inline int CompareBuf(const char* abuf, size_t asiz, const char* bbuf, size_t bsiz) {
+  size_t len = (asiz < bsiz) ? asiz : bsiz;
+  int cmp = memcmp(abuf, bbuf, len);
+  if (cmp != 0) return cmp;
+  return (asiz < bsiz) ? -1 : (asiz > bsiz) ? 1 : 0;
+}
 
-  class Request {
-  private:
-    Persistent<String> code_symbol;
 
-  protected:
-    PolyDBWrap* wrap;
-    Persistent<Function> next;
-    PolyDB::Error::Code result;
+// ## Value Lists ##
 
-  public:
-    Request(const Arguments& args, int nextIndex):
-      result(PolyDB::Error::SUCCESS) {
-      HandleScope scope;
+// Values read for a list of keys, kept in request order. They're
+// packed end to end in one string; `sizes` holds -1 for a key that
+// has no record. Kyoto's `accept_bulk()` visits keys in the order
+// they're given (it only sorts its locks), so no map is needed to
+// put them back in order.
 
-      wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
-      next = Persistent<Function>::New(Handle<Function>::Cast(args[nextIndex]));
+class ValueList : public DB::Visitor {
+public:
+  std::string data;
+  std::vector<size_t> offsets;
+  std::vector<int64_t> sizes;
 
-      wrap->Ref();
-    }
+  // Read `keys` from `db`, all at once in one transaction if `atomic`.
+  bool read(PolyDB* db, const StringList& keys, bool atomic) {
+    offsets.reserve(keys.size());
+    sizes.reserve(keys.size());
 
-    ~Request() {
-      wrap->Unref();
-      next.Dispose();
+    if (atomic) {
+      return db->accept_bulk(keys, this, false);
     }
 
-    virtual inline int exec() = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (!db->accept(keys[i].data(), keys[i].size(), this, false)) {
+	return false;
+      }
+    }
+    return true;
+  }
 
-    virtual inline int after() = 0;
+  // An Array with a value or `undefined` for each key.
+  Local<Array> values(bool asBuffer) {
+    HandleScope scope;
 
-    inline void callback(int argc, Handle<Value> argv[]) {
-      TryCatch try_catch;
-      next->Call(Context::GetCurrent()->Global(), argc, argv);
-      if (try_catch.HasCaught()) {
-	FatalException(try_catch);
+    int count = sizes.size();
+    Local<Array> result = Array::New(count);
+    for (int i = 0; i < count; i++) {
+      const char* vbuf = data.data() + offsets[i];
+      if (sizes[i] < 0) {
+	result->Set(i, Undefined());
+      }
+      else if (asBuffer) {
+	result->Set(i, NewBuffer(vbuf, sizes[i]));
+      }
+      else {
+	result->Set(i, String::New(vbuf, sizes[i]));
       }
     }
 
-    Local<Value> error() {
-      if (result == PolyDB::Error::SUCCESS)
-	return LNULL;
+    return scope.Close(result);
+  }
 
-      const char* name = PolyDB::Error::codename(result);
-      Local<String> message = String::NewSymbol(name);
-      Local<Value> err = Exception::Error(message);
+private:
+  const char* visit_full(const char* kbuf, size_t ksiz,
+			 const char* vbuf, size_t vsiz,
+			 size_t *sp)
+  {
+    offsets.push_back(data.size());
+    sizes.push_back(vsiz);
+    data.append(vbuf, vsiz);
+    return NOP;
+  }
 
-      if (code_symbol.IsEmpty()) {
-	code_symbol = NODE_PSYMBOL("code");
-      }
+  const char* visit_empty(const char* kbuf, size_t ksiz, size_t *sp) {
+    offsets.push_back(data.size());
+    sizes.push_back(-1);
+    return NOP;
+  }
+};
 
-      Local<Object> obj = err->ToObject();
-      obj->Set(code_symbol, Integer::New(result));
 
-      return err;
-    }
-  };
+// ## JSON Edits ##
 
-  
-  // ### Open ###
+// Small changes to a stored JSON document, made without parsing the
+// whole thing. A path of quoted member names (e.g. `"meta"`) is
+// followed through nested objects by skipping over every other
+// value, then the value at the end is changed in place. Missing or
+// null members along the path are filled in.
+//
+// Edits are kept to what Javascript would write: numbers are printed
+// in their shortest form and everything else is already JSON text.
 
-  DEFINE_METHOD(Open, OpenRequest)
-  class OpenRequest: public Request {
-  private:
-    String::Utf8Value path;
-    uint32_t mode;
+struct JsonEdit {
+  enum Kind { INCREMENT = 0, SET = 1, APPEND = 2, SWAP = 3 };
+  enum Status { OK, INVALID, CONFLICT };
 
-  public:
-    inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 3
-	      && args[0]->IsString()
-	      && args[1]->IsUint32()
-	      && args[2]->IsFunction());
-    }
+  int kind;
+  StringList path;
+  std::string value;
+  std::string expect;
+  double delta;
+};
 
-    OpenRequest(const Arguments& args):
-      Request(args, 2),
-      path(args[0]->ToString()),
-      mode(args[1]->Uint32Value())
-    {}
+typedef std::vector<JsonEdit> JsonEditList;
 
-    inline int exec() {
-      PolyDB* db = wrap->db;
-      if (!db->open(*path, mode)) result = db->error().code();
-      return 0;
-    }
+static const size_t JSON_NONE = std::string::npos;
 
-    inline int after() {
-      Local<Value> argv[1] = { error() };
-      callback(1, argv);
-      return 0;
-    }
-  };
+inline size_t JsonSkipSpace(const std::string& doc, size_t pos) {
+  while (pos < doc.size() && isspace(static_cast<unsigned char>(doc[pos]))) pos++;
+  return pos;
+}
 
-  
-  // ### Close ###
+inline size_t JsonSkipString(const std::string& doc, size_t pos) {
+  for (pos++; pos < doc.size(); pos++) {
+    if (doc[pos] == '\\') pos++;
+    else if (doc[pos] == '"') return pos + 1;
+  }
+  return JSON_NONE;
+}
 
-  DEFINE_METHOD(Close, CloseRequest)
-  class CloseRequest: public Request {
-  public:
+// The end of the value starting at `pos`, or JSON_NONE if it's cut
+// short. Scalars aren't checked; they run until the next delimiter.
+size_t JsonSkipValue(const std::string& doc, size_t pos) {
+  if (pos >= doc.size()) return JSON_NONE;
 
-    inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 1 && args[0]->IsFunction());
+  char c = doc[pos];
+  if (c == '"') {
+    return JsonSkipString(doc, pos);
+  }
+  else if (c == '{' || c == '[') {
+    int depth = 0;
+    while (pos < doc.size()) {
+      c = doc[pos];
+      if (c == '"') {
+	if ((pos = JsonSkipString(doc, pos)) == JSON_NONE) return JSON_NONE;
+	continue;
+      }
+      else if (c == '{' || c == '[') {
+	depth++;
+      }
+      else if ((c == '}' || c == ']') && --depth == 0) {
+	return pos + 1;
+      }
+      pos++;
     }
+    return JSON_NONE;
+  }
 
-    CloseRequest(const Arguments& args):
-      Request(args, 0)
-    {}
+  size_t start = pos;
+  while (pos < doc.size() && !strchr(",:]} \t\r\n", doc[pos])) pos++;
+  return (pos > start) ? pos : JSON_NONE;
+}
 
-    inline int exec() {
-      PolyDB* db = wrap->db;
-      if (!db->close()) result = db->error().code();
-      return 0;
-    }
+// Find member `name` of the object starting at `pos`. Returns 1 and
+// the value's span if it's there, 0 and the position of the closing
+// brace if it isn't, or -1 if the object is malformed.
+int JsonFindMember(const std::string& doc, size_t pos, const std::string& name,
+		   size_t* start, size_t* end) {
+  pos = JsonSkipSpace(doc, pos + 1);
+  if (pos < doc.size() && doc[pos] == '}') {
+    *start = *end = pos;
+    return 0;
+  }
 
-    inline int after() {
-      Local<Value> argv[1] = { error() };
-      callback(1, argv);
-      return 0;
-    }
-  };
+  while (pos < doc.size() && doc[pos] == '"') {
+    size_t keyEnd = JsonSkipString(doc, pos);
+    if (keyEnd == JSON_NONE) return -1;
 
-  static Handle<Value> CloseSync(const Arguments& args) {
-    HandleScope scope;
+    bool match = (keyEnd - pos == name.size()
+		  && doc.compare(pos, name.size(), name) == 0);
 
-    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
-    PolyDB* db = wrap->db;
+    pos = JsonSkipSpace(doc, keyEnd);
+    if (pos >= doc.size() || doc[pos] != ':') return -1;
 
-    return Boolean::New(db->close());
-  }
+    pos = JsonSkipSpace(doc, pos + 1);
+    size_t valueEnd = JsonSkipValue(doc, pos);
+    if (valueEnd == JSON_NONE) return -1;
+
+    if (match) {
+      *start = pos;
+      *end = valueEnd;
+      return 1;
+    }
+
+    pos = JsonSkipSpace(doc, valueEnd);
+    if (pos < doc.size() && doc[pos] == '}') {
+      *start = *end = pos;
+      return 0;
+    }
+    else if (pos >= doc.size() || doc[pos] != ',') {
+      return -1;
+    }
+    pos = JsonSkipSpace(doc, pos + 1);
+  }
+
+  return -1;
+}
+
+// The shortest text that reads back as `num`, the way
+// `JSON.stringify()` would print it.
+std::string JsonNumber(double num) {
+  char buf[32];
+
+  if (num == 0) {
+    return "0";
+  }
+  else if (num == floor(num) && fabs(num) < 1e15) {
+    snprintf(buf, sizeof(buf), "%.0f", num);
+    return buf;
+  }
+
+  for (int precision = 1; precision <= 17; precision++) {
+    snprintf(buf, sizeof(buf), "%.*g", precision, num);
+    if (strtod(buf, NULL) == num) break;
+  }
+  return buf;
+}
+
+// What an edit leaves behind when the path runs out at `from`: the
+// new value wrapped in objects for the rest of the path.
+std::string JsonFill(const JsonEdit& edit, size_t from) {
+  std::string result;
+
+  switch (edit.kind) {
+  case JsonEdit::INCREMENT:
+    result = JsonNumber(edit.delta);
+    break;
+  case JsonEdit::APPEND:
+    result = "[" + edit.value + "]";
+    break;
+  default:
+    result = edit.value;
+  }
+
+  for (size_t i = edit.path.size(); i > from; i--) {
+    result = "{" + edit.path[i - 1] + ":" + result + "}";
+  }
+
+  return result;
+}
+
+// Change the value at [start, end) of `doc`.
+JsonEdit::Status JsonChange(std::string& doc, const JsonEdit& edit, size_t start, size_t end) {
+  switch (edit.kind) {
+  case JsonEdit::INCREMENT: {
+    std::string text(doc, start, end - start);
+    char* stop;
+    double num = strtod(text.c_str(), &stop);
+    if (text.empty() || *stop) return JsonEdit::INVALID;
+
+    // Infinities and NaN have no JSON form.
+    num += edit.delta;
+    if (!(num - num == 0)) return JsonEdit::INVALID;
+
+    doc.replace(start, end - start, JsonNumber(num));
+    return JsonEdit::OK;
+  }
+
+  case JsonEdit::SET:
+    doc.replace(start, end - start, edit.value);
+    return JsonEdit::OK;
+
+  case JsonEdit::APPEND:
+    if (doc[start] != '[') return JsonEdit::INVALID;
+    if (doc[JsonSkipSpace(doc, start + 1)] == ']') {
+      doc.insert(end - 1, edit.value);
+    }
+    else {
+      doc.insert(end - 1, "," + edit.value);
+    }
+    return JsonEdit::OK;
+  }
+
+  return JsonEdit::INVALID;
+}
+
+// Apply one edit to `doc`. Nothing is changed unless it succeeds.
+JsonEdit::Status JsonApply(std::string& doc, const JsonEdit& edit) {
+  if (edit.kind == JsonEdit::SWAP) {
+    if (doc != edit.expect) return JsonEdit::CONFLICT;
+    doc = edit.value;
+    return JsonEdit::OK;
+  }
+
+  size_t start = JsonSkipSpace(doc, 0);
+  size_t end = JsonSkipValue(doc, start);
+  if (end == JSON_NONE) return JsonEdit::INVALID;
+
+  for (size_t i = 0; i < edit.path.size(); i++) {
+    if (doc[start] != '{') return JsonEdit::INVALID;
+
+    int found = JsonFindMember(doc, start, edit.path[i], &start, &end);
+    if (found < 0) {
+      return JsonEdit::INVALID;
+    }
+    else if (found == 0) {
+      size_t last = doc.find_last_not_of(" \t\r\n", start - 1);
+      std::string member = edit.path[i] + ":" + JsonFill(edit, i + 1);
+      doc.insert(start, (doc[last] == '{') ? member : "," + member);
+      return JsonEdit::OK;
+    }
+    else if (end - start == 4 && doc.compare(start, 4, "null") == 0) {
+      doc.replace(start, 4, JsonFill(edit, i + 1));
+      return JsonEdit::OK;
+    }
+  }
+
+  return JsonChange(doc, edit, start, end);
+}
+
+
+// Copy the members named by `names` (quoted, like a path) from the
+// JSON object `doc` into a new object. Missing members are left out.
+// Returns false if `doc` isn't a JSON object.
+bool JsonProject(const std::string& doc, const StringList& names, std::string& result) {
+  size_t root = JsonSkipSpace(doc, 0), start, end;
+  if (root >= doc.size() || doc[root] != '{') return false;
+
+  result = "{";
+  for (size_t i = 0; i < names.size(); i++) {
+    int found = JsonFindMember(doc, root, names[i], &start, &end);
+    if (found < 0) return false;
+    else if (found == 0) continue;
+
+    if (result.size() > 1) result += ',';
+    result += names[i];
+    result += ':';
+    result.append(doc, start, end - start);
+  }
+  result += '}';
+
+  return true;
+}
+
+
+// ## Index Layouts ##
+
+// Where each index of a type finds its value in a stored JSON
+// document, so a record's index entries can be worked out without
+// loading it into Javascript (see `IndexSet.layout()` in idx.js).
+// Each index has a key prefix, a path of quoted member names to its
+// value, and a mode saying how entries are keyed:
+//
+//   + PLAIN   - prefix + value + "}" + key, for non-null values
+//   + UNIQUE  - prefix + value + "}", for non-null values
+//   + ORDERED - prefix + encoded value + key, see collate.js
+//
+// Every entry's value is the record's key.
+
+struct IndexLayout {
+  enum Mode { PLAIN = 0, UNIQUE = 1, ORDERED = 2 };
+
+  std::string prefix;
+  StringList path;
+  int mode;
+};
+
+typedef std::vector<IndexLayout> IndexLayoutList;
+
+inline void AppendUtf8(std::string& out, uint32_t code) {
+  if (code < 0x80) {
+    out += static_cast<char>(code);
+  }
+  else if (code < 0x800) {
+    out += static_cast<char>(0xc0 | (code >> 6));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  }
+  else if (code < 0x10000) {
+    out += static_cast<char>(0xe0 | (code >> 12));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  }
+  else {
+    out += static_cast<char>(0xf0 | (code >> 18));
+    out += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+    out += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+    out += static_cast<char>(0x80 | (code & 0x3f));
+  }
+}
+
+inline int HexDigit(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Read four hex digits at `pos`, or return false.
+bool ReadHex4(const std::string& doc, size_t pos, uint32_t* code) {
+  if (pos + 4 > doc.size()) return false;
+
+  *code = 0;
+  for (size_t i = pos; i < pos + 4; i++) {
+    int digit = HexDigit(doc[i]);
+    if (digit < 0) return false;
+    *code = (*code << 4) | digit;
+  }
+  return true;
+}
+
+// The UTF-8 text of the JSON string in [start, end). Unpaired
+// surrogates become U+FFFD, as they do when Javascript encodes them.
+bool JsonUnquote(const std::string& doc, size_t start, size_t end, std::string& out) {
+  for (size_t pos = start + 1; pos < end - 1; pos++) {
+    char c = doc[pos];
+    if (c != '\\') {
+      out += c;
+      continue;
+    }
+
+    switch (doc[++pos]) {
+    case 'b': out += '\b'; break;
+    case 'f': out += '\f'; break;
+    case 'n': out += '\n'; break;
+    case 'r': out += '\r'; break;
+    case 't': out += '\t'; break;
+    case 'u': {
+      uint32_t code, low;
+      if (!ReadHex4(doc, pos + 1, &code)) return false;
+      pos += 4;
+
+      if (code >= 0xd800 && code < 0xdc00
+	  && doc.compare(pos + 1, 2, "\\u") == 0
+	  && ReadHex4(doc, pos + 3, &low)
+	  && low >= 0xdc00 && low < 0xe000) {
+	code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+	pos += 6;
+      }
+      else if (code >= 0xd800 && code < 0xe000) {
+	code = 0xfffd;
+      }
+
+      AppendUtf8(out, code);
+      break;
+    }
+    default:
+      out += doc[pos];
+    }
+  }
+  return true;
+}
+
+inline void AppendHex(std::string& out, const unsigned char* bytes, size_t size) {
+  static const char digits[] = "0123456789abcdef";
+  for (size_t i = 0; i < size; i++) {
+    out += digits[bytes[i] >> 4];
+    out += digits[bytes[i] & 0xf];
+  }
+}
+
+// The order-preserving encoding of `Collate.encodeValue()` for the
+// JSON scalar in [start, end).
+bool CollateJson(const std::string& doc, size_t start, size_t end, std::string& out) {
+  char c = doc[start];
+
+  if (c == 'n') {
+    out += '1';
+  }
+  else if (c == 't' || c == 'f') {
+    out += (c == 't') ? "21" : "20";
+  }
+  else if (c == '"') {
+    std::string text;
+    if (!JsonUnquote(doc, start, end, text)) return false;
+    out += '4';
+    AppendHex(out, reinterpret_cast<const unsigned char*>(text.data()), text.size());
+    out += '.';
+  }
+  else {
+    // Big-endian IEEE 754 with the sign bit flipped, or every bit
+    // flipped for negative numbers.
+    std::string text(doc, start, end - start);
+    char* stop;
+    double num = strtod(text.c_str(), &stop);
+    if (*stop) return false;
+
+    uint64_t bits;
+    memcpy(&bits, &num, sizeof(bits));
+    bits = (bits >> 63) ? ~bits : (bits | (1ULL << 63));
+
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) {
+      bytes[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+    }
+
+    out += '3';
+    AppendHex(out, bytes, sizeof(bytes));
+  }
+
+  return true;
+}
+
+// Collect the index entry keys of the JSON record `doc` stored at
+// `key`. Returns false if the record can't be read this way; it may
+// be an Avro document or have a value where a scalar should be.
+bool IndexEntries(const IndexLayoutList& layout, const std::string& doc,
+		  const std::string& key, StringList& entries) {
+  size_t root = JsonSkipSpace(doc, 0);
+  if (root >= doc.size() || doc[root] != '{') return false;
+
+  for (size_t i = 0; i < layout.size(); i++) {
+    const IndexLayout& index = layout[i];
+    size_t start = root, end = root;
+    bool present = true;
+
+    for (size_t j = 0; j < index.path.size() && present; j++) {
+      if (doc[start] != '{') return false;
+
+      int found = JsonFindMember(doc, start, index.path[j], &start, &end);
+      if (found < 0) return false;
+      present = (found == 1 && doc.compare(start, end - start, "null") != 0);
+    }
+
+    if (present && (doc[start] == '{' || doc[start] == '[')) {
+      return false;
+    }
+    else if (index.mode == IndexLayout::ORDERED) {
+      std::string entry = index.prefix;
+      if (!present) entry += '1';
+      else if (!CollateJson(doc, start, end, entry)) return false;
+      entries.push_back(entry + key);
+    }
+    else if (present) {
+      std::string entry = index.prefix;
+      if (doc[start] != '"') entry.append(doc, start, end - start);
+      else if (!JsonUnquote(doc, start, end, entry)) return false;
+      entry += '}';
+      entries.push_back((index.mode == IndexLayout::UNIQUE) ? entry : entry + key);
+    }
+  }
+
+  return true;
+}
+
+void ArrayToLayout(const Local<Value> obj, IndexLayoutList& result) {
+  HandleScope scope;
+
+  Local<Array> array = Local<Array>::Cast(obj);
+  result.resize(array->Length());
+
+  for (uint32_t i = 0; i < array->Length(); i++) {
+    Local<Array> item = Local<Array>::Cast(array->Get(i));
+    IndexLayout& index = result[i];
+
+    String::Utf8Value prefix(item->Get(0)->ToString());
+    index.prefix.assign(*prefix, prefix.length());
+    ArrayToList(item->Get(1), index.path);
+    index.mode = item->Get(2)->Int32Value();
+  }
+}
+
+bool IsLayout(const Local<Value> obj) {
+  if (!obj->IsArray()) return false;
+
+  Local<Array> array = Local<Array>::Cast(obj);
+  for (uint32_t i = 0; i < array->Length(); i++) {
+    Local<Value> item = array->Get(i);
+    if (!item->IsArray()) return false;
+
+    Local<Array> index = Local<Array>::Cast(item);
+    if (!index->Get(0)->IsString()
+	|| !index->Get(1)->IsArray()
+	|| !index->Get(2)->IsUint32()
+	|| index->Get(2)->Uint32Value() > IndexLayout::ORDERED) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// ## Range Aggregates ##
+
+// Fold the records in a key range into one result without copying
+// them out of the database: a cursor visits each record in place,
+// and only a member's text is copied to read a number.
+//
+//   + COUNT         - counts the records in the range
+//   + SUM, MIN, MAX - fold the number at `path` in each JSON
+//                     document; a missing or null member is skipped
+//   + GROUP         - counts index entries by value (see `group()`);
+//                     `mode` is the index's layout mode
+//
+// A document that isn't a JSON object, or has something other than
+// a number at `path`, is counted as unreadable instead.
+
+class RangeAggregate : public DB::Visitor {
+public:
+  enum Op { COUNT = 0, SUM = 1, MIN = 2, MAX = 3, GROUP = 4 };
+  typedef std::map<std::string, int64_t> GroupMap;
+
+  int op;
+  StringList path;
+  int mode;
+  std::string prefix;
+  std::string end;
+  bool hasEnd;
+  bool done;
+  int64_t count;
+  int64_t values;
+  int64_t unreadable;
+  double value;
+  GroupMap groups;
+
+  RangeAggregate():
+    op(COUNT), mode(IndexLayout::PLAIN), hasEnd(false), done(false),
+    count(0), values(0), unreadable(0), value(0)
+  {}
+
+private:
+  std::string doc;
+  GroupMap::iterator last;
+
+  const char* visit_full(const char* kbuf, size_t ksiz,
+			 const char* vbuf, size_t vsiz,
+			 size_t *sp)
+  {
+    if (ksiz < prefix.size()
+	|| memcmp(kbuf, prefix.data(), prefix.size()) != 0
+	|| (hasEnd && CompareBuf(kbuf, ksiz, end.data(), end.size()) >= 0)) {
+      done = true;
+      return NOP;
+    }
+
+    count++;
+    if (op == GROUP) {
+      group(kbuf, ksiz, vsiz);
+    }
+    else if (op != COUNT) {
+      fold(vbuf, vsiz);
+    }
+    return NOP;
+  }
+
+  // An entry's key is the index prefix, the value and, except in a
+  // unique index, the record's key, which is also the entry's value.
+  // Plain and unique values end with "}". Entries with the same
+  // value are next to each other, so the last group is tried first.
+  void group(const char* kbuf, size_t ksiz, size_t vsiz) {
+    size_t trim = (mode == IndexLayout::UNIQUE) ? 1
+      : (mode == IndexLayout::PLAIN) ? vsiz + 1
+      : vsiz;
+
+    if (prefix.size() + trim > ksiz) {
+      unreadable++;
+      return;
+    }
+
+    const char* text = kbuf + prefix.size();
+    size_t size = ksiz - prefix.size() - trim;
+
+    if (groups.empty()
+	|| last->first.size() != size
+	|| memcmp(last->first.data(), text, size) != 0) {
+      last = groups.insert(GroupMap::value_type(std::string(text, size), 0)).first;
+    }
+    last->second++;
+  }
+
+  void fold(const char* vbuf, size_t vsiz) {
+    doc.assign(vbuf, vsiz);
+
+    size_t start = JsonSkipSpace(doc, 0), end = start;
+    for (size_t i = 0; i < path.size(); i++) {
+      if (start >= doc.size() || doc[start] != '{') {
+	unreadable++;
+	return;
+      }
+
+      int found = JsonFindMember(doc, start, path[i], &start, &end);
+      if (found < 0) {
+	unreadable++;
+	return;
+      }
+      else if (found == 0 || doc.compare(start, end - start, "null") == 0) {
+	return;
+      }
+    }
+
+    char* stop;
+    double num = strtod(doc.c_str() + start, &stop);
+    if (end == start || stop != doc.c_str() + end) {
+      unreadable++;
+      return;
+    }
+
+    if (op == SUM) {
+      value += num;
+    }
+    else if (values == 0 || (op == MIN ? num < value : num > value)) {
+      value = num;
+    }
+    values++;
+  }
+};
+
+
+// ## Snapshot Files ##
+
+// Snapshots are written with Kyoto's `dump_snapshot()` and read with
+// `load_snapshot()`, which stream records through a C++ stream. A
+// compressed snapshot starts with SNAPSHOT_MAGIC, followed by blocks
+// of raw deflate data, each preceded by its length as 4 big-endian
+// bytes. Blocks are compressed independently so neither side has to
+// hold more than one of them.
+
+static const char SNAPSHOT_MAGIC[] = "KCSZ";
+static const size_t SNAPSHOT_MAGIC_SIZE = 4;
+static const size_t SNAPSHOT_BLOCK = 1 << 20;
+
+class DeflateBuf : public std::streambuf {
+  std::ostream& out;
+  std::vector<char> block;
+
+public:
+  explicit DeflateBuf(std::ostream& out):
+    out(out),
+    block(SNAPSHOT_BLOCK)
+  {
+    setp(&block[0], &block[0] + block.size());
+  }
+
+protected:
+  int overflow(int c) {
+    if (flushBlock() != 0) {
+      return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int sync() {
+    return flushBlock();
+  }
+
+private:
+  int flushBlock() {
+    size_t size = pptr() - pbase(), zsiz;
+    if (size == 0) {
+      return 0;
+    }
+
+    char* zbuf = ZLIB::compress(pbase(), size, &zsiz, ZLIB::RAW);
+    if (!zbuf) {
+      return -1;
+    }
+
+    char head[4] = {
+      (char)(zsiz >> 24), (char)(zsiz >> 16), (char)(zsiz >> 8), (char)zsiz
+    };
+    out.write(head, sizeof(head));
+    out.write(zbuf, zsiz);
+    delete[] zbuf;
+
+    setp(&block[0], &block[0] + block.size());
+    return out ? 0 : -1;
+  }
+};
+
+class InflateBuf : public std::streambuf {
+  std::istream& in;
+  std::vector<char> block;
+
+public:
+  explicit InflateBuf(std::istream& in):
+    in(in)
+  {}
+
+protected:
+  int underflow() {
+    if (gptr() < egptr()) {
+      return traits_type::to_int_type(*gptr());
+    }
+
+    unsigned char head[4];
+    if (!in.read((char *)head, sizeof(head))) {
+      return traits_type::eof();
+    }
+
+    // A block never grows much when it's deflated, so anything larger
+    // is a broken file.
+    size_t zsiz = (head[0] << 24) | (head[1] << 16) | (head[2] << 8) | head[3];
+    if (zsiz == 0 || zsiz > SNAPSHOT_BLOCK * 2) {
+      return traits_type::eof();
+    }
+
+    std::vector<char> zbuf(zsiz);
+    if (!in.read(&zbuf[0], zsiz)) {
+      return traits_type::eof();
+    }
+
+    size_t size;
+    char* buf = ZLIB::decompress(&zbuf[0], zsiz, &size, ZLIB::RAW);
+    if (!buf) {
+      return traits_type::eof();
+    }
+    block.assign(buf, buf + size);
+    delete[] buf;
+
+    if (size == 0) {
+      return traits_type::eof();
+    }
+
+    setg(&block[0], &block[0], &block[0] + size);
+    return traits_type::to_int_type(*gptr());
+  }
+};
+
+
+// ## Errors ##
+
+// An Error for a Kyoto error code, with the code in its `code`
+// property.
+
+static Persistent<String> code_symbol;
+
+Local<Value> KyotoError(PolyDB::Error::Code code) {
+  HandleScope scope;
+
+  const char* name = PolyDB::Error::codename(code);
+  Local<Value> err = Exception::Error(String::NewSymbol(name));
+
+  if (code_symbol.IsEmpty()) {
+    code_symbol = NODE_PSYMBOL("code");
+  }
+
+  err->ToObject()->Set(code_symbol, Integer::New(code));
+  return scope.Close(err);
+}
+
+// Synchronous methods throw errors, but a missing record is returned
+// as `missing`.
+Handle<Value> SyncMissing(PolyDB::Error::Code code, Handle<Value> missing) {
+  if (code == PolyDB::Error::NOREC) return missing;
+  return ThrowException(KyotoError(code));
+}
+
+
+// ## Instrumentation ##
+
+// Every asynchronous request is timed when it's made, when a thread
+// starts and finishes running it, and when its callback returns. The
+// intervals go into histograms for each operation, along with counts
+// of operations, bytes and errors. Requests are recorded on the loop
+// as they finish, so nothing is locked; worker threads only write
+// their two timestamps into the request itself.
+
+// A log-linear histogram of durations in microseconds, after
+// HdrHistogram. Values under SUB_COUNT are exact; above that, each
+// power of two is split into SUB_COUNT buckets, so percentiles are
+// within 1/SUB_COUNT of the true value.
+
+class Histogram {
+public:
+  static const int SUB_BITS = 3;
+  static const int SUB_COUNT = 1 << SUB_BITS;
+  static const int MAX_BITS = 40;
+  static const int BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_COUNT;
+
+private:
+  uint32_t counts[BUCKETS];
+  double count;
+  double sum;
+  uint64_t min;
+  uint64_t max;
+
+public:
+  Histogram() {
+    reset();
+  }
+
+  void reset() {
+    memset(counts, 0, sizeof(counts));
+    count = sum = 0;
+    min = max = 0;
+  }
+
+  inline void record(double seconds) {
+    uint64_t usec = (seconds > 0) ? (uint64_t) (seconds * 1e6) : 0;
+    if (usec >= (1ULL << MAX_BITS)) {
+      usec = (1ULL << MAX_BITS) - 1;
+    }
+
+    counts[bucket(usec)]++;
+    if (count == 0 || usec < min) min = usec;
+    if (usec > max) max = usec;
+    count++;
+    sum += usec;
+  }
+
+  // The highest value that falls in the same bucket as the value at
+  // quantile `q`.
+  uint64_t percentile(double q) const {
+    double rank = q * count, seen = 0;
+
+    for (int i = 0; i < BUCKETS; i++) {
+      seen += counts[i];
+      if (counts[i] && seen >= rank) {
+	return std::min(highest(i), max);
+      }
+    }
+
+    return max;
+  }
+
+  // Times are reported in milliseconds.
+  Local<Object> toObject() const {
+    HandleScope scope;
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("count"), Number::New(count));
+    result->Set(String::NewSymbol("mean"), Number::New(count ? sum / count / 1000 : 0));
+    result->Set(String::NewSymbol("min"), Number::New(min / 1000.));
+    result->Set(String::NewSymbol("max"), Number::New(max / 1000.));
+    result->Set(String::NewSymbol("p50"), Number::New(percentile(0.5) / 1000.));
+    result->Set(String::NewSymbol("p90"), Number::New(percentile(0.9) / 1000.));
+    result->Set(String::NewSymbol("p99"), Number::New(percentile(0.99) / 1000.));
+    result->Set(String::NewSymbol("p999"), Number::New(percentile(0.999) / 1000.));
+
+    return scope.Close(result);
+  }
+
+private:
+  static inline int bucket(uint64_t usec) {
+    if (usec < (uint64_t) SUB_COUNT) {
+      return usec;
+    }
+
+    int bits = 63 - __builtin_clzll(usec);
+    int sub = (usec >> (bits - SUB_BITS)) - SUB_COUNT;
+    return (bits - SUB_BITS + 1) * SUB_COUNT + sub;
+  }
+
+  static inline uint64_t highest(int index) {
+    if (index < SUB_COUNT) {
+      return index;
+    }
+
+    int shift = index / SUB_COUNT - 1;
+    uint64_t low = (uint64_t) (SUB_COUNT + index % SUB_COUNT) << shift;
+    return low + (1ULL << shift) - 1;
+  }
+};
+
+// When a request was made, ran and called back, and how much data it
+// carried in each direction.
+struct Timing {
+  double called;
+  double started;
+  double finished;
+  size_t bytesIn;
+  size_t bytesOut;
+
+  Timing():
+    called(ev_time()),
+    started(0),
+    finished(0),
+    bytesIn(0),
+    bytesOut(0)
+  {}
+};
+
+// Statistics for one operation of one database. Operations are
+// numbered as they're first used, see `Instruments::Register()`.
+
+class OperationStats {
+public:
+  static const int CODES = PolyDB::Error::MISC + 1;
+
+  double count;
+  double bytesIn;
+  double bytesOut;
+  double errors[CODES];
+
+  Histogram queue;
+  Histogram exec;
+  Histogram callback;
+  Histogram total;
+
+  OperationStats() {
+    reset();
+  }
+
+  void reset() {
+    count = bytesIn = bytesOut = 0;
+    memset(errors, 0, sizeof(errors));
+    queue.reset();
+    exec.reset();
+    callback.reset();
+    total.reset();
+  }
+
+  inline void record(const Timing& timing, PolyDB::Error::Code code, double now) {
+    count++;
+    bytesIn += timing.bytesIn;
+    bytesOut += timing.bytesOut;
+    if (code != PolyDB::Error::SUCCESS) {
+      errors[(code < CODES) ? code : PolyDB::Error::MISC]++;
+    }
+
+    queue.record(timing.started - timing.called);
+    exec.record(timing.finished - timing.started);
+    callback.record(now - timing.finished);
+    total.record(now - timing.called);
+  }
+
+  Local<Object> toObject() const {
+    HandleScope scope;
+
+    Local<Object> codes = Object::New();
+    for (int i = 0; i < CODES; i++) {
+      if (errors[i] > 0) {
+	const char* name = PolyDB::Error::codename(static_cast<PolyDB::Error::Code>(i));
+	codes->Set(String::NewSymbol(name), Number::New(errors[i]));
+      }
+    }
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("count"), Number::New(count));
+    result->Set(String::NewSymbol("bytesIn"), Number::New(bytesIn));
+    result->Set(String::NewSymbol("bytesOut"), Number::New(bytesOut));
+    result->Set(String::NewSymbol("errors"), codes);
+    result->Set(String::NewSymbol("queue"), queue.toObject());
+    result->Set(String::NewSymbol("exec"), exec.toObject());
+    result->Set(String::NewSymbol("callback"), callback.toObject());
+    result->Set(String::NewSymbol("total"), total.toObject());
+
+    return scope.Close(result);
+  }
+};
+
+class Instruments {
+private:
+  std::vector<OperationStats*> operations;
+
+  static std::vector<std::string>& names() {
+    static std::vector<std::string> list;
+    return list;
+  }
+
+public:
+  ~Instruments() {
+    for (size_t i = 0; i < operations.size(); i++) {
+      if (operations[i]) delete operations[i];
+    }
+  }
+
+  // Number an operation, named like its Javascript method. This is
+  // done once for each method (see DEFINE_FUNC).
+  static int Register(const char* family, const char* method) {
+    std::string name(family);
+    size_t start = name.size();
+
+    name += method;
+    name[start] = tolower(name[start]);
+    names().push_back(name);
+    return names().size() - 1;
+  }
+
+  inline void record(int op, const Timing& timing, PolyDB::Error::Code code) {
+    if (op < 0) return;
+
+    if ((size_t) op >= operations.size()) {
+      operations.resize(op + 1, NULL);
+    }
+    if (!operations[op]) {
+      operations[op] = new OperationStats();
+    }
+
+    operations[op]->record(timing, code, ev_time());
+  }
+
+  // Statistics for each operation that's been used, by name.
+  Local<Object> toObject(bool reset) {
+    HandleScope scope;
+
+    Local<Object> result = Object::New();
+    for (size_t i = 0; i < operations.size(); i++) {
+      OperationStats* stats = operations[i];
+      if (stats && stats->count > 0) {
+	result->Set(String::New(names()[i].c_str()), stats->toObject());
+	if (reset) stats->reset();
+      }
+    }
+
+    return scope.Close(result);
+  }
+
+  // Times a synchronous method from construction to destruction.
+  class Probe {
+  public:
+    Timing timing;
+    PolyDB::Error::Code result;
+
+  private:
+    Instruments& instruments;
+    int op;
+
+  public:
+    Probe(Instruments& instruments, int op):
+      result(PolyDB::Error::SUCCESS),
+      instruments(instruments),
+      op(op)
+    {
+      timing.started = timing.called;
+    }
+
+    ~Probe() {
+      timing.finished = ev_time();
+      instruments.record(op, timing, result);
+    }
+  };
+};
+
+
+// ## Worker Pool ##
+
+// A database can run its requests on threads of its own instead of
+// libeio's, which it would otherwise share with Node's file system
+// calls. Jobs wait in priority lanes. Workers take point operations
+// first, but when both lanes have work every SCAN_SHARE'th job comes
+// from the scan lane so scans aren't starved.
+//
+// Only the loop submits jobs, so the lanes are guarded by a mutex
+// that workers also sleep on. Finished jobs come from every worker:
+// they're pushed onto a lock-free list and the loop is woken with an
+// ev_async to run their `after` callbacks.
+
+class WorkerPool {
+public:
+  enum Lane { POINT = 0, SCAN = 1, LANES = 2 };
+
+  static const unsigned SCAN_SHARE = 4;
+
+  struct Job {
+    eio_cb exec;
+    eio_cb after;
+    eio_req req;
+    int lane;
+    Job* next;
+  };
+
+  struct LaneStats {
+    double submitted;
+    double completed;
+    size_t depth;
+    size_t maxDepth;
+  };
+
+private:
+  std::vector<pthread_t> threads;
+  pthread_mutex_t mutex;
+  pthread_cond_t ready;
+  std::deque<Job*> lanes[LANES];
+  LaneStats stats[LANES];
+  unsigned picks;
+  bool stopping;
+
+  volatile int busy;
+  Job* volatile finished;
+  ev_async wakeup;
+
+public:
+  WorkerPool(size_t count):
+    picks(0),
+    stopping(false),
+    busy(0),
+    finished(NULL)
+  {
+    memset(stats, 0, sizeof(stats));
+    pthread_mutex_init(&mutex, NULL);
+    pthread_cond_init(&ready, NULL);
+
+    ev_async_init(&wakeup, OnWakeup);
+    wakeup.data = this;
+    ev_async_start(EV_DEFAULT_UC_ &wakeup);
+    ev_unref(EV_DEFAULT_UC);
+
+    for (size_t i = 0; i < count; i++) {
+      pthread_t thread;
+      if (pthread_create(&thread, NULL, Work, this) == 0) {
+	threads.push_back(thread);
+      }
+    }
+  }
+
+  // Only called once no requests are outstanding.
+  ~WorkerPool() {
+    pthread_mutex_lock(&mutex);
+    stopping = true;
+    pthread_cond_broadcast(&ready);
+    pthread_mutex_unlock(&mutex);
+
+    for (size_t i = 0; i < threads.size(); i++) {
+      pthread_join(threads[i], NULL);
+    }
+
+    ev_ref(EV_DEFAULT_UC);
+    ev_async_stop(EV_DEFAULT_UC_ &wakeup);
+    pthread_cond_destroy(&ready);
+    pthread_mutex_destroy(&mutex);
+  }
+
+  inline size_t size() const {
+    return threads.size();
+  }
+
+  void submit(int lane, eio_cb exec, eio_cb after, void* data) {
+    Job* job = new Job();
+    memset(&job->req, 0, sizeof(job->req));
+    job->exec = exec;
+    job->after = after;
+    job->req.data = data;
+    job->lane = lane;
+    job->next = NULL;
+
+    pthread_mutex_lock(&mutex);
+    LaneStats& lstats = stats[lane];
+    lanes[lane].push_back(job);
+    lstats.submitted++;
+    if (++lstats.depth > lstats.maxDepth) {
+      lstats.maxDepth = lstats.depth;
+    }
+    pthread_cond_signal(&ready);
+    pthread_mutex_unlock(&mutex);
+  }
+
+  Local<Object> statsObject(bool reset) {
+    HandleScope scope;
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("threads"), Integer::New(threads.size()));
+    result->Set(String::NewSymbol("busy"), Integer::New(busy));
+
+    pthread_mutex_lock(&mutex);
+    result->Set(String::NewSymbol("point"), laneObject(stats[POINT]));
+    result->Set(String::NewSymbol("scan"), laneObject(stats[SCAN]));
+    if (reset) {
+      for (int i = 0; i < LANES; i++) {
+	stats[i].submitted = stats[i].completed = 0;
+	stats[i].maxDepth = stats[i].depth;
+      }
+    }
+    pthread_mutex_unlock(&mutex);
+
+    return scope.Close(result);
+  }
+
+private:
+  static Local<Object> laneObject(const LaneStats& lstats) {
+    HandleScope scope;
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("depth"), Integer::New(lstats.depth));
+    result->Set(String::NewSymbol("maxDepth"), Integer::New(lstats.maxDepth));
+    result->Set(String::NewSymbol("submitted"), Number::New(lstats.submitted));
+    result->Set(String::NewSymbol("completed"), Number::New(lstats.completed));
+
+    return scope.Close(result);
+  }
+
+  static void* Work(void* data) {
+    static_cast<WorkerPool*>(data)->work();
+    return NULL;
+  }
+
+  void work() {
+    while (true) {
+      pthread_mutex_lock(&mutex);
+      Job* job;
+      while (!(job = take()) && !stopping) {
+	pthread_cond_wait(&ready, &mutex);
+      }
+      pthread_mutex_unlock(&mutex);
+
+      if (!job) return;
+
+      __sync_fetch_and_add(&busy, 1);
+      job->exec(&job->req);
+      __sync_fetch_and_sub(&busy, 1);
+
+      finish(job);
+    }
+  }
+
+  // Called with the mutex held.
+  Job* take() {
+    int lane = POINT;
+    if (!lanes[SCAN].empty()
+	&& (lanes[POINT].empty() || ++picks % SCAN_SHARE == 0)) {
+      lane = SCAN;
+    }
+
+    if (lanes[lane].empty()) {
+      return NULL;
+    }
+
+    Job* job = lanes[lane].front();
+    lanes[lane].pop_front();
+    stats[lane].depth--;
+    return job;
+  }
+
+  void finish(Job* job) {
+    Job* head;
+    do {
+      head = finished;
+      job->next = head;
+    } while (!__sync_bool_compare_and_swap(&finished, head, job));
+
+    ev_async_send(EV_DEFAULT_UC_ &wakeup);
+  }
+
+  static void OnWakeup(EV_P_ ev_async* watcher, int revents) {
+    WorkerPool* pool = static_cast<WorkerPool*>(watcher->data);
+    Job* list = __sync_lock_test_and_set(&pool->finished, (Job*) NULL);
+
+    // The list is newest first.
+    Job* ordered = NULL;
+    while (list) {
+      Job* next = list->next;
+      list->next = ordered;
+      ordered = list;
+      list = next;
+    }
+
+    while (ordered) {
+      Job* job = ordered;
+      ordered = job->next;
+      pool->stats[job->lane].completed++;
+      job->after(&job->req);
+      delete job;
+    }
+  }
+};
+
+// Run a request's `exec` on a worker thread and then its `after` on
+// the loop, using the database's own pool if it has one.
+void Schedule(WorkerPool* pool, int lane, eio_cb exec, eio_cb after, void* data) {
+  if (pool) {
+    pool->submit(lane, exec, after, data);
+  }
+  else {
+    eio_custom(exec, EIO_PRI_DEFAULT, after, data);
+  }
+  ev_ref(EV_DEFAULT_UC);
+}
+
+class PolyDBWrap: ObjectWrap {
+public:
+  class IndexedRequest;
+  class WriteBatch;
+  class CloseRequest;
+
+private:
+  PolyDB* db;
+  WorkerPool* pool;
+  Instruments instruments;
+
+  // Group commit state, see `queueWrite()`.
+  std::vector<IndexedRequest*> pending;
+  std::vector<CloseRequest*> closing;
+  ev_timer flushTimer;
+  bool flushing;
+  double window;
+  size_t maxOps;
+
+  struct WriteStats {
+    double batches;
+    double operations;
+    double largest;
+    double latency;
+    double maxLatency;
+    double commitTime;
+  } stats;
+
+public:
+
+  // ## Initialization ##
+
+  static Persistent<FunctionTemplate> ctor;
+
+  static void Init(Handle<Object> target) {
+    HandleScope scope;
+
+    Local<FunctionTemplate> tmpl = FunctionTemplate::New(New);
+
+    ctor = Persistent<FunctionTemplate>::New(tmpl);
+    ctor->InstanceTemplate()->SetInternalFieldCount(1);
+    ctor->SetClassName(String::NewSymbol("PolyDB"));
+
+    SET_CLASS_CONSTANT(ctor, PolyDB, OREADER);
+    SET_CLASS_CONSTANT(ctor, PolyDB, OWRITER);
+    SET_CLASS_CONSTANT(ctor, PolyDB, OCREATE);
+    SET_CLASS_CONSTANT(ctor, PolyDB, OTRUNCATE);
+    SET_CLASS_CONSTANT(ctor, PolyDB, OAUTOTRAN);
+    SET_CLASS_CONSTANT(ctor, PolyDB, OAUTOSYNC);
+    SET_CLASS_CONSTANT(ctor, PolyDB, ONOLOCK);
+    SET_CLASS_CONSTANT(ctor, PolyDB, OTRYLOCK);
+    SET_CLASS_CONSTANT(ctor, PolyDB, ONOREPAIR);
+
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, SUCCESS);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, NOIMPL);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, INVALID);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, NOREPOS);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, NOPERM);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, BROKEN);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, DUPREC);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, NOREC);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, LOGIC);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, SYSTEM);
+    SET_CLASS_CONSTANT(ctor, PolyDB::Error, MISC);
+
+    NODE_SET_PROTOTYPE_METHOD(ctor, "open", Open);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "close", Close);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "closeSync", CloseSync);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "set", Set);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "add", Add);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "replace", Replace);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "get", Get);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "getBulk", GetBulk);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "getList", GetList);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "setBulk", SetBulk);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "remove", Remove);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "removeBulk", RemoveBulk);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "update", Update);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "synchronize", Synchronize);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "dumpSnapshot", DumpSnapshot);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "loadSnapshot", LoadSnapshot);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "appendSorted", AppendSorted);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "scanRange", ScanRange);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "scanProject", ScanProject);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "aggregate", Aggregate);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "intersect", Intersect);
+
+    NODE_SET_PROTOTYPE_METHOD(ctor, "getSync", GetSync);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "setSync", SetSync);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "removeSync", RemoveSync);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "getBulkSync", GetBulkSync);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "getListSync", GetListSync);
+
+    // Here are some non-standard methods.
+    NODE_SET_PROTOTYPE_METHOD(ctor, "addIndexed", AddIndexed);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "replaceIndexed", ReplaceIndexed);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "removeIndexed", RemoveIndexed);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "replaceDiffed", ReplaceDiffed);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "removeDiffed", RemoveDiffed);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "addIndexedBulk", AddIndexedBulk);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "buildIndex", BuildIndex);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "checkIndex", CheckIndex);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "groupCommit", GroupCommit);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "writeStats", GetWriteStats);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "workerPool", SetWorkerPool);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "poolStats", GetPoolStats);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "stats", GetStats);
+
+    target->Set(String::NewSymbol("PolyDB"), ctor->GetFunction());
+  }
+
+  // ## Construction ##
+
+  PolyDBWrap():
+    pool(NULL),
+    flushing(false),
+    window(0),
+    maxOps(128)
+  {
+    db = new PolyDB();
+    memset(&stats, 0, sizeof(stats));
+    ev_timer_init(&flushTimer, OnFlushTimer, 0., 0.);
+    flushTimer.data = this;
+  }
+
+  ~PolyDBWrap() {
+    ev_timer_stop(EV_DEFAULT_UC_ &flushTimer);
+    if (pool) delete pool;
+    delete db;
+  }
+
+  static Handle<Value> New(const Arguments& args) {
+    HandleScope scope;
+    PolyDBWrap* wrap = new PolyDBWrap();
+    wrap->Wrap(args.This());
+    return args.This();
+  }
+
+  
+  // ## Helpers ##
+
+  DB::Cursor* cursor() {
+    return db->cursor();
+  }
+
+  WorkerPool* workers() {
+    return pool;
+  }
+
+  inline void record(int op, const Timing& timing, PolyDB::Error::Code code) {
+    instruments.record(op, timing, code);
+  }
+
+  inline Instruments& instrumentation() {
+    return instruments;
+  }
+
+  
+  // ## Async Glue ##
+
+  class Request {
+  protected:
+    PolyDBWrap* wrap;
+    Persistent<Function> next;
+    PolyDB::Error::Code result;
+
+  public:
+    int op;
+    Timing timing;
+
+    Request(const Arguments& args, int nextIndex):
+      result(PolyDB::Error::SUCCESS),
+      op(-1) {
+      HandleScope scope;
+
+      wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+      next = Persistent<Function>::New(Handle<Function>::Cast(args[nextIndex]));
+
+      wrap->Ref();
+    }
+
+    virtual ~Request() {
+      wrap->Unref();
+      next.Dispose();
+    }
+
+    virtual inline int exec() = 0;
+
+    virtual inline int after() = 0;
+
+    inline WorkerPool* pool() {
+      return wrap->pool;
+    }
+
+    static const char* family() {
+      return "";
+    }
+
+    inline void record() {
+      wrap->record(op, timing, result);
+    }
+
+    // Requests that read or write many records wait in the scan lane
+    // of a worker pool.
+    virtual int lane() {
+      return WorkerPool::POINT;
+    }
+
+    inline void callback(int argc, Handle<Value> argv[]) {
+      TryCatch try_catch;
+      next->Call(Context::GetCurrent()->Global(), argc, argv);
+      if (try_catch.HasCaught()) {
+	FatalException(try_catch);
+      }
+    }
+
+    Local<Value> error() {
+      if (result == PolyDB::Error::SUCCESS)
+	return LNULL;
+      return KyotoError(result);
+    }
+  };
+
+  
+  // ### Open ###
+
+  DEFINE_METHOD(Open, OpenRequest)
+  class OpenRequest: public Request {
+  private:
+    String::Utf8Value path;
+    uint32_t mode;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 3
+	      && args[0]->IsString()
+	      && args[1]->IsUint32()
+	      && args[2]->IsFunction());
+    }
+
+    OpenRequest(const Arguments& args):
+      Request(args, 2),
+      path(args[0]->ToString()),
+      mode(args[1]->Uint32Value())
+    {}
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if (!db->open(*path, mode)) result = db->error().code();
+      return 0;
+    }
+
+    inline int after() {
+      Local<Value> argv[1] = { error() };
+      callback(1, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### Close ###
+
+  // A close waits until every queued write has been committed (see
+  // `drained()`).
+
+  DEFINE_QUEUED_METHOD(Close, CloseRequest)
+  class CloseRequest: public Request {
+  public:
+
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 1 && args[0]->IsFunction());
+    }
+
+    CloseRequest(const Arguments& args):
+      Request(args, 0)
+    {}
+
+    inline bool enqueue() {
+      if (!wrap->flushing && wrap->pending.empty()) {
+	return false;
+      }
+
+      wrap->closing.push_back(this);
+      if (!wrap->flushing) {
+	wrap->flushWrites();
+      }
+      return true;
+    }
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if (!db->close()) result = db->error().code();
+      return 0;
+    }
+
+    inline int after() {
+      Local<Value> argv[1] = { error() };
+      callback(1, argv);
+      return 0;
+    }
+  };
+
+  static Handle<Value> CloseSync(const Arguments& args) {
+    HandleScope scope;
+
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    PolyDB* db = wrap->db;
+
+    if (wrap->flushing || !wrap->pending.empty()) {
+      return ThrowException(Exception::Error(
+        String::New("Can't close synchronously while writes are queued.")));
+    }
+
+    return Boolean::New(db->close());
+  }
+
+  
+  // ### Sync ###
+
+  // Point operations that run on the calling thread. For memory
+  // databases they take a few microseconds, much less than a round
+  // trip through the thread pool. Don't use them on file databases,
+  // where they can block on I/O.
+
+  static Handle<Value> GetSync(const Arguments& args) {
+    HandleScope scope;
+
+    if (!(args.Length() >= 2
+	  && Bytes::IsBytes(args[0])
+	  && args[1]->IsBoolean())) {
+      return THROW_BAD_ARGS;
+    }
+
+    static int op = Instruments::Register("", "GetSync");
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    Instruments::Probe probe(wrap->instruments, op);
+    PolyDB* db = wrap->db;
+    Bytes key(args[0]);
+    size_t vsiz;
+    char* vbuf = db->get(*key, key.length(), &vsiz);
+
+    probe.timing.bytesIn = key.length();
+    if (!vbuf) {
+      probe.result = db->error().code();
+      return scope.Close(SyncMissing(probe.result, Undefined()));
+    }
+
+    probe.timing.bytesOut = vsiz;
+    if (V8_TO_BOOL(args[1])) {
+      return scope.Close(AdoptBuffer(vbuf, vbuf, vsiz));
+    }
+
+    Local<String> val = String::New(vbuf, vsiz);
+    delete[] vbuf;
+    return scope.Close(val);
+  }
+
+  static Handle<Value> SetSync(const Arguments& args) {
+    HandleScope scope;
+
+    if (!(args.Length() >= 2
+	  && Bytes::IsBytes(args[0])
+	  && Bytes::IsBytes(args[1]))) {
+      return THROW_BAD_ARGS;
+    }
+
+    static int op = Instruments::Register("", "SetSync");
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    Instruments::Probe probe(wrap->instruments, op);
+    PolyDB* db = wrap->db;
+    Bytes key(args[0]);
+    Bytes value(args[1]);
+
+    probe.timing.bytesIn = key.length() + value.length();
+    if (!db->set(*key, key.length(), *value, value.length())) {
+      probe.result = db->error().code();
+      return ThrowException(KyotoError(probe.result));
+    }
+    return True();
+  }
+
+  // Returns false if there was no record.
+  static Handle<Value> RemoveSync(const Arguments& args) {
+    HandleScope scope;
+
+    if (!(args.Length() >= 1 && Bytes::IsBytes(args[0]))) {
+      return THROW_BAD_ARGS;
+    }
+
+    static int op = Instruments::Register("", "RemoveSync");
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    Instruments::Probe probe(wrap->instruments, op);
+    PolyDB* db = wrap->db;
+    Bytes key(args[0]);
+
+    probe.timing.bytesIn = key.length();
+    if (!db->remove(*key, key.length())) {
+      probe.result = db->error().code();
+      return scope.Close(SyncMissing(probe.result, False()));
+    }
+    return True();
+  }
+
+  static Handle<Value> GetBulkSync(const Arguments& args) {
+    HandleScope scope;
+
+    if (!(args.Length() >= 3
+	  && args[0]->IsArray()
+	  && args[1]->IsBoolean()
+	  && args[2]->IsBoolean())) {
+      return THROW_BAD_ARGS;
+    }
+
+    static int op = Instruments::Register("", "GetBulkSync");
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    Instruments::Probe probe(wrap->instruments, op);
+    PolyDB* db = wrap->db;
+    StringList keys;
+    StringMap items;
+
+    ArrayToList(args[0], keys);
+    probe.timing.bytesIn = ListBytes(keys);
+    if (db->get_bulk(keys, &items, V8_TO_BOOL(args[1])) == -1) {
+      probe.result = db->error().code();
+      return ThrowException(KyotoError(probe.result));
+    }
+
+    probe.timing.bytesOut = MapBytes(items);
+    return scope.Close(MapToObj(items, V8_TO_BOOL(args[2])));
+  }
+
+  static Handle<Value> GetListSync(const Arguments& args) {
+    HandleScope scope;
+
+    if (!(args.Length() >= 3
+	  && args[0]->IsArray()
+	  && args[1]->IsBoolean()
+	  && args[2]->IsBoolean())) {
+      return THROW_BAD_ARGS;
+    }
+
+    static int op = Instruments::Register("", "GetListSync");
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    Instruments::Probe probe(wrap->instruments, op);
+    StringList keys;
+    ValueList values;
+
+    ArrayToList(args[0], keys);
+    probe.timing.bytesIn = ListBytes(keys);
+    if (!values.read(wrap->db, keys, V8_TO_BOOL(args[1]))) {
+      probe.result = wrap->db->error().code();
+      return ThrowException(KyotoError(probe.result));
+    }
+
+    probe.timing.bytesOut = values.data.size();
+    return scope.Close(values.values(V8_TO_BOOL(args[2])));
+  }
+
+  
+  // ### Set ###
+
+  DEFINE_METHOD(Set, SetRequest)
+  class SetRequest: public Request {
+  protected:
+    Bytes key;
+    Bytes value;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 3
+	      && Bytes::IsBytes(args[0])
+	      && Bytes::IsBytes(args[1])
+	      && args[2]->IsFunction());
+    }
+
+    SetRequest(const Arguments& args):
+      Request(args, 2),
+      key(args[0]),
+      value(args[1])
+    {
+      timing.bytesIn = key.length() + value.length();
+    }
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if (!db->set(*key, key.length(), *value, value.length())) {
+	result = db->error().code();
+      }
+      return 0;
+    }
+
+    inline int after() {
+      Local<Value> argv[1] = { error() };
+      callback(1, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### Add ###
+
+  DEFINE_METHOD(Add, AddRequest)
+  class AddRequest: public SetRequest {
+  public:
+    AddRequest(const Arguments& args) :
+      SetRequest(args)
+    {}
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if (!db->add(*key, key.length(), *value, value.length())) {
+	result = db->error().code();
+      }
+      return 0;
+    }
+  };
+
+  
+  // ### Replace ###
+
+  DEFINE_METHOD(Replace, ReplaceRequest)
+  class ReplaceRequest: public SetRequest {
+  public:
+    ReplaceRequest(const Arguments& args) :
+      SetRequest(args)
+    {}
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if (!db->replace(*key, key.length(), *value, value.length())) {
+	result = db->error().code();
+      }
+      return 0;
+    }
+  };
+
+  
+  // ### Get ###
+
+  DEFINE_METHOD(Get, GetRequest)
+  class GetRequest: public Request {
+  protected:
+    Bytes key;
+    bool asBuffer;
+    char *vbuf;
+    size_t vsiz;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 3
+	      && Bytes::IsBytes(args[0])
+	      && args[1]->IsBoolean()
+	      && args[2]->IsFunction());
+    }
+
+    GetRequest(const Arguments& args):
+      Request(args, 2),
+      key(args[0]),
+      asBuffer(V8_TO_BOOL(args[1])),
+      vbuf(NULL)
+    {
+      timing.bytesIn = key.length();
+    }
+
+    ~GetRequest() {
+      if (vbuf) delete[] vbuf;
+    }
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      vbuf = db->get(*key, key.length(), &vsiz);
+      if (!vbuf) result = db->error().code();
+      else timing.bytesOut = vsiz;
+      return 0;
+    }
+
+    inline int after() {
+      int argc = 1;
+      Local<Value> argv[2];
+
+      argv[0] = error();
+      if (vbuf && asBuffer) {
+	// The Buffer takes over Kyoto's copy of the value.
+	argv[argc++] = AdoptBuffer(vbuf, vbuf, vsiz);
+	vbuf = NULL;
+      }
+      else if (vbuf) {
+	argv[argc++] = String::New(vbuf, vsiz);
+      }
+
+      callback(argc, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### GetBulk ###
+
+  DEFINE_METHOD(GetBulk, GetBulkRequest)
+  class GetBulkRequest: public Request {
+  protected:
+    StringList keys;
+    StringMap items;
+    bool atomic;
+    bool asBuffer;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 4
+	      && args[0]->IsArray()
+	      && args[1]->IsBoolean()
+	      && args[2]->IsBoolean()
+	      && args[3]->IsFunction());
+    }
+
+    GetBulkRequest(const Arguments& args):
+      Request(args, 3),
+      atomic(V8_TO_BOOL(args[1])),
+      asBuffer(V8_TO_BOOL(args[2]))
+    {
+      ArrayToList(args[0], keys);
+      timing.bytesIn = ListBytes(keys);
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if (db->get_bulk(keys, &items, atomic) == -1) {
+	result = db->error().code();
+      }
+      timing.bytesOut = MapBytes(items);
+      return 0;
+    }
+
+    inline int after() {
+      int argc = 2;
+      Local<Value> argv[2] = { error(), MapToObj(items, asBuffer) };
+      callback(argc, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### GetList ###
+
+  // Like GetBulk, but the callback receives an Array of values in the
+  // order of the keys, with `undefined` for keys that have no record.
+
+  DEFINE_METHOD(GetList, GetListRequest)
+  class GetListRequest: public Request {
+  protected:
+    StringList keys;
+    ValueList values;
+    bool atomic;
+    bool asBuffer;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return GetBulkRequest::validate(args);
+    }
+
+    GetListRequest(const Arguments& args):
+      Request(args, 3),
+      atomic(V8_TO_BOOL(args[1])),
+      asBuffer(V8_TO_BOOL(args[2]))
+    {
+      ArrayToList(args[0], keys);
+      timing.bytesIn = ListBytes(keys);
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    inline int exec() {
+      if (!values.read(wrap->db, keys, atomic)) {
+	result = wrap->db->error().code();
+      }
+      timing.bytesOut = values.data.size();
+      return 0;
+    }
+
+    inline int after() {
+      int argc = 2;
+      Local<Value> argv[2] = { error(), values.values(asBuffer) };
+      callback(argc, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### SetBulk ###
+
+  // Set every item of an object in one job. The callback receives the
+  // number of records written.
+
+  DEFINE_METHOD(SetBulk, SetBulkRequest)
+  class SetBulkRequest: public Request {
+  protected:
+    StringMap items;
+    bool atomic;
+    int64_t count;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 3
+	      && args[0]->IsObject()
+	      && args[1]->IsBoolean()
+	      && args[2]->IsFunction());
+    }
+
+    SetBulkRequest(const Arguments& args):
+      Request(args, 2),
+      atomic(V8_TO_BOOL(args[1])),
+      count(0)
+    {
+      ObjToMap(args[0], items);
+      timing.bytesIn = MapBytes(items);
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if ((count = db->set_bulk(items, atomic)) == -1) {
+	result = db->error().code();
+      }
+      return 0;
+    }
+
+    inline int after() {
+      Local<Value> argv[2] = { error(), Integer::New(count) };
+      callback(2, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### Remove ###
+
+  DEFINE_METHOD(Remove, RemoveRequest)
+  class RemoveRequest: public Request {
+  protected:
+    Bytes key;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 2
+	      && Bytes::IsBytes(args[0])
+	      && args[1]->IsFunction());
+    }
+
+    RemoveRequest(const Arguments& args):
+      Request(args, 1),
+      key(args[0])
+    {
+      timing.bytesIn = key.length();
+    }
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if (!db->remove(*key, key.length())) {
+	result = db->error().code();
+      }
+      return 0;
+    }
+
+    inline int after() {
+      Local<Value> argv[1] = { error() };
+      callback(1, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### RemoveBulk ###
+
+  // Remove a list of keys in one job. Missing keys are skipped; the
+  // callback receives the number of records removed.
+
+  DEFINE_METHOD(RemoveBulk, RemoveBulkRequest)
+  class RemoveBulkRequest: public Request {
+  protected:
+    StringList keys;
+    bool atomic;
+    int64_t count;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 3
+	      && args[0]->IsArray()
+	      && args[1]->IsBoolean()
+	      && args[2]->IsFunction());
+    }
+
+    RemoveBulkRequest(const Arguments& args):
+      Request(args, 2),
+      atomic(V8_TO_BOOL(args[1])),
+      count(0)
+    {
+      ArrayToList(args[0], keys);
+      timing.bytesIn = ListBytes(keys);
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if ((count = db->remove_bulk(keys, atomic)) == -1) {
+	result = db->error().code();
+      }
+      return 0;
+    }
+
+    inline int after() {
+      Local<Value> argv[2] = { error(), Integer::New(count) };
+      callback(2, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### Synchronize ###
+
+  DEFINE_METHOD(Synchronize, SynchronizeRequest)
+  class SynchronizeRequest: public Request {
+  protected:
+    bool hard;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 1
+	      && args[0]->IsBoolean());
+    }
+
+    SynchronizeRequest(const Arguments& args):
+      Request(args, 1),
+      hard(args[0]->ToBoolean() == v8::True())
+    {}
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      if (!db->synchronize(hard)) {
+	result = db->error().code();
+      }
+      return 0;
+    }
+
+    inline int after() {
+      Local<Value> argv[1] = { error() };
+      callback(1, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### Snapshots ###
+
+  // Write every record to a file, or add every record from one, in
+  // Kyoto's snapshot format (see "Snapshot Files"). Writers wait
+  // while a snapshot is dumped, so it's consistent. `compress`
+  // deflates a dumped file; loading detects it.
+  //
+  // If `progress` is a Function, it's called on the loop now and then
+  // with the number of records done so far and the total, or -1 when
+  // the total isn't known. Reports along the way may be merged or
+  // dropped; the final count is always reported, just before the
+  // callback.
+
+  class SnapshotRequest: public Request, public BasicDB::ProgressChecker {
+  private:
+    Persistent<Function> progress;
+    ev_async notify;
+    pthread_mutex_t mutex;
+    int64_t done;
+    int64_t total;
+    int64_t reported;
+    int64_t delivered;
+
+  protected:
+    std::string path;
+
+  public:
+    static const int64_t PROGRESS_STEP = 4096;
+
+    inline static bool validate(const Arguments& args, int progressIndex) {
+      return (args.Length() > progressIndex + 1
+	      && args[0]->IsString()
+	      && (args[progressIndex]->IsFunction() || args[progressIndex]->IsNull())
+	      && args[progressIndex + 1]->IsFunction());
+    }
+
+    SnapshotRequest(const Arguments& args, int progressIndex):
+      Request(args, progressIndex + 1),
+      done(0),
+      total(-1),
+      reported(0),
+      delivered(-1),
+      path(*String::Utf8Value(args[0]))
+    {
+      pthread_mutex_init(&mutex, NULL);
+      ev_async_init(&notify, OnProgress);
+      notify.data = this;
+
+      if (args[progressIndex]->IsFunction()) {
+	progress = Persistent<Function>::New(Handle<Function>::Cast(args[progressIndex]));
+	ev_async_start(EV_DEFAULT_UC_ &notify);
+	ev_unref(EV_DEFAULT_UC);
+      }
+    }
+
+    virtual ~SnapshotRequest() {
+      if (!progress.IsEmpty()) {
+	ev_ref(EV_DEFAULT_UC);
+	ev_async_stop(EV_DEFAULT_UC_ &notify);
+	progress.Dispose();
+      }
+      pthread_mutex_destroy(&mutex);
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    // Called by Kyoto on the worker thread, as often as every record.
+    // The final count is left for `after()`.
+    bool check(const char* name, const char* message, int64_t curcnt, int64_t allcnt) {
+      if (progress.IsEmpty()) {
+	return true;
+      }
+
+      bool step = (curcnt - reported >= PROGRESS_STEP && curcnt != allcnt);
+
+      pthread_mutex_lock(&mutex);
+      done = curcnt;
+      total = allcnt;
+      pthread_mutex_unlock(&mutex);
+
+      if (step) {
+	reported = curcnt;
+	ev_async_send(EV_DEFAULT_UC_ &notify);
+      }
+      return true;
+    }
+
+    inline int after() {
+      if (!progress.IsEmpty()) {
+	report();
+      }
+
+      Local<Value> argv[1] = { error() };
+      callback(1, argv);
+      return 0;
+    }
+
+  private:
+    static void OnProgress(EV_P_ ev_async* watcher, int revents) {
+      static_cast<SnapshotRequest *>(watcher->data)->report();
+    }
+
+    // Call `progress` with the latest count, unless it's been
+    // reported already.
+    void report() {
+      HandleScope scope;
+
+      pthread_mutex_lock(&mutex);
+      int64_t count = done;
+      Local<Value> argv[2] = { Number::New(done), Number::New(total) };
+      pthread_mutex_unlock(&mutex);
+
+      if (count == delivered) {
+	return;
+      }
+      delivered = count;
+
+      TryCatch try_catch;
+      progress->Call(Context::GetCurrent()->Global(), 2, argv);
+      if (try_catch.HasCaught()) {
+	FatalException(try_catch);
+      }
+    }
+  };
+
+  DEFINE_METHOD(DumpSnapshot, DumpSnapshotRequest)
+  class DumpSnapshotRequest: public SnapshotRequest {
+  protected:
+    bool compress;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (SnapshotRequest::validate(args, 2)
+	      && args[1]->IsBoolean());
+    }
+
+    DumpSnapshotRequest(const Arguments& args):
+      SnapshotRequest(args, 2),
+      compress(V8_TO_BOOL(args[1]))
+    {}
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      std::ofstream out(path.c_str(), std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+
+      if (!out) {
+	result = PolyDB::Error::NOREPOS;
+      }
+      else if (!compress) {
+	if (!db->dump_snapshot(&out, this)) result = db->error().code();
+      }
+      else {
+	out.write(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+	DeflateBuf deflate(out);
+	std::ostream zout(&deflate);
+	if (!db->dump_snapshot(&zout, this)) result = db->error().code();
+	else if (!zout.flush()) result = PolyDB::Error::SYSTEM;
+      }
+
+      if (result == PolyDB::Error::SUCCESS && !out.flush()) {
+	result = PolyDB::Error::SYSTEM;
+      }
+      return 0;
+    }
+  };
+
+  DEFINE_METHOD(LoadSnapshot, LoadSnapshotRequest)
+  class LoadSnapshotRequest: public SnapshotRequest {
+  public:
+    inline static bool validate(const Arguments& args) {
+      return SnapshotRequest::validate(args, 1);
+    }
+
+    LoadSnapshotRequest(const Arguments& args):
+      SnapshotRequest(args, 1)
+    {}
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      std::ifstream in(path.c_str(), std::ios_base::in | std::ios_base::binary);
+      char magic[SNAPSHOT_MAGIC_SIZE];
+
+      if (!in) {
+	result = PolyDB::Error::NOREPOS;
+      }
+      else if (in.read(magic, SNAPSHOT_MAGIC_SIZE)
+	       && memcmp(magic, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) == 0) {
+	InflateBuf inflate(in);
+	std::istream zin(&inflate);
+	if (!db->load_snapshot(&zin, this)) result = db->error().code();
+      }
+      else {
+	in.clear();
+	in.seekg(0);
+	if (!db->load_snapshot(&in, this)) result = db->error().code();
+      }
+
+      return 0;
+    }
+  };
+
+  
+  // ### Append Sorted ###
+
+  // Write records whose keys are in ascending order, each after the
+  // last key in the database, without a transaction. In a tree
+  // database every record lands on the last leaf, so loading sorted
+  // data skips the random inserts and page splits of `setBulk()`.
+  // Hash databases only check the order within the list.
+  //
+  // The callback receives the number of records written. A key out of
+  // order fails with a "load-unsorted" Error whose `position` is its
+  // index; the records before it are kept.
+
+  DEFINE_METHOD(AppendSorted, AppendSortedRequest)
+  class AppendSortedRequest: public Request {
+  private:
+    Persistent<String> position_symbol;
+
+  protected:
+    StringList keys;
+    StringList vals;
+    int64_t count;
+    bool unsorted;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 3
+	      && args[0]->IsArray()
+	      && args[1]->IsArray()
+	      && args[2]->IsFunction()
+	      && (Local<Array>::Cast(args[0])->Length()
+		  == Local<Array>::Cast(args[1])->Length()));
+    }
+
+    AppendSortedRequest(const Arguments& args):
+      Request(args, 2),
+      count(0),
+      unsorted(false)
+    {
+      ArrayToList(args[0], keys);
+      ArrayToList(args[1], vals);
+      timing.bytesIn = ListBytes(keys) + ListBytes(vals);
+    }
+
+    ~AppendSortedRequest() {
+      if (!position_symbol.IsEmpty()) position_symbol.Dispose();
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      DB::Cursor* cursor = db->cursor();
+      std::string last;
+      bool ordered = cursor->jump_back() && cursor->get_key(&last);
+      delete cursor;
+
+      for (size_t i = 0; i < keys.size(); i++) {
+	if (ordered && keys[i].compare(last) <= 0) {
+	  unsorted = true;
+	  break;
+	}
+	if (!db->set(keys[i], vals[i])) {
+	  result = db->error().code();
+	  break;
+	}
+	last = keys[i];
+	ordered = true;
+	count++;
+      }
+
+      return 0;
+    }
+
+    Local<Value> error() {
+      if (!unsorted) {
+	return Request::error();
+      }
+
+      Local<Value> err = Exception::Error(String::NewSymbol("load-unsorted"));
+      if (position_symbol.IsEmpty()) {
+	position_symbol = NODE_PSYMBOL("position");
+      }
+      err->ToObject()->Set(position_symbol, Integer::New(count));
+
+      return err;
+    }
+
+    inline int after() {
+      Local<Value> argv[2] = { error(), Integer::New(count) };
+      callback(2, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### Update ###
+
+  // Read, change and write back one record while Kyoto holds its
+  // lock, so concurrent updates can't overwrite each other. Each
+  // edit is an Array of `[kind, path, value, expect]`:
+  //
+  //   + INCREMENT - add the Number `value` to the number at `path`
+  //   + SET       - replace the value at `path` with JSON `value`
+  //   + APPEND    - add JSON `value` to the end of the array at `path`
+  //   + SWAP      - replace the whole record with `value` if it's
+  //                 exactly `expect`
+  //
+  // A path is an Array of member names, quoted as they appear in the
+  // document. Edits are applied in order and all or none are written.
+  // The callback receives the new value. An edit that can't be made
+  // fails with an "update-invalid" Error (or "update-conflict" for a
+  // swap), its index in the `position` property.
+
+  class UpdateVisitor : public DB::Visitor {
+  public:
+    const JsonEditList& edits;
+    std::string value;
+    JsonEdit::Status status;
+    int failed;
+    bool found;
+
+    explicit UpdateVisitor(const JsonEditList& edits) :
+      edits(edits),
+      status(JsonEdit::OK),
+      failed(-1),
+      found(false)
+    {}
+
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+			   const char* vbuf, size_t vsiz,
+			   size_t *sp)
+    {
+      found = true;
+      value.assign(vbuf, vsiz);
+
+      for (size_t i = 0; i < edits.size(); i++) {
+	if ((status = JsonApply(value, edits[i])) != JsonEdit::OK) {
+	  failed = i;
+	  return NOP;
+	}
+      }
+
+      *sp = value.size();
+      return value.data();
+    }
+  };
+
+  DEFINE_METHOD(Update, UpdateRequest)
+  class UpdateRequest: public Request {
+  private:
+    Persistent<String> position_symbol;
+
+  protected:
+    Bytes key;
+    JsonEditList edits;
+    bool asBuffer;
+    bool found;
+    std::string value;
+    JsonEdit::Status status;
+    int failed;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      if (!(args.Length() >= 4
+	    && Bytes::IsBytes(args[0])
+	    && args[1]->IsArray()
+	    && args[2]->IsBoolean()
+	    && args[3]->IsFunction())) {
+	return false;
+      }
+
+      Local<Array> list = Local<Array>::Cast(args[1]);
+      for (uint32_t i = 0; i < list->Length(); i++) {
+	Local<Value> item = list->Get(i);
+	if (!item->IsArray()) return false;
+
+	Local<Array> edit = Local<Array>::Cast(item);
+	Local<Value> kind = edit->Get(0);
+	if (!kind->IsUint32() || kind->Uint32Value() > JsonEdit::SWAP) return false;
+
+	switch (kind->Uint32Value()) {
+	case JsonEdit::INCREMENT:
+	  if (!edit->Get(2)->IsNumber()) return false;
+	  break;
+	case JsonEdit::SWAP:
+	  if (!Bytes::IsBytes(edit->Get(3))) return false;
+	  // fall through
+	default:
+	  if (!Bytes::IsBytes(edit->Get(2))) return false;
+	}
+
+	if (kind->Uint32Value() != JsonEdit::SWAP && !edit->Get(1)->IsArray()) return false;
+      }
+
+      return true;
+    }
+
+    UpdateRequest(const Arguments& args):
+      Request(args, 3),
+      key(args[0]),
+      asBuffer(V8_TO_BOOL(args[2])),
+      found(false),
+      status(JsonEdit::OK),
+      failed(-1)
+    {
+      HandleScope scope;
+
+      Local<Array> list = Local<Array>::Cast(args[1]);
+      edits.resize(list->Length());
+      timing.bytesIn = key.length();
+
+      for (uint32_t i = 0; i < list->Length(); i++) {
+	Local<Array> item = Local<Array>::Cast(list->Get(i));
+	JsonEdit& edit = edits[i];
+
+	edit.kind = item->Get(0)->Uint32Value();
+	edit.delta = 0;
+
+	if (edit.kind == JsonEdit::INCREMENT) {
+	  edit.delta = item->Get(2)->NumberValue();
+	}
+	else {
+	  Bytes value(item->Get(2));
+	  edit.value.assign(*value, value.length());
+	}
+
+	if (edit.kind == JsonEdit::SWAP) {
+	  Bytes expect(item->Get(3));
+	  edit.expect.assign(*expect, expect.length());
+	}
+	else {
+	  ArrayToList(item->Get(1), edit.path);
+	}
+
+	timing.bytesIn += edit.value.size() + edit.expect.size() + ListBytes(edit.path);
+      }
+    }
+
+    ~UpdateRequest() {
+      if (!position_symbol.IsEmpty()) position_symbol.Dispose();
+    }
+
+    inline int exec() {
+      PolyDB* db = wrap->db;
+      UpdateVisitor visitor(edits);
+
+      if (!db->accept(*key, key.length(), &visitor, true)) {
+	result = db->error().code();
+      }
+      else if (!visitor.found) {
+	result = PolyDB::Error::NOREC;
+      }
+      else if (visitor.failed >= 0) {
+	status = visitor.status;
+	failed = visitor.failed;
+      }
+      else {
+	value.swap(visitor.value);
+	timing.bytesOut = value.size();
+      }
+
+      return 0;
+    }
+
+    Local<Value> error() {
+      if (failed < 0) {
+	return Request::error();
+      }
+
+      const char* name = (status == JsonEdit::CONFLICT) ? "update-conflict" : "update-invalid";
+      Local<Value> err = Exception::Error(String::NewSymbol(name));
+
+      if (position_symbol.IsEmpty()) {
+	position_symbol = NODE_PSYMBOL("position");
+      }
+      err->ToObject()->Set(position_symbol, Integer::New(failed));
+
+      return err;
+    }
+
+    inline int after() {
+      int argc = 1;
+      Local<Value> argv[2];
+
+      argv[0] = error();
+      if (result == PolyDB::Error::SUCCESS && failed < 0) {
+	argv[argc++] = asBuffer
+	  ? NewBuffer(value.data(), value.size())
+	  : Local<Value>(String::New(value.data(), value.size()));
+      }
+
+      callback(argc, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### Scan Range ###
+
+  // Walk a tree database from `begin` and collect records until a
+  // key falls outside the range. The range ends before `end` (when
+  // it's a string) and covers only keys starting with `prefix` (when
+  // it's a string). At most `limit` records are collected; zero
+  // means no limit.
+  //
+  // The callback receives arrays of values and keys (values are
+  // `null` if `keysOnly` is set, Buffers if `asBuffer` is set) and a
+  // flag that's true when more records may follow in the range.
+  // Continue from the last key with a "\0" appended.
+
+  DEFINE_METHOD(ScanRange, ScanRangeRequest)
+  class ScanRangeRequest: public Request {
+  protected:
+    Bytes begin;
+    std::string end;
+    std::string prefix;
+    bool hasEnd;
+    bool hasPrefix;
+    uint32_t limit;
+    bool keysOnly;
+    bool asBuffer;
+    bool more;
+    RecordList records;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 7
+	      && Bytes::IsBytes(args[0])
+	      && (Bytes::IsBytes(args[1]) || args[1]->IsNull())
+	      && (Bytes::IsBytes(args[2]) || args[2]->IsNull())
+	      && args[3]->IsUint32()
+	      && args[4]->IsBoolean()
+	      && args[5]->IsBoolean()
+	      && args[6]->IsFunction());
+    }
+
+    // Subclasses without the `keysOnly` and `asBuffer` flags pass the
+    // position of their callback.
+    ScanRangeRequest(const Arguments& args, int cbIndex = 6):
+      Request(args, cbIndex),
+      begin(args[0]),
+      hasEnd(!args[1]->IsNull()),
+      hasPrefix(!args[2]->IsNull()),
+      limit(args[3]->Uint32Value()),
+      keysOnly(cbIndex == 6 && V8_TO_BOOL(args[4])),
+      asBuffer(cbIndex == 6 && V8_TO_BOOL(args[5])),
+      more(false)
+    {
+      if (hasEnd) {
+	Bytes bytes(args[1]);
+	end.assign(*bytes, bytes.length());
+      }
+      if (hasPrefix) {
+	Bytes bytes(args[2]);
+	prefix.assign(*bytes, bytes.length());
+      }
+    }
+
+    inline bool inRange(const char* kbuf, size_t ksiz) {
+      if (hasPrefix
+	  && (ksiz < prefix.size() || memcmp(kbuf, prefix.data(), prefix.size()) != 0))
+	return false;
+      if (hasEnd && CompareBuf(kbuf, ksiz, end.data(), end.size()) >= 0)
+	return false;
+      return true;
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    inline int exec() {
+      DB::Cursor* cursor = wrap->cursor();
+      Record rec;
+
+      if (!cursor->jump(*begin, begin.length())) {
+	result = CURSOR_ERROR(cursor);
+	delete cursor;
+	return 0;
+      }
+
+      while (limit == 0 || records.size() < limit) {
+	if (keysOnly) {
+	  rec.kbuf = cursor->get_key(&rec.ksiz, false);
+	  rec.vbuf = NULL;
+	  rec.vsiz = 0;
+	}
+	else {
+	  rec.kbuf = cursor->get(&rec.ksiz, &rec.vbuf, &rec.vsiz, false);
+	}
+
+	if (!rec.kbuf) {
+	  result = CURSOR_ERROR(cursor);
+	  break;
+	}
+	else if (!inRange(rec.kbuf, rec.ksiz)) {
+	  delete[] rec.kbuf;
+	  break;
+	}
+
+	records.push(rec);
+	if (!cursor->step()) {
+	  result = CURSOR_ERROR(cursor);
+	  break;
+	}
+      }
+
+      // Stopped at the limit; peek so the caller doesn't come back
+      // for an empty page.
+      if (result == PolyDB::Error::SUCCESS && limit > 0 && records.size() == limit) {
+	size_t ksiz;
+	char* kbuf = cursor->get_key(&ksiz, false);
+	if (kbuf) {
+	  more = inRange(kbuf, ksiz);
+	  delete[] kbuf;
+	}
+      }
+
+      timing.bytesOut = records.bytes;
+      delete cursor;
+      return 0;
+    }
+
+    inline int after() {
+      if (result != PolyDB::Error::SUCCESS && result != PolyDB::Error::NOREC) {
+	Local<Value> argv[1] = { error() };
+	callback(1, argv);
+	return 0;
+      }
+
+      Local<Array> keys = records.keys();
+      Local<Value> argv[4] = {
+	LNULL,
+	records.values(asBuffer),
+	keys,
+	Local<Value>::New(Boolean::New(more))
+      };
+      callback(4, argv);
+      return 0;
+    }
+  };
 
   
-  // ### Set ###
+  // ### Scan Project ###
+
+  // Like ScanRange, but each JSON value is cut down to the members
+  // named by an Array of quoted names before it's passed to
+  // Javascript (see `JsonProject()`). Values that aren't JSON objects
+  // are passed whole. The arguments are `begin`, `end`, `prefix`,
+  // `limit`, the names and the callback.
+
+  DEFINE_METHOD(ScanProject, ScanProjectRequest)
+  class ScanProjectRequest: public ScanRangeRequest {
+  protected:
+    StringList names;
+    StringList values;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 6
+	      && Bytes::IsBytes(args[0])
+	      && (Bytes::IsBytes(args[1]) || args[1]->IsNull())
+	      && (Bytes::IsBytes(args[2]) || args[2]->IsNull())
+	      && args[3]->IsUint32()
+	      && args[4]->IsArray()
+	      && args[5]->IsFunction());
+    }
+
+    ScanProjectRequest(const Arguments& args):
+      ScanRangeRequest(args, 5)
+    {
+      ArrayToList(args[4], names);
+    }
+
+    inline int exec() {
+      ScanRangeRequest::exec();
+
+      std::string doc, projected;
+      values.reserve(records.size());
+      timing.bytesOut = 0;
+
+      for (size_t i = 0; i < records.size(); i++) {
+	Record& rec = records.items[i];
+	doc.assign(rec.vbuf, rec.vsiz);
+	if (JsonProject(doc, names, projected)) {
+	  values.push_back(projected);
+	}
+	else {
+	  values.push_back(doc);
+	}
+	timing.bytesOut += rec.ksiz + values.back().size();
+      }
+
+      return 0;
+    }
+
+    inline int after() {
+      if (result != PolyDB::Error::SUCCESS && result != PolyDB::Error::NOREC) {
+	Local<Value> argv[1] = { error() };
+	callback(1, argv);
+	return 0;
+      }
+
+      Local<Value> argv[4] = {
+	LNULL,
+	ListToArray(values),
+	records.keys(),
+	Local<Value>::New(Boolean::New(more))
+      };
+      callback(4, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### Aggregate ###
+
+  // Fold a key range natively (see `RangeAggregate`). The arguments
+  // are `begin`, `end` and `prefix` as for ScanRange, the operation,
+  // its argument (the Array path to a number for SUM, MIN and MAX,
+  // the layout mode for GROUP, null for COUNT) and the callback.
+  //
+  // The callback receives an Object with `count` (records in the
+  // range), `values` (numbers folded), `value` (the result, or null
+  // without numbers), `groups` (an Object of counts by value) and
+  // `unreadable` (records that couldn't be folded).
+
+  DEFINE_METHOD(Aggregate, AggregateRequest)
+  class AggregateRequest: public Request {
+  protected:
+    Bytes begin;
+    RangeAggregate agg;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      if (args.Length() < 6
+	  || !Bytes::IsBytes(args[0])
+	  || !(Bytes::IsBytes(args[1]) || args[1]->IsNull())
+	  || !Bytes::IsBytes(args[2])
+	  || !args[3]->IsUint32()
+	  || !args[5]->IsFunction()) {
+	return false;
+      }
+
+      switch (args[3]->Uint32Value()) {
+      case RangeAggregate::COUNT: return true;
+      case RangeAggregate::GROUP: return args[4]->IsUint32();
+      case RangeAggregate::SUM:
+      case RangeAggregate::MIN:
+      case RangeAggregate::MAX: return args[4]->IsArray();
+      default: return false;
+      }
+    }
+
+    AggregateRequest(const Arguments& args):
+      Request(args, 5),
+      begin(args[0])
+    {
+      Bytes prefix(args[2]);
+      agg.prefix.assign(*prefix, prefix.length());
+      agg.op = args[3]->Uint32Value();
+
+      if (!args[1]->IsNull()) {
+	Bytes end(args[1]);
+	agg.end.assign(*end, end.length());
+	agg.hasEnd = true;
+      }
+
+      if (agg.op == RangeAggregate::GROUP) {
+	agg.mode = args[4]->Uint32Value();
+      }
+      else if (agg.op != RangeAggregate::COUNT) {
+	ArrayToList(args[4], agg.path);
+      }
+
+      timing.bytesIn = begin.length() + agg.prefix.size() + agg.end.size();
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    inline int exec() {
+      DB::Cursor* cursor = wrap->cursor();
+
+      if (cursor->jump(*begin, begin.length())) {
+	while (!agg.done && cursor->accept(&agg, false, true)) {}
+      }
+
+      if (!agg.done && CURSOR_ERROR(cursor) != PolyDB::Error::NOREC) {
+	result = CURSOR_ERROR(cursor);
+      }
+
+      delete cursor;
+      return 0;
+    }
+
+    inline int after() {
+      if (result != PolyDB::Error::SUCCESS) {
+	Local<Value> argv[1] = { error() };
+	callback(1, argv);
+	return 0;
+      }
+
+      Local<Object> groups = Object::New();
+      RangeAggregate::GroupMap::const_iterator item = agg.groups.begin();
+      for (; item != agg.groups.end(); ++item) {
+	groups->Set(String::New(item->first.data(), item->first.size()),
+		    Number::New(item->second));
+      }
+
+      Local<Object> report = Object::New();
+      report->Set(String::NewSymbol("count"), Number::New(agg.count));
+      report->Set(String::NewSymbol("values"), Number::New(agg.values));
+      report->Set(String::NewSymbol("value"), agg.values ? Local<Value>(Number::New(agg.value)) : LNULL);
+      report->Set(String::NewSymbol("groups"), groups);
+      report->Set(String::NewSymbol("unreadable"), Number::New(agg.unreadable));
+
+      Local<Value> argv[2] = { LNULL, report };
+      callback(2, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### Intersect ###
+
+  // Find the suffixes that follow every one of several key prefixes,
+  // in order. Plain index entries are keyed by `prefix + primary key`,
+  // so this intersects the postings of several index values without
+  // reading them all: each cursor jumps ahead to the largest suffix
+  // seen so far (a leapfrog join). The posting list with the fewest
+  // entries, estimated by counting up to ESTIMATE_LIMIT of them,
+  // drives the join.
+  //
+  // Matches start at `start`; at most `limit` are returned (zero means
+  // no limit). The callback receives the matching suffixes and a flag
+  // that's true when more may follow. Continue from the last suffix
+  // with a "\0" appended.
+
+  static const int64_t ESTIMATE_LIMIT = 256;
+
+  class Posting {
+  public:
+    std::string prefix;
+    std::string suffix;
+    DB::Cursor* cursor;
+    int64_t estimate;
+    PolyDB::Error::Code error;
+
+    Posting(PolyDBWrap* wrap, const std::string& prefix):
+      prefix(prefix),
+      cursor(wrap->cursor()),
+      estimate(0),
+      error(PolyDB::Error::SUCCESS)
+    {}
+
+    ~Posting() {
+      delete cursor;
+    }
+
+    // Move to the first entry at or after `prefix + from`. Returns
+    // false when there are no more entries.
+    bool seek(const std::string& from) {
+      if (!cursor->jump(prefix + from)) {
+	return failed();
+      }
+      return read();
+    }
+
+    bool step() {
+      if (!cursor->step()) {
+	return failed();
+      }
+      return read();
+    }
+
+    bool read() {
+      size_t ksiz;
+      char* kbuf = cursor->get_key(&ksiz, false);
+      if (!kbuf) {
+	return failed();
+      }
+
+      bool match = (ksiz >= prefix.size()
+		    && memcmp(kbuf, prefix.data(), prefix.size()) == 0);
+      if (match) {
+	suffix.assign(kbuf + prefix.size(), ksiz - prefix.size());
+      }
+
+      delete[] kbuf;
+      return match;
+    }
+
+    void count(const std::string& from) {
+      bool more = seek(from);
+      estimate = 0;
+      while (more && estimate < ESTIMATE_LIMIT) {
+	estimate++;
+	more = step();
+      }
+    }
+
+    // Running off the end of the database is just the end of the
+    // postings.
+    bool failed() {
+      PolyDB::Error::Code code = CURSOR_ERROR(cursor);
+      if (code != PolyDB::Error::NOREC) {
+	error = code;
+      }
+      return false;
+    }
+
+    static bool fewer(const Posting* a, const Posting* b) {
+      return a->estimate < b->estimate;
+    }
+  };
+
+  DEFINE_METHOD(Intersect, IntersectRequest)
+  class IntersectRequest: public Request {
+  protected:
+    StringList prefixes;
+    std::string start;
+    uint32_t limit;
+    StringList matches;
+    bool more;
+
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 4
+	      && args[0]->IsArray()
+	      && Local<Array>::Cast(args[0])->Length() > 0
+	      && Bytes::IsBytes(args[1])
+	      && args[2]->IsUint32()
+	      && args[3]->IsFunction());
+    }
+
+    IntersectRequest(const Arguments& args):
+      Request(args, 3),
+      limit(args[2]->Uint32Value()),
+      more(false)
+    {
+      ArrayToList(args[0], prefixes);
+      Bytes bytes(args[1]);
+      start.assign(*bytes, bytes.length());
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    inline int exec() {
+      std::vector<Posting*> postings;
+      for (size_t i = 0; i < prefixes.size(); i++) {
+	postings.push_back(new Posting(wrap, prefixes[i]));
+	postings[i]->count(start);
+      }
+      std::sort(postings.begin(), postings.end(), Posting::fewer);
+
+      if (postings[0]->estimate > 0) {
+	join(postings);
+      }
+
+      for (size_t i = 0; i < postings.size(); i++) {
+	if (postings[i]->error != PolyDB::Error::SUCCESS) {
+	  result = postings[i]->error;
+	}
+	delete postings[i];
+      }
+
+      return 0;
+    }
+
+    void join(std::vector<Posting*>& postings) {
+      size_t count = postings.size();
+      for (size_t i = 0; i < count; i++) {
+	if (!postings[i]->seek(start)) return;
+      }
+
+      std::string candidate = postings[0]->suffix;
+      size_t agree = 1;
+      size_t i = 0;
+
+      while (true) {
+	if (agree == count) {
+	  matches.push_back(candidate);
+	  if (limit > 0 && matches.size() >= limit) {
+	    more = true;
+	    return;
+	  }
+	  if (!postings[i]->step()) return;
+	  candidate = postings[i]->suffix;
+	  agree = 1;
+	}
+
+	i = (i + 1) % count;
+	Posting* posting = postings[i];
+	if (posting->suffix < candidate && !posting->seek(candidate)) {
+	  return;
+	}
+
+	if (posting->suffix == candidate) {
+	  agree++;
+	}
+	else {
+	  candidate = posting->suffix;
+	  agree = 1;
+	}
+      }
+    }
+
+    inline int after() {
+      if (result != PolyDB::Error::SUCCESS) {
+	Local<Value> argv[1] = { error() };
+	callback(1, argv);
+	return 0;
+      }
+
+      Local<Array> keys = Array::New(matches.size());
+      for (size_t i = 0; i < matches.size(); i++) {
+	keys->Set(i, String::New(matches[i].data(), matches[i].size()));
+      }
+
+      Local<Value> argv[3] = {
+	LNULL,
+	keys,
+	Local<Value>::New(Boolean::New(more))
+      };
+      callback(3, argv);
+      return 0;
+    }
+  };
+
+  
+  // ### AddIndexed ###
+
+  // When `check` is set, index entries are compared but nothing is
+  // written.
+
+  class ApplyIndexVisitor : public DB::Visitor {
+  public:
+    const StringMap& index;
+    StringMap& errors;
+    bool check;
+
+    explicit ApplyIndexVisitor(const StringMap& index, StringMap& errors, bool check = false) :
+      index(index),
+      errors(errors),
+      check(check)
+    {}
+
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+			   const char* vbuf, size_t vsiz,
+			   size_t *sp)
+    {
+      MapIterator probe = index.find(std::string(kbuf, ksiz));
+
+      // It's an error for an index entry to exist with any other
+      // value than the value it's supposed to be.
+      if (probe != index.end() && !EQ_STRING_BUF(probe->second, vbuf, vsiz)) {
+	errors.insert(MapItem(probe->first, std::string(vbuf, vsiz)));
+      }
+
+      return NOP;
+    }
+
+    const char* visit_empty(const char* kbuf, size_t ksiz,
+			    size_t *sp)
+    {
+      MapIterator probe = index.find(std::string(kbuf, ksiz));
+      if (check || probe == index.end()) {
+	return NOP;
+      }
+
+      *sp = probe->second.size();
+      return probe->second.data();
+    }
+  };
+
+  class RemoveIndexVisitor : public DB::Visitor {
+  public:
+    Bytes& key;
+    StringMap& errors;
+    bool check;
+
+    explicit RemoveIndexVisitor(Bytes &key, StringMap& errors, bool check = false) :
+      key(key),
+      errors(errors),
+      check(check)
+    {}
+
+  private:
+    const char* visit_full(const char* kbuf, size_t ksiz,
+			   const char* vbuf, size_t vsiz,
+			   size_t *sp)
+    {
+      // It's an error to remove an index entry when it doesn't
+      // point to this object.
+      if (!EQ_UTF8_BUF(key, vbuf, vsiz)) {
+	errors.insert(MapItem(std::string(kbuf, ksiz), std::string(vbuf, vsiz)));
+	return NOP;
+      }
+      return check ? NOP : REMOVE;
+    }
+  };
+
+  // Index entries to remove are either given or, when there's a
+  // `layout`, worked out from the stored record inside the write's
+  // transaction. Those are the entries it has that aren't in
+  // `toIndex`.
+
+  class IndexedRequest: public Request {
+  private:
+    Persistent<String> invalid_symbol;
+
+  protected:
+    Bytes key;
+
+    StringMap toIndex;
+    StringList toRemove;
+    StringMap errors;
+    IndexLayoutList layout;
+    bool unreadable;
+
+  public:
+    double queued;
+
+    IndexedRequest(const Arguments &args, int nextIndex) :
+      Request(args, nextIndex),
+      key(args[0]),
+      unreadable(false),
+      queued(0)
+    {
+      timing.bytesIn = key.length();
+    }
+
+    inline bool unindexed() {
+      return toIndex.empty() && toRemove.empty() && layout.empty();
+    }
+
+    // Writes without index changes don't need a transaction, so they
+    // aren't worth grouping.
+    inline bool enqueue() {
+      if (unindexed()) {
+	return false;
+      }
+      return wrap->queueWrite(this);
+    }
 
-  DEFINE_METHOD(Set, SetRequest)
-  class SetRequest: public Request {
-  protected:
-    String::Utf8Value key;
-    String::Utf8Value value;
+    // Find the stored record's index entries. Sets `result` and
+    // returns false if it's missing or can't be read.
+    bool diff_index() {
+      if (layout.empty()) {
+	return true;
+      }
 
-  public:
-    inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 3
-	      && args[0]->IsString()
-	      && args[1]->IsString()
-	      && args[2]->IsFunction());
+      PolyDB* db = wrap->db;
+      std::string skey(*key, key.length());
+      size_t vsiz;
+      char* vbuf = db->get(*key, key.length(), &vsiz);
+
+      if (!vbuf) {
+	result = db->error().code();
+	return false;
+      }
+
+      std::string doc(vbuf, vsiz);
+      delete[] vbuf;
+      timing.bytesOut += vsiz;
+
+      StringList entries;
+      if (!IndexEntries(layout, doc, skey, entries)) {
+	unreadable = true;
+	result = PolyDB::Error::MISC;
+	return false;
+      }
+
+      for (size_t i = 0; i < entries.size(); i++) {
+	if (toIndex.find(entries[i]) == toIndex.end()) {
+	  toRemove.push_back(entries[i]);
+	}
+      }
+
+      return true;
     }
 
-    SetRequest(const Arguments& args):
-      Request(args, 2),
-      key(args[0]->ToString()),
-      value(args[1]->ToString())
-    {}
+    inline void fail(PolyDB::Error::Code code) {
+      if (result == PolyDB::Error::SUCCESS && errors.empty()) {
+	result = code;
+      }
+    }
+
+    virtual bool main_operation() = 0;
+
+    inline bool apply_index() {
+      PolyDB* db = wrap->db;
+
+      std::vector<std::string> keys;
+      MapKeys(toIndex, keys);
+
+      ApplyIndexVisitor visitor(toIndex, errors);
+      int written = db->accept_bulk(keys, &visitor, true);
+
+      return (written != -1) && errors.empty();
+    }
+
+    bool cleanup() {
+      PolyDB* db = wrap->db;
+
+      RemoveIndexVisitor visitor(key, errors);
+      int written = db->accept_bulk(toRemove, &visitor, true);
+
+      return (written != -1) && errors.empty();
+    }
 
     inline int exec() {
+      // Fast path: nothing to index, just run the main op.
+      if (unindexed()) {
+	if (!main_operation()) {
+	  result = wrap->db->error().code();
+	}
+	return 0;
+      }
+
+      // Long path: run full transaction, update indicies.
+      return transaction();
+    }
+
+    inline int transaction() {
       PolyDB* db = wrap->db;
-      if (!db->set(*key, key.length(), *value, value.length())) {
+
+      if (!db->begin_transaction()) {
+	result = db->error().code();
+	return 0;
+      }
+
+      if (!diff_index()) {
+	db->end_transaction(false);
+	return 0;
+      }
+
+      if (!main_operation()) {
+	result = db->error().code();
+	db->end_transaction(false);
+	return 0;
+      }
+
+      if (!toIndex.empty()) {
+	if (!apply_index()) {
+	  result = db->error().code();
+	  db->end_transaction(false);
+	  return 0;
+	}
+      }
+
+      if (!toRemove.empty()) {
+	if (!cleanup()) {
+	  result = db->error().code();
+	  db->end_transaction(false);
+	  return 0;
+	}
+      }
+
+      if (!db->end_transaction(true)) {
 	result = db->error().code();
       }
+
       return 0;
     }
 
+    // Look for index conflicts without writing anything. Returns
+    // false if the database failed.
+    bool check() {
+      PolyDB* db = wrap->db;
+
+      if (!toIndex.empty()) {
+	StringList keys;
+	MapKeys(toIndex, keys);
+
+	ApplyIndexVisitor visitor(toIndex, errors, true);
+	if (!db->accept_bulk(keys, &visitor, false)) {
+	  return false;
+	}
+      }
+
+      if (!toRemove.empty()) {
+	RemoveIndexVisitor visitor(key, errors, true);
+	if (!db->accept_bulk(toRemove, &visitor, false)) {
+	  return false;
+	}
+      }
+
+      return true;
+    }
+
+    // Apply this write inside a group commit's transaction. It's
+    // checked first, so a write that fails leaves nothing behind
+    // and doesn't affect the rest of the batch. Returns false if the
+    // whole batch has to be rolled back.
+    bool apply_grouped() {
+      PolyDB* db = wrap->db;
+
+      if (!diff_index()) {
+	return (result == PolyDB::Error::NOREC || unreadable);
+      }
+
+      if (!check()) {
+	result = db->error().code();
+	return false;
+      }
+
+      if (!errors.empty()) {
+	return true;
+      }
+
+      if (!main_operation()) {
+	result = db->error().code();
+	return (result == PolyDB::Error::DUPREC || result == PolyDB::Error::NOREC);
+      }
+
+      if ((!toIndex.empty() && !apply_index())
+	  || (!toRemove.empty() && !cleanup())) {
+	result = db->error().code();
+	return false;
+      }
+
+      return true;
+    }
+
+    Local<Value> error() {
+      if (unreadable) {
+	return Exception::Error(String::NewSymbol("index-unreadable"));
+      }
+
+      Local<Value> err = Request::error();
+
+      if (!errors.empty()) {
+	if (err->IsNull()) {
+	  err = Exception::Error(String::NewSymbol("index-error"));
+	}
+
+	if (invalid_symbol.IsEmpty()) {
+	  invalid_symbol = NODE_PSYMBOL("invalid");
+	}
+
+	Local<Object> obj = err->ToObject();
+	obj->Set(invalid_symbol, MapToObj(errors));
+      }
+
+      return err;
+    }
+
     inline int after() {
       Local<Value> argv[1] = { error() };
       callback(1, argv);
@@ -385,155 +3961,282 @@ public:
     }
   };
 
-  
-  // ### Add ###
+  DEFINE_QUEUED_METHOD(AddIndexed, AddIndexedRequest)
+  class AddIndexedRequest: virtual public IndexedRequest {
+  protected:
+    Bytes value;
 
-  DEFINE_METHOD(Add, AddRequest)
-  class AddRequest: public SetRequest {
   public:
-    AddRequest(const Arguments& args) :
-      SetRequest(args)
-    {}
 
-    inline int exec() {
-      PolyDB* db = wrap->db;
-      if (!db->add(*key, key.length(), *value, value.length())) {
-	result = db->error().code();
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 4
+	      && Bytes::IsBytes(args[0])
+	      && Bytes::IsBytes(args[1])
+	      && (args[2]->IsObject() || args[2]->IsNull())
+	      && args[3]->IsFunction());
+    }
+
+    AddIndexedRequest(const Arguments& args):
+      IndexedRequest(args, 3),
+      value(args[1])
+    {
+      timing.bytesIn += value.length();
+      if (!args[2]->IsNull()) {
+	ObjToMap(args[2], toIndex);
       }
-      return 0;
+    }
+
+    bool main_operation() {
+      PolyDB* db = wrap->db;
+      return db->add(*key, key.length(), *value, value.length());
     }
   };
 
-  
-  // ### Replace ###
+  DEFINE_QUEUED_METHOD(ReplaceIndexed, ReplaceIndexedRequest)
+  class ReplaceIndexedRequest: public IndexedRequest {
+  protected:
+    Bytes value;
 
-  DEFINE_METHOD(Replace, ReplaceRequest)
-  class ReplaceRequest: public SetRequest {
   public:
-    ReplaceRequest(const Arguments& args) :
-      SetRequest(args)
-    {}
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 5
+	      && Bytes::IsBytes(args[0])
+	      && Bytes::IsBytes(args[1])
+	      && (args[2]->IsObject() || args[2]->IsNull())
+	      && (args[3]->IsArray() || args[3]->IsNull())
+	      && args[4]->IsFunction());
+    }
 
-    inline int exec() {
+    ReplaceIndexedRequest(const Arguments& args):
+      IndexedRequest(args, 4),
+      value(args[1])
+    {
+      timing.bytesIn += value.length();
+      if (!args[2]->IsNull()) {
+	ObjToMap(args[2], toIndex);
+      }
+      if (!args[3]->IsNull()) {
+	ArrayToList(args[3], toRemove);
+      }
+    }
+
+    bool main_operation() {
       PolyDB* db = wrap->db;
-      if (!db->replace(*key, key.length(), *value, value.length())) {
-	result = db->error().code();
+      return db->replace(*key, key.length(), *value, value.length());
+    }
+  };
+
+  DEFINE_QUEUED_METHOD(RemoveIndexed, RemoveIndexedRequest)
+  class RemoveIndexedRequest: public IndexedRequest {
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 3
+	      && Bytes::IsBytes(args[0])
+	      && (args[1]->IsArray() || args[1]->IsNull())
+	      && args[2]->IsFunction());
+    }
+
+    RemoveIndexedRequest(const Arguments& args):
+      IndexedRequest(args, 2)
+    {
+      if (!args[1]->IsNull()) {
+	ArrayToList(args[1], toRemove);
       }
-      return 0;
+    }
+
+    bool main_operation() {
+      PolyDB* db = wrap->db;
+      return db->remove(*key, key.length());
     }
   };
 
-  
-  // ### Get ###
+  // Like ReplaceIndexed and RemoveIndexed, but the stored record's
+  // index entries are found from a layout instead of being given.
+  // Records that can't be read by the layout fail with an
+  // "index-unreadable" Error and nothing is written.
 
-  DEFINE_METHOD(Get, GetRequest)
-  class GetRequest: public Request {
+  DEFINE_QUEUED_METHOD(ReplaceDiffed, ReplaceDiffedRequest)
+  class ReplaceDiffedRequest: public IndexedRequest {
   protected:
-    String::Utf8Value key;
-    char *vbuf;
-    size_t vsiz;
+    Bytes value;
 
   public:
     inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 2
-	      && args[0]->IsString()
-	      && args[1]->IsFunction());
+      return (args.Length() >= 5
+	      && Bytes::IsBytes(args[0])
+	      && Bytes::IsBytes(args[1])
+	      && (args[2]->IsObject() || args[2]->IsNull())
+	      && IsLayout(args[3])
+	      && args[4]->IsFunction());
     }
 
-    GetRequest(const Arguments& args):
-      Request(args, 1),
-      key(args[0]->ToString())
-    {}
-
-    ~GetRequest() {
-      if (vbuf) delete[] vbuf;
+    ReplaceDiffedRequest(const Arguments& args):
+      IndexedRequest(args, 4),
+      value(args[1])
+    {
+      timing.bytesIn += value.length();
+      if (!args[2]->IsNull()) {
+	ObjToMap(args[2], toIndex);
+      }
+      ArrayToLayout(args[3], layout);
     }
 
-    inline int exec() {
+    bool main_operation() {
       PolyDB* db = wrap->db;
-      vbuf = db->get(*key, key.length(), &vsiz);
-      if (!vbuf) result = db->error().code();
-      return 0;
+      return db->replace(*key, key.length(), *value, value.length());
     }
+  };
 
-    inline int after() {
-      int argc = 1;
-      Local<Value> argv[2];
+  DEFINE_QUEUED_METHOD(RemoveDiffed, RemoveDiffedRequest)
+  class RemoveDiffedRequest: public IndexedRequest {
+  public:
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 3
+	      && Bytes::IsBytes(args[0])
+	      && IsLayout(args[1])
+	      && args[2]->IsFunction());
+    }
 
-      argv[0] = error();
-      if (vbuf) argv[argc++] = String::New(vbuf, vsiz);
+    RemoveDiffedRequest(const Arguments& args):
+      IndexedRequest(args, 2)
+    {
+      ArrayToLayout(args[1], layout);
+    }
 
-      callback(argc, argv);
-      return 0;
+    bool main_operation() {
+      PolyDB* db = wrap->db;
+      return db->remove(*key, key.length());
     }
   };
 
   
-  // ### GetBulk ###
+  // ### AddIndexedBulk ###
+
+  // Add many records and their index entries in a single transaction.
+  // The arguments are parallel arrays of keys, values and index
+  // objects (or nulls). If any record can't be added, nothing is
+  // written and the error's `position` is the offset of the record
+  // that failed.
+
+  DEFINE_METHOD(AddIndexedBulk, AddIndexedBulkRequest)
+  class AddIndexedBulkRequest: public Request {
+  private:
+    Persistent<String> invalid_symbol;
+    Persistent<String> position_symbol;
 
-  DEFINE_METHOD(GetBulk, GetBulkRequest)
-  class GetBulkRequest: public Request {
   protected:
     StringList keys;
-    StringMap items;
-    bool atomic;
+    StringList values;
+    std::vector<StringMap> indexes;
+    StringMap errors;
+    int failed;
 
   public:
     inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 3
-	      && args[0]->IsArray()
-	      && args[1]->IsBoolean()
-	      && args[2]->IsFunction());
+      if (!(args.Length() >= 4
+	    && args[0]->IsArray()
+	    && args[1]->IsArray()
+	    && args[2]->IsArray()
+	    && args[3]->IsFunction())) {
+	return false;
+      }
+
+      uint32_t len = Local<Array>::Cast(args[0])->Length();
+      return (Local<Array>::Cast(args[1])->Length() == len
+	      && Local<Array>::Cast(args[2])->Length() == len);
     }
 
-    GetBulkRequest(const Arguments& args):
-      Request(args, 2),
-      atomic(V8_TO_BOOL(args[1]))
+    AddIndexedBulkRequest(const Arguments& args):
+      Request(args, 3),
+      failed(-1)
     {
       ArrayToList(args[0], keys);
+      ArrayToList(args[1], values);
+      timing.bytesIn = ListBytes(keys) + ListBytes(values);
+
+      Local<Array> list = Local<Array>::Cast(args[2]);
+      int len = list->Length();
+      indexes.resize(len);
+      for (int i = 0; i < len; i++) {
+	Local<Value> item = list->Get(Integer::New(i));
+	if (item->IsObject()) {
+	  ObjToMap(item, indexes[i]);
+	}
+      }
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
     }
 
     inline int exec() {
       PolyDB* db = wrap->db;
-      if (db->get_bulk(keys, &items, atomic) == -1) {
+      int len = keys.size();
+
+      if (!db->begin_transaction()) {
+	result = db->error().code();
+	return 0;
+      }
+
+      for (int i = 0; i < len; i++) {
+	if (!add(db, i)) {
+	  failed = i;
+	  if (errors.empty()) result = db->error().code();
+	  db->end_transaction(false);
+	  return 0;
+	}
+      }
+
+      if (!db->end_transaction(true)) {
 	result = db->error().code();
       }
-      return 0;
-    }
 
-    inline int after() {
-      int argc = 2;
-      Local<Value> argv[2] = { error(), MapToObj(items) };
-      callback(argc, argv);
       return 0;
     }
-  };
 
-  
-  // ### Remove ###
+    inline bool add(PolyDB* db, int i) {
+      if (!db->add(keys[i], values[i])) {
+	return false;
+      }
 
-  DEFINE_METHOD(Remove, RemoveRequest)
-  class RemoveRequest: public Request {
-  protected:
-    String::Utf8Value key;
+      const StringMap& toIndex = indexes[i];
+      if (toIndex.empty()) {
+	return true;
+      }
 
-  public:
-    inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 1
-	      && args[0]->IsString());
+      StringList names;
+      MapKeys(toIndex, names);
+
+      ApplyIndexVisitor visitor(toIndex, errors);
+      return (db->accept_bulk(names, &visitor, true) && errors.empty());
     }
 
-    RemoveRequest(const Arguments& args):
-      Request(args, 1),
-      key(args[0]->ToString())
-    {}
+    Local<Value> error() {
+      Local<Value> err = Request::error();
 
-    inline int exec() {
-      PolyDB* db = wrap->db;
-      if (!db->remove(*key, key.length())) {
-	result = db->error().code();
+      if (!errors.empty()) {
+	if (err->IsNull()) {
+	  err = Exception::Error(String::NewSymbol("index-error"));
+	}
+
+	if (invalid_symbol.IsEmpty()) {
+	  invalid_symbol = NODE_PSYMBOL("invalid");
+	}
+
+	Local<Object> obj = err->ToObject();
+	obj->Set(invalid_symbol, MapToObj(errors));
       }
-      return 0;
+
+      if (failed >= 0) {
+	if (position_symbol.IsEmpty()) {
+	  position_symbol = NODE_PSYMBOL("position");
+	}
+
+	Local<Object> obj = err->ToObject();
+	obj->Set(position_symbol, Integer::New(failed));
+      }
+
+      return err;
     }
 
     inline int after() {
@@ -544,323 +4247,566 @@ public:
   };
 
   
-  // ### Synchronize ###
-
-  DEFINE_METHOD(Synchronize, SynchronizeRequest)
-  class SynchronizeRequest: public Request {
+  // ### Index Maintenance ###
+
+  // Bring a batch of records and one index into agreement, for an
+  // index added after records were stored or entries left behind by
+  // a crash. Both walk the keys starting with `prefix` from `begin`
+  // and read at most `limit` records (zero means no limit).
+  //
+  //   + buildIndex - reads documents and finds the entries `layout`
+  //                  gives them that are missing. An entry held by
+  //                  another record (a unique value that's taken)
+  //                  is a conflict and is left alone.
+  //   + checkIndex - reads index entries and finds the ones whose
+  //                  record is gone or no longer has them.
+  //
+  // With `repair`, the entries found are added or removed in one
+  // transaction. Each is checked against its record again first, so
+  // a record saved while the batch was read isn't given a stale
+  // entry. The callback receives an Object with `scanned` (records
+  // read), `next` (the key to continue from, or null at the end),
+  // `changed` (the entry keys found), `conflicts` (pairs of an entry
+  // key and the record holding it) and `unreadable` (records the
+  // layout can't read, such as Avro documents; `checkIndex` lists
+  // their entries).
+
+  class IndexMaintenanceRequest: public Request {
   protected:
-    bool hard;
+    std::string prefix;
+    std::string begin;
+    IndexLayoutList layout;
+    uint32_t limit;
+    bool repair;
+    int64_t scanned;
+    bool more;
+    std::string resume;
+    StringList changed;
+    StringList owners;
+    StringList conflicts;
+    StringList unreadable;
 
   public:
     inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 1
-	      && args[0]->IsBoolean());
+      return (args.Length() >= 6
+	      && Bytes::IsBytes(args[0])
+	      && Bytes::IsBytes(args[1])
+	      && IsLayout(args[2])
+	      && args[3]->IsUint32()
+	      && args[4]->IsBoolean()
+	      && args[5]->IsFunction());
     }
 
-    SynchronizeRequest(const Arguments& args):
-      Request(args, 1),
-      hard(args[0]->ToBoolean() == v8::True())
-    {}
+    IndexMaintenanceRequest(const Arguments& args):
+      Request(args, 5),
+      limit(args[3]->Uint32Value()),
+      repair(V8_TO_BOOL(args[4])),
+      scanned(0),
+      more(false)
+    {
+      Bytes prefixBytes(args[0]), beginBytes(args[1]);
+      prefix.assign(*prefixBytes, prefixBytes.length());
+      begin.assign(*beginBytes, beginBytes.length());
+      ArrayToLayout(args[2], layout);
+      timing.bytesIn = prefix.size() + begin.size();
+    }
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    // Look at one record in the range.
+    virtual void visit(PolyDB* db, const std::string& key, const std::string& value) = 0;
+
+    // Write the changes found. Returns false on a database error.
+    virtual bool apply(PolyDB* db) = 0;
 
     inline int exec() {
       PolyDB* db = wrap->db;
-      if (!db->synchronize(hard)) {
-	result = db->error().code();
+      DB::Cursor* cursor = db->cursor();
+      std::string key, value;
+      bool ok = cursor->jump(begin);
+
+      while (ok && (ok = cursor->get(&key, &value, true))) {
+	if (key.compare(0, prefix.size(), prefix) != 0) {
+	  break;
+	}
+	else if (limit > 0 && scanned == limit) {
+	  more = true;
+	  resume = key;
+	  break;
+	}
+
+	scanned++;
+	timing.bytesOut += key.size() + value.size();
+	visit(db, key, value);
+      }
+
+      if (!ok && CURSOR_ERROR(cursor) != PolyDB::Error::NOREC) {
+	result = CURSOR_ERROR(cursor);
+      }
+      delete cursor;
+
+      if (result == PolyDB::Error::SUCCESS && repair && !changed.empty()) {
+	if (!db->begin_transaction()) {
+	  result = db->error().code();
+	}
+	else if (!apply(db)) {
+	  result = db->error().code();
+	  db->end_transaction(false);
+	}
+	else if (!db->end_transaction(true)) {
+	  result = db->error().code();
+	}
       }
+
       return 0;
     }
 
+    // Whether the record at `owner` should have `entry`: 1 if it
+    // does, 0 if it doesn't or is gone, -1 if it can't be read.
+    int holds(PolyDB* db, const std::string& owner, const std::string& entry) {
+      std::string doc;
+      StringList entries;
+
+      if (!db->get(owner, &doc)) {
+	return 0;
+      }
+      else if (!IndexEntries(layout, doc, owner, entries)) {
+	return -1;
+      }
+
+      return (std::find(entries.begin(), entries.end(), entry) != entries.end()) ? 1 : 0;
+    }
+
     inline int after() {
-      Local<Value> argv[1] = { error() };
-      callback(1, argv);
+      if (result != PolyDB::Error::SUCCESS) {
+	Local<Value> argv[1] = { error() };
+	callback(1, argv);
+	return 0;
+      }
+
+      Local<Object> report = Object::New();
+      Local<Array> pairs = Array::New(conflicts.size() / 2);
+      for (size_t i = 0; i + 1 < conflicts.size(); i += 2) {
+	Local<Array> pair = Array::New(2);
+	pair->Set(0, String::New(conflicts[i].data(), conflicts[i].size()));
+	pair->Set(1, String::New(conflicts[i + 1].data(), conflicts[i + 1].size()));
+	pairs->Set(i / 2, pair);
+      }
+
+      report->Set(String::NewSymbol("scanned"), Number::New(scanned));
+      report->Set(String::NewSymbol("next"), more ? Local<Value>(String::New(resume.data(), resume.size())) : LNULL);
+      report->Set(String::NewSymbol("changed"), ListToArray(changed));
+      report->Set(String::NewSymbol("conflicts"), pairs);
+      report->Set(String::NewSymbol("unreadable"), ListToArray(unreadable));
+
+      Local<Value> argv[2] = { LNULL, report };
+      callback(2, argv);
       return 0;
     }
   };
 
-  
-  // ### AddIndexed ###
-
-  class ApplyIndexVisitor : public DB::Visitor {
+  DEFINE_METHOD(BuildIndex, BuildIndexRequest)
+  class BuildIndexRequest: public IndexMaintenanceRequest {
   public:
-    String::Utf8Value& key;
-    const StringMap& index;
-    StringMap& errors;
-
-    explicit ApplyIndexVisitor(String::Utf8Value &key, const StringMap& index, StringMap& errors) :
-      key(key),
-      index(index),
-      errors(errors)
+    BuildIndexRequest(const Arguments& args):
+      IndexMaintenanceRequest(args)
     {}
 
-  private:
-    const char* visit_full(const char* kbuf, size_t ksiz,
-			   const char* vbuf, size_t vsiz,
-			   size_t *sp)
-    {
-      MapIterator probe = index.find(std::string(kbuf, ksiz));
+    void visit(PolyDB* db, const std::string& key, const std::string& value) {
+      StringList entries;
+      std::string holder;
 
-      // It's an error for an index entry to exist with any other
-      // value than the value it's supposed to be.
-      if (probe != index.end() && !EQ_STRING_BUF(probe->second, vbuf, vsiz)) {
-	errors.insert(MapItem(probe->first, std::string(vbuf, vsiz)));
+      if (!IndexEntries(layout, value, key, entries)) {
+	unreadable.push_back(key);
+	return;
       }
 
-      return NOP;
+      for (size_t i = 0; i < entries.size(); i++) {
+	if (!db->get(entries[i], &holder)) {
+	  changed.push_back(entries[i]);
+	  owners.push_back(key);
+	}
+	else if (holder != key) {
+	  conflicts.push_back(entries[i]);
+	  conflicts.push_back(holder);
+	}
+      }
     }
 
-    const char* visit_empty(const char* kbuf, size_t ksiz,
-			    size_t *sp)
-    {
-      MapIterator probe = index.find(std::string(kbuf, ksiz));
-      if (probe == index.end()) {
-	return NOP;
+    // Entries are added, not set, so a value taken earlier in the
+    // batch or since it was read becomes a conflict.
+    bool apply(PolyDB* db) {
+      StringList added;
+      std::string holder;
+
+      for (size_t i = 0; i < changed.size(); i++) {
+	if (holds(db, owners[i], changed[i]) != 1) {
+	  continue;
+	}
+	else if (db->add(changed[i], owners[i])) {
+	  added.push_back(changed[i]);
+	}
+	else if (db->error().code() != PolyDB::Error::DUPREC) {
+	  return false;
+	}
+	else if (db->get(changed[i], &holder) && holder != owners[i]) {
+	  conflicts.push_back(changed[i]);
+	  conflicts.push_back(holder);
+	}
       }
 
-      *sp = probe->second.size();
-      return probe->second.data();
+      changed.swap(added);
+      return true;
     }
   };
 
-  class RemoveIndexVisitor : public DB::Visitor {
+  DEFINE_METHOD(CheckIndex, CheckIndexRequest)
+  class CheckIndexRequest: public IndexMaintenanceRequest {
   public:
-    String::Utf8Value& key;
-    StringMap& errors;
-
-    explicit RemoveIndexVisitor(String::Utf8Value &key, StringMap& errors) :
-      key(key),
-      errors(errors)
+    CheckIndexRequest(const Arguments& args):
+      IndexMaintenanceRequest(args)
     {}
 
-  private:
-    const char* visit_full(const char* kbuf, size_t ksiz,
-			   const char* vbuf, size_t vsiz,
-			   size_t *sp)
-    {
-      // It's an error to remove an index entry when it doesn't
-      // point to this object.
-      if (!EQ_UTF8_BUF(key, vbuf, vsiz)) {
-	errors.insert(MapItem(std::string(kbuf, ksiz), std::string(vbuf, vsiz)));
-	return NOP;
+    // Each entry's value is the key of the record it belongs to.
+    void visit(PolyDB* db, const std::string& key, const std::string& value) {
+      switch (holds(db, value, key)) {
+      case 0:
+	changed.push_back(key);
+	owners.push_back(value);
+	break;
+      case -1:
+	unreadable.push_back(key);
+	break;
       }
-      return REMOVE;
     }
-  };
-
-  class IndexedRequest: public Request {
-  private:
-    Persistent<String> invalid_symbol;
 
-  protected:
-    String::Utf8Value key;
+    // An entry is only removed if it still belongs to the same record.
+    bool apply(PolyDB* db) {
+      StringList removed;
 
-    StringMap toIndex;
-    StringList toRemove;
-    StringMap errors;
+      for (size_t i = 0; i < changed.size(); i++) {
+	const std::string& entry = changed[i];
+	const std::string& owner = owners[i];
 
-  public:
+	if (holds(db, owner, entry) != 0) {
+	  continue;
+	}
+	else if (db->cas(entry.data(), entry.size(), owner.data(), owner.size(), NULL, 0)) {
+	  removed.push_back(entry);
+	}
+	else if (db->error().code() != PolyDB::Error::LOGIC) {
+	  return false;
+	}
+      }
 
-    IndexedRequest(const Arguments &args, int nextIndex) :
-      Request(args, nextIndex),
-      key(args[0]->ToString())
-    {}
+      changed.swap(removed);
+      return true;
+    }
+  };
 
-    virtual bool main_operation() = 0;
+  
+  // ### Group Commit ###
+
+  // Every indexed write runs in a transaction, and committing one
+  // syncs the database. To share that cost, indexed writes are
+  // queued and applied in batches, one transaction per batch. A batch
+  // starts when `maxOps` writes are waiting or `window` seconds after
+  // the first one was queued; with no window, it starts right away.
+  // Only one batch runs at a time, so writes queued meanwhile go into
+  // the next one. Each write still gets its own result.
+  //
+  // Setting `maxOps` to zero turns grouping off. A close waits for
+  // the queue to drain: once one is requested, batches are written
+  // back to back without waiting for the window.
+
+  bool queueWrite(IndexedRequest* req) {
+    if (maxOps == 0) {
+      return false;
+    }
 
-    inline bool apply_index() {
-      PolyDB* db = wrap->db;
+    req->queued = ev_now(EV_DEFAULT_UC);
+    pending.push_back(req);
+    if (!flushing) {
+      scheduleFlush();
+    }
+    return true;
+  }
 
-      std::vector<std::string> keys;
-      MapKeys(toIndex, keys);
+  void scheduleFlush() {
+    if (pending.empty()) {
+      return;
+    }
 
-      ApplyIndexVisitor visitor(key, toIndex, errors);
-      int written = db->accept_bulk(keys, &visitor, true);
+    if (window <= 0 || pending.size() >= maxOps) {
+      flushWrites();
+    }
+    else if (!ev_is_active(&flushTimer)) {
+      ev_timer_set(&flushTimer, window, 0.);
+      ev_timer_start(EV_DEFAULT_UC_ &flushTimer);
+    }
+  }
 
-      return (written != -1) && errors.empty();
+  void flushWrites() {
+    ev_timer_stop(EV_DEFAULT_UC_ &flushTimer);
+    if (pending.empty()) {
+      return;
     }
 
-    bool cleanup() {
-      PolyDB* db = wrap->db;
+    size_t count = (maxOps > 0 && pending.size() > maxOps) ? maxOps : pending.size();
+    WriteBatch* batch = new WriteBatch(this);
+    batch->ops.assign(pending.begin(), pending.begin() + count);
+    pending.erase(pending.begin(), pending.begin() + count);
 
-      RemoveIndexVisitor visitor(key, errors);
-      int written = db->accept_bulk(toRemove, &visitor, true);
+    flushing = true;
+    Schedule(pool, WorkerPool::POINT, EIO_ExecWriteBatch, EIO_AfterWriteBatch, batch);
+  }
 
-      return (written != -1) && errors.empty();
+  // A batch finished. Start the next one or, once nothing is queued,
+  // any waiting closes.
+  void drained() {
+    if (closing.empty()) {
+      scheduleFlush();
     }
-
-    inline int exec() {
-      // Fast path: nothing to index, just run the main op.
-      if (toIndex.empty() && toRemove.empty()) {
-	if (!main_operation()) {
-	  result = wrap->db->error().code();
-	}
-	return 0;
+    else if (!pending.empty()) {
+      flushWrites();
+    }
+    else {
+      for (size_t i = 0; i < closing.size(); i++) {
+	CloseRequest* req = closing[i];
+	Schedule(req->pool(), req->lane(), EIO_ExecClose, EIO_AfterClose, req);
       }
+      closing.clear();
+    }
+  }
+
+  static void OnFlushTimer(EV_P_ ev_timer* timer, int revents) {
+    PolyDBWrap* wrap = static_cast<PolyDBWrap *>(timer->data);
+    if (!wrap->flushing) {
+      wrap->flushWrites();
+    }
+  }
 
-      // Long path: run full transaction, update indicies.
-      return transaction();
+  class WriteBatch {
+  public:
+    PolyDBWrap* wrap;
+    std::vector<IndexedRequest*> ops;
+    double elapsed;
+
+    WriteBatch(PolyDBWrap* wrap):
+      wrap(wrap),
+      elapsed(0)
+    {
+      wrap->Ref();
     }
 
-    inline int transaction() {
+    ~WriteBatch() {
+      wrap->Unref();
+    }
+
+    inline int exec() {
       PolyDB* db = wrap->db;
+      double start = ev_time();
 
       if (!db->begin_transaction()) {
-	result = db->error().code();
-	return 0;
-      }
-
-      if (!main_operation()) {
-	result = db->error().code();
-	db->end_transaction(false);
-	return 0;
+	abort(db->error().code());
       }
-
-      if (!toIndex.empty()) {
-	if (!apply_index()) {
-	  result = db->error().code();
-	  db->end_transaction(false);
-	  return 0;
+      else {
+	bool ok = true;
+	for (size_t i = 0; ok && i < ops.size(); i++) {
+	  ok = ops[i]->apply_grouped();
 	}
-      }
 
-      if (!toRemove.empty()) {
-	if (!cleanup()) {
-	  result = db->error().code();
+	if (!ok) {
+	  PolyDB::Error::Code code = db->error().code();
 	  db->end_transaction(false);
-	  return 0;
+	  abort(code);
+	}
+	else if (!db->end_transaction(true)) {
+	  abort(db->error().code());
 	}
       }
 
-      if (!db->end_transaction(true)) {
-	result = db->error().code();
+      double end = ev_time();
+      for (size_t i = 0; i < ops.size(); i++) {
+	ops[i]->timing.started = start;
+	ops[i]->timing.finished = end;
       }
 
+      elapsed = end - start;
       return 0;
     }
 
-    Local<Value> error() {
-      Local<Value> err = Request::error();
+    // Nothing in the batch was written.
+    inline void abort(PolyDB::Error::Code code) {
+      if (code == PolyDB::Error::SUCCESS) {
+	code = PolyDB::Error::MISC;
+      }
+      for (size_t i = 0; i < ops.size(); i++) {
+	ops[i]->fail(code);
+      }
+    }
 
-      if (!errors.empty()) {
-	if (err->IsNull()) {
-	  err = Exception::Error(String::NewSymbol("index-error"));
-	}
+    inline int after() {
+      WriteStats& stats = wrap->stats;
+      double now = ev_now(EV_DEFAULT_UC);
+      size_t count = ops.size();
 
-	if (invalid_symbol.IsEmpty()) {
-	  invalid_symbol = NODE_PSYMBOL("invalid");
-	}
+      stats.batches += 1;
+      stats.operations += count;
+      stats.commitTime += elapsed;
+      if (count > stats.largest) stats.largest = count;
 
-	Local<Object> obj = err->ToObject();
-	obj->Set(invalid_symbol, MapToObj(errors));
-      }
+      for (size_t i = 0; i < count; i++) {
+	IndexedRequest* req = ops[i];
+	double latency = now - req->queued;
 
-      return err;
-    }
+	stats.latency += latency;
+	if (latency > stats.maxLatency) stats.maxLatency = latency;
 
-    inline int after() {
-      Local<Value> argv[1] = { error() };
-      callback(1, argv);
+	req->after();
+	req->record();
+	delete req;
+      }
+
+      wrap->flushing = false;
+      wrap->drained();
       return 0;
     }
   };
 
-  DEFINE_METHOD(AddIndexed, AddIndexedRequest)
-  class AddIndexedRequest: virtual public IndexedRequest {
-  protected:
-    String::Utf8Value value;
+  static int EIO_ExecWriteBatch(eio_req *ereq) {
+    WriteBatch* batch = static_cast<WriteBatch *>(ereq->data);
+    return batch->exec();
+  }
 
-  public:
+  static int EIO_AfterWriteBatch(eio_req *ereq) {
+    HandleScope scope;
+    WriteBatch* batch = static_cast<WriteBatch *>(ereq->data);
+    ev_unref(EV_DEFAULT_UC);
+    int result = batch->after();
+    delete batch;
+    return result;
+  }
 
-    inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 4
-	      && args[0]->IsString()
-	      && args[1]->IsString()
-	      && (args[2]->IsObject() || args[2]->IsNull())
-	      && args[3]->IsFunction());
-    }
+  // Set the group commit window in milliseconds and the largest
+  // batch size.
+  static Handle<Value> GroupCommit(const Arguments& args) {
+    HandleScope scope;
 
-    AddIndexedRequest(const Arguments& args):
-      IndexedRequest(args, 3),
-      value(args[1]->ToString())
-    {
-      if (!args[2]->IsNull()) {
-	ObjToMap(args[2], toIndex);
-      }
+    if (!(args.Length() >= 2
+	  && args[0]->IsNumber()
+	  && args[1]->IsUint32())) {
+      return THROW_BAD_ARGS;
     }
 
-    bool main_operation() {
-      PolyDB* db = wrap->db;
-      return db->add(*key, key.length(), *value, value.length());
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    wrap->window = args[0]->NumberValue() / 1000;
+    wrap->maxOps = args[1]->Uint32Value();
+
+    // Anything waiting is written under the old settings.
+    if (!wrap->flushing) {
+      wrap->flushWrites();
     }
-  };
 
-  DEFINE_METHOD(ReplaceIndexed, ReplaceIndexedRequest)
-  class ReplaceIndexedRequest: public IndexedRequest {
-  protected:
-    String::Utf8Value value;
+    return args.This();
+  }
 
-  public:
-    inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 5
-	      && args[0]->IsString()
-	      && args[1]->IsString()
-	      && (args[2]->IsObject() || args[2]->IsNull())
-	      && (args[3]->IsArray() || args[3]->IsNull())
-	      && args[4]->IsFunction());
-    }
+  // Group commit statistics; times are in milliseconds. Pass `true`
+  // to reset them.
+  static Handle<Value> GetWriteStats(const Arguments& args) {
+    HandleScope scope;
 
-    ReplaceIndexedRequest(const Arguments& args):
-      IndexedRequest(args, 4),
-      value(args[1]->ToString())
-    {
-      if (!args[2]->IsNull()) {
-	ObjToMap(args[2], toIndex);
-      }
-      if (!args[3]->IsNull()) {
-	ArrayToList(args[3], toRemove);
-      }
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    WriteStats& stats = wrap->stats;
+
+    Local<Object> result = Object::New();
+    result->Set(String::NewSymbol("batches"), Number::New(stats.batches));
+    result->Set(String::NewSymbol("operations"), Number::New(stats.operations));
+    result->Set(String::NewSymbol("largestBatch"), Number::New(stats.largest));
+    result->Set(String::NewSymbol("latency"), Number::New(stats.latency * 1000));
+    result->Set(String::NewSymbol("maxLatency"), Number::New(stats.maxLatency * 1000));
+    result->Set(String::NewSymbol("commitTime"), Number::New(stats.commitTime * 1000));
+    result->Set(String::NewSymbol("pending"), Integer::New(wrap->pending.size()));
+
+    if (args.Length() > 0 && V8_TO_BOOL(args[0])) {
+      memset(&stats, 0, sizeof(stats));
     }
 
-    bool main_operation() {
-      PolyDB* db = wrap->db;
-      return db->replace(*key, key.length(), *value, value.length());
-    }
-  };
+    return scope.Close(result);
+  }
 
-  DEFINE_METHOD(RemoveIndexed, RemoveIndexedRequest)
-  class RemoveIndexedRequest: public IndexedRequest {
-  public:
-    inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 3
-	      && args[0]->IsString()
-	      && (args[1]->IsArray() || args[1]->IsNull())
-	      && args[2]->IsFunction());
+  
+  // ### Worker Pool ###
+
+  // Start a pool of `threads` workers for this database's requests
+  // (see `WorkerPool`). It runs until the database is collected, so
+  // this may only be called once.
+  static Handle<Value> SetWorkerPool(const Arguments& args) {
+    HandleScope scope;
+
+    if (!(args.Length() >= 1 && args[0]->IsUint32())) {
+      return THROW_BAD_ARGS;
     }
 
-    RemoveIndexedRequest(const Arguments& args):
-      IndexedRequest(args, 2)
-    {
-      if (!args[1]->IsNull()) {
-	ArrayToList(args[1], toRemove);
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    uint32_t threads = args[0]->Uint32Value();
+
+    if (wrap->pool) {
+      return ThrowException(Exception::Error(
+        String::New("A worker pool is already running.")));
+    }
+    else if (threads > 0) {
+      wrap->pool = new WorkerPool(threads);
+      if (wrap->pool->size() == 0) {
+	delete wrap->pool;
+	wrap->pool = NULL;
+	return ThrowException(Exception::Error(
+          String::New("Couldn't start worker threads.")));
       }
     }
 
-    bool main_operation() {
-      PolyDB* db = wrap->db;
-      return db->remove(*key, key.length());
+    return args.This();
+  }
+
+  // Queue depths and job counts for each lane, or null without a
+  // pool. Pass `true` to reset the counts.
+  static Handle<Value> GetPoolStats(const Arguments& args) {
+    HandleScope scope;
+
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    if (!wrap->pool) {
+      return scope.Close(LNULL);
     }
-  };
+
+    bool reset = args.Length() > 0 && V8_TO_BOOL(args[0]);
+    return scope.Close(wrap->pool->statsObject(reset));
+  }
+
+  
+  // ### Statistics ###
+
+  // Counts and latency histograms for each operation that's been
+  // used, see `Instruments`. Pass `true` to reset them.
+  static Handle<Value> GetStats(const Arguments& args) {
+    HandleScope scope;
+
+    PolyDBWrap* wrap = ObjectWrap::Unwrap<PolyDBWrap>(args.This());
+    bool reset = args.Length() > 0 && V8_TO_BOOL(args[0]);
+    return scope.Close(wrap->instruments.toObject(reset));
+  }
 
 };
 
 
 // # Cursor #
 
-#define CURSOR_ERROR(cursor)                                            \
-  static_cast<PolyDB *>(cursor->db())->error().code()                   \
-
 class CursorWrap: ObjectWrap {
 private:
   DB::Cursor* cursor;
+  PolyDBWrap* dbWrap;
+  Persistent<Object> dbHandle;
 
 public:
 
@@ -880,24 +4826,31 @@ public:
     NODE_SET_PROTOTYPE_METHOD(ctor, "get", Get);
     NODE_SET_PROTOTYPE_METHOD(ctor, "getKey", GetKey);
     NODE_SET_PROTOTYPE_METHOD(ctor, "getValue", GetValue);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "getBatch", GetBatch);
     NODE_SET_PROTOTYPE_METHOD(ctor, "jump", Jump);
     NODE_SET_PROTOTYPE_METHOD(ctor, "jumpTo", JumpTo);
     NODE_SET_PROTOTYPE_METHOD(ctor, "jumpBack", JumpBack);
     NODE_SET_PROTOTYPE_METHOD(ctor, "jumpBackTo", JumpBackTo);
     NODE_SET_PROTOTYPE_METHOD(ctor, "step", Step);
     NODE_SET_PROTOTYPE_METHOD(ctor, "stepBack", StepBack);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "getSync", GetSync);
+    NODE_SET_PROTOTYPE_METHOD(ctor, "stepSync", StepSync);
 
     target->Set(String::NewSymbol("Cursor"), ctor->GetFunction());
   }
 
   // ## Construction ##
 
-  CursorWrap(DB::Cursor* cur):
-    cursor(cur)
+  // The cursor keeps its database from being collected.
+  CursorWrap(PolyDBWrap* db, Handle<Object> handle):
+    cursor(db->cursor()),
+    dbWrap(db),
+    dbHandle(Persistent<Object>::New(handle))
   {}
 
   ~CursorWrap() {
     delete cursor;
+    dbHandle.Dispose();
   }
 
   static Handle<Value> New(const Arguments& args) {
@@ -905,8 +4858,9 @@ public:
 
     if (args.Length() < 1 && args[0]->IsObject()) return THROW_BAD_ARGS;
 
-    PolyDBWrap* dbWrap = ObjectWrap::Unwrap<PolyDBWrap>(args[0]->ToObject());
-    CursorWrap* cursorWrap = new CursorWrap(dbWrap->cursor());
+    Local<Object> dbObj = args[0]->ToObject();
+    PolyDBWrap* dbWrap = ObjectWrap::Unwrap<PolyDBWrap>(dbObj);
+    CursorWrap* cursorWrap = new CursorWrap(dbWrap, dbObj);
     cursorWrap->Wrap(args.This());
     return args.This();
   }
@@ -915,17 +4869,18 @@ public:
   // ## Async Glue ##
 
   class Request {
-  private:
-    Persistent<String> code_symbol;
-
   protected:
     CursorWrap* wrap;
     Persistent<Function> next;
     PolyDB::Error::Code result;
 
   public:
+    int op;
+    Timing timing;
+
     Request(const Arguments& args, int nextIndex):
-      result(PolyDB::Error::SUCCESS) {
+      result(PolyDB::Error::SUCCESS),
+      op(-1) {
       HandleScope scope;
 
       wrap = ObjectWrap::Unwrap<CursorWrap>(args.This());
@@ -934,11 +4889,27 @@ public:
       wrap->Ref();
     }
 
-    ~Request() {
+    virtual ~Request() {
       wrap->Unref();
       next.Dispose();
     }
 
+    inline WorkerPool* pool() {
+      return wrap->dbWrap->workers();
+    }
+
+    static const char* family() {
+      return "cursor.";
+    }
+
+    inline void record() {
+      wrap->dbWrap->record(op, timing, result);
+    }
+
+    virtual int lane() {
+      return WorkerPool::POINT;
+    }
+
     inline void callback(int argc, Handle<Value> argv[]) {
       TryCatch try_catch;
       next->Call(Context::GetCurrent()->Global(), argc, argv);
@@ -950,49 +4921,53 @@ public:
     Local<Value> error() {
       if (result == PolyDB::Error::SUCCESS)
 	return LNULL;
-
-      const char* name = PolyDB::Error::codename(result);
-      Local<String> message = String::NewSymbol(name);
-      Local<Value> err = Exception::Error(message);
-
-      if (code_symbol.IsEmpty()) {
-	code_symbol = NODE_PSYMBOL("code");
-      }
-
-      Local<Object> obj = err->ToObject();
-      obj->Set(code_symbol, Integer::New(result));
-
-      return err;
+      return KyotoError(result);
     }
   };
 
   
   // ### Get ###
 
+  // The key and value are read together in one allocation. When the
+  // value is returned as a Buffer, the Buffer takes it over.
+
   DEFINE_METHOD(Get, GetRequest)
   class GetRequest: public Request {
   private:
     bool step;
-    std::string key, value;
+    bool asBuffer;
+    Record rec;
 
   public:
 
     inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 2
+      return (args.Length() >= 3
 	      && args[0]->IsBoolean()
-	      && args[1]->IsFunction());
+	      && args[1]->IsBoolean()
+	      && args[2]->IsFunction());
     }
 
     GetRequest(const Arguments& args):
-      Request(args, 1),
-      step(V8_TO_BOOL(args[0]))
-    {}
+      Request(args, 2),
+      step(V8_TO_BOOL(args[0])),
+      asBuffer(V8_TO_BOOL(args[1]))
+    {
+      rec.kbuf = NULL;
+    }
+
+    ~GetRequest() {
+      if (rec.kbuf) delete[] rec.kbuf;
+    }
 
     inline int exec() {
       DB::Cursor* cursor = wrap->cursor;
-      if (!cursor->get(&key, &value, step)) {
+      rec.kbuf = cursor->get(&rec.ksiz, &rec.vbuf, &rec.vsiz, step);
+      if (!rec.kbuf) {
 	result = CURSOR_ERROR(cursor);
       }
+      else {
+	timing.bytesOut = rec.ksiz + rec.vsiz;
+      }
       return 0;
     }
 
@@ -1003,8 +4978,14 @@ public:
       if (result == PolyDB::Error::SUCCESS) {
   	argc = 3;
   	argv[0] = LNULL;
-  	argv[1] = WRAP_STRING(value);
-  	argv[2] = WRAP_STRING(key);
+  	argv[2] = String::New(rec.kbuf, rec.ksiz);
+	if (asBuffer) {
+	  argv[1] = AdoptBuffer(rec.kbuf, rec.vbuf, rec.vsiz);
+	  rec.kbuf = NULL;
+	}
+	else {
+	  argv[1] = String::New(rec.vbuf, rec.vsiz);
+	}
       }
       else {
   	argc = 1;
@@ -1023,24 +5004,34 @@ public:
   class GetKeyRequest: public Request {
   protected:
     bool step;
-    std::string value;
+    bool asBuffer;
+    char* vbuf;
+    size_t vsiz;
 
   public:
 
     inline static bool validate(const Arguments& args) {
-      return (args.Length() >= 2
+      return (args.Length() >= 3
 	      && args[0]->IsBoolean()
-	      && args[1]->IsFunction());
+	      && args[1]->IsBoolean()
+	      && args[2]->IsFunction());
     }
 
     GetKeyRequest(const Arguments& args):
-      Request(args, 1),
-      step(V8_TO_BOOL(args[0]))
+      Request(args, 2),
+      step(V8_TO_BOOL(args[0])),
+      asBuffer(V8_TO_BOOL(args[1])),
+      vbuf(NULL)
     {}
 
+    ~GetKeyRequest() {
+      if (vbuf) delete[] vbuf;
+    }
+
     inline int exec() {
       DB::Cursor* cursor = wrap->cursor;
-      if (!cursor->get_key(&value, step)) {
+      vbuf = cursor->get_key(&vsiz, step);
+      if (!vbuf) {
 	result = CURSOR_ERROR(cursor);
       }
       return 0;
@@ -1053,7 +5044,13 @@ public:
       if (result == PolyDB::Error::SUCCESS) {
   	argc = 2;
   	argv[0] = LNULL;
-  	argv[1] = WRAP_STRING(value);
+	if (asBuffer) {
+	  argv[1] = AdoptBuffer(vbuf, vbuf, vsiz);
+	  vbuf = NULL;
+	}
+	else {
+	  argv[1] = String::New(vbuf, vsiz);
+	}
       }
       else {
   	argc = 1;
@@ -1077,13 +5074,105 @@ public:
 
     inline int exec() {
       DB::Cursor* cursor = wrap->cursor;
-      if (!cursor->get_value(&value, step)) {
+      vbuf = cursor->get_value(&vsiz, step);
+      if (!vbuf) {
 	result = CURSOR_ERROR(cursor);
       }
       return 0;
     }
   };
 
+  
+  // ### Get Batch ###
+
+  // Read up to `limit` records in one job. Reading stops early once
+  // `maxBytes` of keys and values have been collected (zero means no
+  // byte limit). The cursor is stepped between records; `step`
+  // decides whether it's also stepped past the last record read.
+  //
+  // The callback receives parallel arrays of values and keys and a
+  // flag that's true when the end of the database was reached. Values
+  // are Strings unless `asBuffer` is set.
+
+  DEFINE_METHOD(GetBatch, GetBatchRequest)
+  class GetBatchRequest: public Request {
+  protected:
+    uint32_t limit;
+    int64_t maxBytes;
+    bool step;
+    bool asBuffer;
+    RecordList records;
+
+  public:
+
+    inline static bool validate(const Arguments& args) {
+      return (args.Length() >= 5
+	      && args[0]->IsUint32()
+	      && args[1]->IsNumber()
+	      && args[2]->IsBoolean()
+	      && args[3]->IsBoolean()
+	      && args[4]->IsFunction());
+    }
+
+    GetBatchRequest(const Arguments& args):
+      Request(args, 4),
+      limit(args[0]->Uint32Value()),
+      maxBytes(args[1]->IntegerValue()),
+      step(V8_TO_BOOL(args[2])),
+      asBuffer(V8_TO_BOOL(args[3]))
+    {}
+
+    int lane() {
+      return WorkerPool::SCAN;
+    }
+
+    inline int exec() {
+      DB::Cursor* cursor = wrap->cursor;
+      bool more = (limit > 0);
+      Record rec;
+
+      // `limit` comes from Javascript; don't trust it for an allocation.
+      records.items.reserve(std::min(limit, 1024u));
+      while (more) {
+	rec.kbuf = cursor->get(&rec.ksiz, &rec.vbuf, &rec.vsiz, false);
+	if (!rec.kbuf) {
+	  result = CURSOR_ERROR(cursor);
+	  break;
+	}
+
+	records.push(rec);
+	more = (records.size() < limit)
+	  && (maxBytes <= 0 || records.bytes < maxBytes);
+
+	if ((more || step) && !cursor->step()) {
+	  result = CURSOR_ERROR(cursor);
+	  break;
+	}
+      }
+
+      timing.bytesOut = records.bytes;
+      return 0;
+    }
+
+    inline int after() {
+      if (result != PolyDB::Error::SUCCESS && result != PolyDB::Error::NOREC) {
+	Local<Value> argv[1] = { error() };
+	callback(1, argv);
+	return 0;
+      }
+
+      Local<Array> keys = records.keys();
+      Local<Value> argv[4] = {
+	LNULL,
+	records.values(asBuffer),
+	keys,
+	Local<Value>::New(Boolean::New(result == PolyDB::Error::NOREC))
+      };
+      callback(4, argv);
+      return 0;
+    }
+  };
+
   
   // ### Jump ###
 
@@ -1118,19 +5207,19 @@ public:
   DEFINE_METHOD(JumpTo, JumpToRequest)
   class JumpToRequest: public Request {
   protected:
-    String::Utf8Value key;
+    Bytes key;
 
   public:
 
     inline static bool validate(const Arguments& args) {
       return (args.Length() >= 2
-	      && args[0]->IsString()
+	      && Bytes::IsBytes(args[0])
 	      && args[1]->IsFunction());
     }
 
     JumpToRequest(const Arguments& args):
       Request(args, 1),
-      key(args[0]->ToString())
+      key(args[0])
     {}
 
     inline int exec() {
@@ -1229,6 +5318,67 @@ public:
     }
   };
 
+  
+  // ### Sync ###
+
+  // Cursor methods that run on the calling thread, for memory
+  // databases (see `PolyDBWrap::GetSync()`). Don't mix them with
+  // asynchronous requests on the same cursor.
+
+  // Returns `[value, key]`, or undefined at the end.
+  static Handle<Value> GetSync(const Arguments& args) {
+    HandleScope scope;
+
+    if (!(args.Length() >= 2
+	  && args[0]->IsBoolean()
+	  && args[1]->IsBoolean())) {
+      return THROW_BAD_ARGS;
+    }
+
+    static int op = Instruments::Register("cursor.", "GetSync");
+    CursorWrap* wrap = ObjectWrap::Unwrap<CursorWrap>(args.This());
+    Instruments::Probe probe(wrap->dbWrap->instrumentation(), op);
+    DB::Cursor* cursor = wrap->cursor;
+    const char* vbuf;
+    size_t ksiz, vsiz;
+    char* kbuf = cursor->get(&ksiz, &vbuf, &vsiz, V8_TO_BOOL(args[0]));
+
+    if (!kbuf) {
+      probe.result = CURSOR_ERROR(cursor);
+      return scope.Close(SyncMissing(probe.result, Undefined()));
+    }
+
+    probe.timing.bytesOut = ksiz + vsiz;
+
+    Local<Array> result = Array::New(2);
+    result->Set(1, String::New(kbuf, ksiz));
+    if (V8_TO_BOOL(args[1])) {
+      result->Set(0, AdoptBuffer(kbuf, vbuf, vsiz));
+    }
+    else {
+      result->Set(0, String::New(vbuf, vsiz));
+      delete[] kbuf;
+    }
+
+    return scope.Close(result);
+  }
+
+  // Returns false at the end.
+  static Handle<Value> StepSync(const Arguments& args) {
+    HandleScope scope;
+
+    static int op = Instruments::Register("cursor.", "StepSync");
+    CursorWrap* wrap = ObjectWrap::Unwrap<CursorWrap>(args.This());
+    Instruments::Probe probe(wrap->dbWrap->instrumentation(), op);
+    DB::Cursor* cursor = wrap->cursor;
+
+    if (!cursor->step()) {
+      probe.result = CURSOR_ERROR(cursor);
+      return scope.Close(SyncMissing(probe.result, False()));
+    }
+    return True();
+  }
+
 };
 
 
@@ -0,0 +1,116 @@
+var Assert = require('assert'),
+    Binary = require('../../lib/avro/binary'),
+    Registry = require('../../lib/avro/registry').Registry;
+
+module.exports = {
+  'primitives': function() {
+    roundTrip('null', null);
+    roundTrip('boolean', true);
+    roundTrip('boolean', false);
+    roundTrip('string', '');
+    roundTrip('string', 'snowman ☃');
+    roundTrip('double', 3.14159);
+    roundTrip('double', -0.5);
+    roundTrip('float', 1.5);
+  },
+
+  'integers': function() {
+    [0, -1, 1, 63, -64, 64, 300, -300, 2147483647, -2147483648]
+      .forEach(function(n) { roundTrip('int', n); });
+
+    [4294967296, -4294967297, Math.pow(2, 52), -Math.pow(2, 52)]
+      .forEach(function(n) { roundTrip('long', n); });
+
+    Assert.deepEqual(bytes('int', 0), [0x00]);
+    Assert.deepEqual(bytes('int', -1), [0x01]);
+    Assert.deepEqual(bytes('int', 64), [0x80, 0x01]);
+  },
+
+  'special doubles': function() {
+    roundTrip('double', Infinity);
+    roundTrip('double', -Infinity);
+    Assert.ok(isNaN(Binary.decode(define('double'), Binary.encode(define('double'), NaN))));
+  },
+
+  'array and map': function() {
+    roundTrip({ type: 'array', items: 'int' }, []);
+    roundTrip({ type: 'array', items: 'int' }, [1, 2, 3]);
+    roundTrip({ type: 'map', values: 'string' }, {});
+    roundTrip({ type: 'map', values: 'string' }, { a: 'apple', b: 'jack' });
+  },
+
+  'union': function() {
+    var type = define(['int', 'string', null]);
+    roundTrip(type, null);
+    roundTrip(type, { 'int': 1 });
+    roundTrip(type, { 'string': 'one' });
+  },
+
+  'record': function() {
+    var type = define({
+      type: 'record',
+      name: 'Point',
+      fields: [
+        { name: 'x', type: 'double' },
+        { name: 'y', type: 'double' },
+        { name: 'label', type: ['string', null] },
+        { name: 'tags', type: { type: 'array', items: 'string' } }
+      ]
+    });
+
+    roundTrip(type, { x: 1, y: -2.5, label: { 'string': 'origin' }, tags: ['a', 'b'] });
+    roundTrip(type, { x: 0, y: 0, label: null, tags: [] });
+  },
+
+  'appended fields': function() {
+    var old = define({
+      type: 'record',
+      name: 'Item',
+      fields: [{ name: 'name', type: 'string' }]
+    });
+
+    var current = define({
+      type: 'record',
+      name: 'Item',
+      fields: [
+        { name: 'name', type: 'string' },
+        { name: 'count', type: 'int', 'default': 7 }
+      ]
+    });
+
+    var data = Binary.decode(current, Binary.encode(old, { name: 'thing' }));
+    Assert.deepEqual(data, { name: 'thing' });
+    Assert.equal(current.loadJSON(data).count, 7);
+  },
+
+  'truncated': function() {
+    var type = define('string'),
+        buf = Binary.encode(type, 'truncated');
+
+    Assert.throws(function() {
+      Binary.decode(type, buf.slice(0, 4));
+    }, /unexpected end/);
+  }
+};
+
+
+// ## Helpers ##
+
+function define(base, schema) {
+  var reg = new Registry();
+  return reg.define(base, schema);
+}
+
+function roundTrip(type, value) {
+  if (!type.readBinary)
+    type = define(type);
+  Assert.deepEqual(Binary.decode(type, Binary.encode(type, value)), value);
+}
+
+function bytes(type, value) {
+  var buf = Binary.encode(define(type), value),
+      result = [];
+  for (var i = 0; i < buf.length; i++)
+    result.push(buf[i]);
+  return result;
+}
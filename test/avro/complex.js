@@ -1,6 +1,7 @@
 var Assert = require('assert'),
     Schema = require('../../lib/avro/schema'),
-    Registry = require('../../lib/avro/registry').Registry;
+    Registry = require('../../lib/avro/registry').Registry,
+    Complex = require('../../lib/avro/complex');
 
 module.exports = {
   'simple array': function() {
@@ -154,6 +155,49 @@ module.exports = {
       i: { A: { value: 'zeta' } },
       j: { value: 'eta' }
     });
+  },
+
+  'union dispatch': function() {
+    var type = define(['null', 'string']),
+        mixed = define(['null', 'double', 'boolean']);
+
+    Assert.deepEqual(type.__dispatch__, { string: 'string' });
+    Assert.deepEqual(mixed.__dispatch__, { number: 'double', boolean: 'boolean' });
+    Assert.deepEqual(type.exportJSON('x'), { string: 'x' });
+    Assert.deepEqual(mixed.exportJSON(1.5), { double: 1.5 });
+  },
+
+  'generated codecs': function() {
+    var type = define({
+      type: 'record',
+      name: 'Codec',
+      fields: [
+        { name: 'a', type: ['string', 'null'] },
+        { name: 'b', type: ['int', 'double'] },
+        { name: 'c', type: { type: 'array', items: 'string' } }
+      ]
+    });
+
+    var json = { a: { 'string': 'x' }, b: { 'double': 1.5 }, c: ['y'] },
+        compiled = [type.loadJSON(json), type.dumpJSON({ a: 'x', b: 2, c: [] })],
+        interpreted;
+
+    Complex.compileCodecs(false);
+    try {
+      interpreted = [type.loadJSON(json), type.dumpJSON({ a: 'x', b: 2, c: [] })];
+    } finally {
+      Complex.compileCodecs(true);
+    }
+
+    Assert.deepEqual(compiled, interpreted);
+    Assert.deepEqual(compiled[1], { a: { 'string': 'x' }, b: { 'double': 2 }, c: [] });
+    invalid({ a: 1, b: 2, c: [] }, type);
+
+    // Changing a field replaces the codecs.
+    type.modifyField('a', function(field) {
+      field.changeType('string');
+    });
+    Assert.deepEqual(type.dumpJSON({ a: 'x', b: 2, c: [] }), { a: 'x', b: { 'double': 2 }, c: [] });
   }
 
 };
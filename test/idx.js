@@ -24,6 +24,27 @@ var IndexTree = Toji.type('IndexTree', {
   return obj.group || obj;
 });
 
+var IndexTicket = Toji.type('IndexTicket', {
+  id: Toji.ObjectId,
+  status: String,
+  owner: String,
+  title: String
+})
+.addIndex('status')
+.addIndex('owner');
+
+var IndexScore = Toji.type('IndexScore', {
+  id: Toji.ObjectId,
+  score: Number
+})
+.addOrderedIndex('score');
+
+var IndexLate = Toji.type('IndexLate', {
+  id: Toji.ObjectId,
+  code: String,
+  tag: String
+});
+
 module.exports = {
   'setup': function(done) {
     db = Toji.open('*memory*', function(err) {
@@ -350,6 +371,196 @@ module.exports = {
           done();
         });
     }
+  },
+
+  'load falls back to single creates on conflict': function(done) {
+    db.load(loaded, [
+      new IndexData({ id: 'x', letter: 'omega', number: 10 }),
+      new IndexData({ id: 'y', letter: 'omega', number: 11 })
+    ]);
+
+    function loaded(err) {
+      Assert.ok(err);
+      IndexData.find('x', function(err, obj) {
+        if (err) throw err;
+        Assert.equal(obj.letter, 'omega');
+        IndexData.find('y', verifyMissing);
+      });
+    }
+
+    function verifyMissing(err, obj) {
+      Assert.ok(!obj);
+      done();
+    }
+  },
+
+  'queries intersect several plain indexes': function(done) {
+    db.load(loaded, [
+      new IndexTicket({ id: 't1', status: 'open', owner: 'ann', title: 'one' }),
+      new IndexTicket({ id: 't2', status: 'open', owner: 'bob', title: 'two' }),
+      new IndexTicket({ id: 't3', status: 'closed', owner: 'ann', title: 'three' }),
+      new IndexTicket({ id: 't4', status: 'open', owner: 'ann', title: 'four' }),
+      new IndexTicket({ id: 't5', status: 'open', owner: 'ann', title: 'five' })
+    ]);
+
+    function loaded(err) {
+      if (err) throw err;
+      IndexTicket.find({ status: 'open', owner: 'ann' }).all(function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(ids(results), ['t1', 't4', 't5']);
+        filtered();
+      });
+    }
+
+    function filtered() {
+      IndexTicket.find({ status: 'open', owner: 'ann', title: 'four' }).all(function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(ids(results), ['t4']);
+        nothing();
+      });
+    }
+
+    function nothing() {
+      IndexTicket.find({ status: 'closed', owner: 'bob' }).all(function(err, results) {
+        if (err) throw err;
+        Assert.equal(results.length, 0);
+        done();
+      });
+    }
+
+    function ids(results) {
+      return results.map(function(obj) { return obj.id; });
+    }
+  },
+
+  'ordered indexes answer ranges in order': function(done) {
+    db.load(loaded, [
+      new IndexScore({ id: 's1', score: 9 }),
+      new IndexScore({ id: 's2', score: 10 }),
+      new IndexScore({ id: 's3', score: 100 }),
+      new IndexScore({ id: 's4', score: -1 }),
+      new IndexScore({ id: 's5', score: 2.5 })
+    ]);
+
+    function loaded(err) {
+      if (err) throw err;
+      IndexScore.find({ score: { $gt: 2.5, $lte: 100 } }).all(function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(scores(results), [9, 10, 100]);
+        below();
+      });
+    }
+
+    function below() {
+      IndexScore.find({ score: { $lt: 10 } }).all(function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(scores(results), [-1, 2.5, 9]);
+        first();
+      });
+    }
+
+    function first() {
+      IndexScore.find({}).order('score').limit(2).all(function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(scores(results), [-1, 2.5]);
+        exact();
+      });
+    }
+
+    function exact() {
+      IndexScore.find({ score: 10 }).all(function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(scores(results), [10]);
+        done();
+      });
+    }
+
+    function scores(results) {
+      return results.map(function(obj) { return obj.score; });
+    }
+  },
+
+  'saving diffs index entries without reading first': function(done) {
+    IndexScore.find('s1', function(err, obj) {
+      if (err) throw err;
+      db.stats(true);
+      obj.score = 50;
+      obj.save(saved);
+    });
+
+    function saved(err) {
+      if (err) throw err;
+      var stats = db.stats();
+      Assert.equal(stats.replaceDiffed.count, 1);
+      Assert.equal(stats.get, undefined);
+      Assert.equal(stats.getSync, undefined);
+
+      indexState(IndexScore, function(err, state) {
+        if (err) throw err;
+        Assert.deepEqual(Object.keys(state).filter(function(name) {
+          return state[name] == 'IndexScore/s1';
+        }), ['%IndexScore.score<3c049000000000000IndexScore/s1']);
+        done();
+      });
+    }
+  },
+
+  'indexes added later are built and checked': function(done) {
+    db.load(declare, [
+      new IndexLate({ id: 'l1', code: 'x', tag: 'red' }),
+      new IndexLate({ id: 'l2', code: 'y', tag: 'red' }),
+      new IndexLate({ id: 'l3', code: 'x', tag: 'blue' })
+    ]);
+
+    function declare(err) {
+      if (err) throw err;
+      IndexLate.validatesUniquenessOf('code').addIndex('tag');
+      db.buildIndex(IndexLate, 'tag', { batch: 2 }, function(err, report) {
+        if (err) throw err;
+        Assert.equal(report.scanned, 3);
+        Assert.equal(report.changed, 3);
+        db.buildIndex(IndexLate, 'code', built);
+      });
+    }
+
+    function built(err, report) {
+      if (err) throw err;
+      Assert.equal(report.changed, 2);
+      Assert.deepEqual(report.conflicts, [['%IndexLate.code{x}', 'IndexLate/l1']]);
+
+      indexState(IndexLate, function(err, state) {
+        if (err) throw err;
+        Assert.deepEqual(state, {
+          '%IndexLate.code{x}': 'IndexLate/l1',
+          '%IndexLate.code{y}': 'IndexLate/l2',
+          '%IndexLate.tag{blue}IndexLate/l3': 'IndexLate/l3',
+          '%IndexLate.tag{red}IndexLate/l1': 'IndexLate/l1',
+          '%IndexLate.tag{red}IndexLate/l2': 'IndexLate/l2'
+        });
+        db.db.set('%IndexLate.tag{green}IndexLate/l9', 'IndexLate/l9', orphaned);
+      });
+    }
+
+    function orphaned(err) {
+      if (err) throw err;
+      db.checkIndex(IndexLate, 'tag', function(err, report) {
+        if (err) throw err;
+        Assert.equal(report.scanned, 4);
+        Assert.equal(report.changed, 1);
+        db.db.get('%IndexLate.tag{green}IndexLate/l9', function(err, val) {
+          if (err) throw err;
+          Assert.equal(val, undefined);
+          done();
+        });
+      });
+    }
+  },
+
+  'close': function(done) {
+    Toji.close(function(err) {
+      if (err) throw err;
+      done();
+    });
   }
 };
 
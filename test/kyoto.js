@@ -1,5 +1,6 @@
 var Assert = require('assert'),
     Kyoto = require('../lib/kyoto'),
+    Gen = require('../lib/generators'),
     U = require('../lib/util'),
     db, cursor;
 
@@ -76,6 +77,96 @@ module.exports = {
     });
   },
 
+  'get list': function(done) {
+    db.getList(['beta', 'missing', 'alpha', 'beta'], true, function(err, items, keys) {
+      if (err) throw err;
+      Assert.deepEqual(items, ['replaced two', undefined, 'changed one', 'replaced two']);
+      Assert.equal(items.length, 4);
+      Assert.equal(keys.length, 4);
+      done();
+    });
+  },
+
+  'set bulk': function(done) {
+    db.setBulk({ gamma: 'three', delta: 'four' }, function(err, count) {
+      if (err) throw err;
+      Assert.equal(count, 2);
+      removeBulk();
+    });
+
+    function removeBulk() {
+      db.removeBulk(['gamma', 'delta', 'epsilon'], true, function(err, count) {
+        if (err) throw err;
+        Assert.equal(count, 2);
+        allEqual(done, { alpha: 'changed one', beta: 'replaced two' });
+      });
+    }
+  },
+
+  'buffers': function(done) {
+    db.set(new Buffer('gamma'), new Buffer('three'), function(err) {
+      if (err) throw err;
+      db.get('gamma', true, gotValue);
+    });
+
+    function gotValue(err, val) {
+      if (err) throw err;
+      Assert.ok(Buffer.isBuffer(val));
+      Assert.equal(val.toString(), 'three');
+      db.getBulk(['beta', new Buffer('gamma')], false, true, gotBulk);
+    }
+
+    function gotBulk(err, items) {
+      if (err) throw err;
+      Assert.ok(Buffer.isBuffer(items.beta));
+      Assert.equal(items.beta.toString(), 'replaced two');
+      Assert.equal(items.gamma.toString(), 'three');
+      db.remove(new Buffer('gamma'), function(err) {
+        if (err) throw err;
+        done();
+      });
+    }
+  },
+
+  'group commit': function(done) {
+    var results = {};
+
+    db.writeStats(true);
+    db.groupCommit({ window: 5, maxOps: 8 });
+
+    db.addIndexed('k1', 'one', { '%i{x}': 'k1' }, collect('k1'));
+    db.addIndexed('k2', 'two', { '%i{x}': 'k2' }, collect('k2'));
+    db.addIndexed('k3', 'three', { '%i{y}': 'k3' }, collect('k3'));
+
+    function collect(key) {
+      return function(err) {
+        results[key] = err || null;
+        if (Object.keys(results).length == 3)
+          verify();
+      };
+    }
+
+    function verify() {
+      var stats = db.writeStats();
+
+      Assert.equal(results.k1, null);
+      Assert.equal(results.k3, null);
+      Assert.equal(results.k2.message, 'index-error');
+      Assert.deepEqual(results.k2.invalid, { '%i{x}': 'k1' });
+
+      Assert.equal(stats.operations, 3);
+      Assert.ok(stats.batches >= 1 && stats.largestBatch <= 3);
+      Assert.equal(stats.pending, 0);
+
+      db.groupCommit(false);
+      db.removeBulk(['k1', 'k3', '%i{x}', '%i{y}'], function(err, count) {
+        if (err) throw err;
+        Assert.equal(count, 4);
+        done();
+      });
+    }
+  },
+
   'remove': function(done) {
     db.remove('alpha', function(err) {
       if (err) throw err;
@@ -90,6 +181,51 @@ module.exports = {
     });
   },
 
+  'stats': function() {
+    var stats = db.stats();
+
+    Assert.equal(stats.get.count, 2);
+    Assert.equal(stats.get.total.count, 2);
+    Assert.ok(stats.get.total.max >= stats.get.exec.max);
+    Assert.equal(stats.add.errors.DUPREC, 1);
+    Assert.equal(stats.replace.errors.NOREC, 1);
+    Assert.ok(stats.set.count >= 2);
+
+    db.stats(true);
+    Assert.equal(db.stats().get, undefined);
+  },
+
+  'update': function(done) {
+    db.set('doc', JSON.stringify({ n: 1, tags: [] }), function(err) {
+      if (err) throw err;
+      db.update('doc', [['inc', 'n', 2], ['push', 'tags', 'x'], ['set', ['meta', 'votes'], 3]], updated);
+    });
+
+    function updated(err, val) {
+      if (err) throw err;
+      Assert.deepEqual(JSON.parse(val), { n: 3, tags: ['x'], meta: { votes: 3 } });
+      db.update('doc', [['inc', 'n', 1], ['inc', 'tags', 1]], function(err) {
+        Assert.equal(err.message, 'update-invalid');
+        Assert.equal(err.position, 1);
+        db.cas('doc', 'wrong', 'swapped', function(err, swapped) {
+          if (err) throw err;
+          Assert.equal(swapped, false);
+          db.cas('doc', val, 'swapped', swappedDoc);
+        });
+      });
+    }
+
+    function swappedDoc(err, swapped) {
+      if (err) throw err;
+      Assert.equal(swapped, true);
+      db.get('doc', function(err, val) {
+        if (err) throw err;
+        Assert.equal(val, 'swapped');
+        db.remove('doc', done);
+      });
+    }
+  },
+
   'close': function(done) {
     db.close(function(err) {
       if (err) throw err;
@@ -97,6 +233,113 @@ module.exports = {
     });
   },
 
+  'worker pool': function(done) {
+    var pooled = new Kyoto.KyotoDB();
+
+    Assert.equal(pooled.workerPool(2), pooled);
+    pooled.open('/tmp/pool.kct', 'w+', function(err) {
+      if (err) throw err;
+      Assert.throws(function() { pooled.workerPool(4); });
+      pooled.set('key', 'value', function(err) {
+        if (err) throw err;
+        pooled.get('key', function(err, val) {
+          if (err) throw err;
+          Assert.equal(val, 'value');
+
+          var stats = pooled.poolStats();
+          Assert.equal(stats.threads, 2);
+          Assert.equal(stats.point.depth, 0);
+          Assert.equal(stats.scan.depth, 0);
+          pooled.close(done);
+        });
+      });
+    });
+  },
+
+  'close after group commit': function(done) {
+    var grouped = new Kyoto.KyotoDB(),
+        keys = [],
+        written = 0;
+
+    for (var i = 0; i < 10; i++)
+      keys.push('g' + i);
+
+    grouped.groupCommit({ window: 1000, maxOps: 4 });
+    grouped.open('/tmp/group.kct', 'w+', function(err) {
+      if (err) throw err;
+      keys.forEach(function(key) {
+        var index = {};
+        index['%i{' + key + '}'] = key;
+        grouped.addIndexed(key, 'value', index, function(err) {
+          if (err) throw err;
+          written++;
+        });
+      });
+
+      Assert.throws(function() { grouped.closeSync(); });
+      grouped.close(closed);
+    });
+
+    function closed(err) {
+      if (err) throw err;
+      Assert.equal(written, keys.length);
+      grouped.open('/tmp/group.kct', 'r', function(err) {
+        if (err) throw err;
+        grouped.getList(keys, false, false, function(err, values) {
+          if (err) throw err;
+          Assert.deepEqual(values, keys.map(function() { return 'value'; }));
+          grouped.close(done);
+        });
+      });
+    }
+  },
+
+  'snapshot': function(done) {
+    var source = new Kyoto.KyotoDB(),
+        copy = new Kyoto.KyotoDB(),
+        reported = 0;
+
+    source.open('/tmp/snapshot.kct', 'w+', function(err) {
+      if (err) throw err;
+      source.setBulk({ a: '1', b: '2', c: '3' }, function(err) {
+        if (err) throw err;
+        source.dumpSnapshot('/tmp/snapshot.kcss', { compress: true, progress: progress }, dumped);
+      });
+    });
+
+    function progress(count, total) {
+      reported = count;
+    }
+
+    function dumped(err) {
+      if (err) throw err;
+      Assert.equal(reported, 3);
+      copy.open('+', 'w+', function(err) {
+        if (err) throw err;
+        copy.loadSnapshot('/tmp/snapshot.kcss', loaded);
+      });
+    }
+
+    function loaded(err) {
+      if (err) throw err;
+      copy.getBulk(['a', 'b', 'c'], function(err, items) {
+        if (err) throw err;
+        Assert.deepEqual(items, { a: '1', b: '2', c: '3' });
+        copy.appendSorted(['d', 'f', 'e'], ['4', '6', '5'], appended);
+      });
+    }
+
+    function appended(err, count) {
+      Assert.equal(err.message, 'load-unsorted');
+      Assert.equal(err.position, 2);
+      Assert.equal(count, 2);
+      copy.close(function(err) {
+        if (err) throw err;
+        source.close(done);
+      });
+    }
+  },
+
   'cursor tests': function(done) {
     db = Kyoto.open('+', 'w+', function(err) {
       if (err) throw err;
@@ -196,6 +439,154 @@ module.exports = {
     }
   },
 
+  'cursor get batch': function(done) {
+    cursor.jump(function(err) {
+      if (err) throw err;
+      cursor.getBatch(3, gotFirst);
+    });
+
+    function gotFirst(err, vals, keys, end) {
+      if (err) throw err;
+      Assert.deepEqual(keys, ['aardvark', 'active', 'air']);
+      Assert.deepEqual(vals, ['4', '6', '5']);
+      Assert.ok(!end);
+      cursor.getBatch(10, gotRest);
+    }
+
+    function gotRest(err, vals, keys, end) {
+      if (err) throw err;
+      Assert.deepEqual(keys, ['allow', 'alpha', 'api', 'apple', 'arrest']);
+      Assert.ok(end);
+      done();
+    }
+  },
+
+  'cursor get buffers': function(done) {
+    cursor.jump(function(err) {
+      if (err) throw err;
+      cursor.get(false, true, gotFirst);
+    });
+
+    function gotFirst(err, val, key) {
+      if (err) throw err;
+      Assert.equal(key, 'aardvark');
+      Assert.ok(Buffer.isBuffer(val));
+      Assert.equal(val.toString(), '4');
+      cursor.getBatch(2, 0, true, true, gotBatch);
+    }
+
+    function gotBatch(err, vals, keys, end) {
+      if (err) throw err;
+      Assert.deepEqual(keys, ['aardvark', 'active']);
+      Assert.deepEqual(vals.map(String), ['4', '6']);
+      Assert.ok(Buffer.isBuffer(vals[1]));
+      done();
+    }
+  },
+
+  'scan range': function(done) {
+    db.scanRange({ start: 'act', end: 'am' }, function(err, vals, keys, more) {
+      if (err) throw err;
+      Assert.deepEqual(keys, ['active', 'air', 'allow', 'alpha']);
+      Assert.deepEqual(vals, ['6', '5', '8', '1']);
+      Assert.ok(!more);
+      prefix();
+    });
+
+    function prefix() {
+      db.scanRange({ prefix: 'ap', keysOnly: true }, function(err, vals, keys, more) {
+        if (err) throw err;
+        Assert.deepEqual(keys, ['api', 'apple']);
+        Assert.ok(!more);
+        limited();
+      });
+    }
+
+    function limited() {
+      db.scanRange({ prefix: 'a', limit: 2 }, function(err, vals, keys, more) {
+        if (err) throw err;
+        Assert.deepEqual(keys, ['aardvark', 'active']);
+        Assert.ok(more);
+        done();
+      });
+    }
+  },
+
+  'generate range': function(done) {
+    var seen = [];
+
+    Gen.each(db.generateRange({ prefix: 'al' }, finished), function(val, key) {
+      seen.push(key);
+    });
+
+    function finished(err) {
+      if (err) throw err;
+      Assert.deepEqual(seen, ['allow', 'alpha']);
+      done();
+    }
+  },
+
+  'read stream': function(done) {
+    var stream = db.createReadStream({ prefix: 'a', highWaterMark: 2 }),
+        seen = [];
+
+    stream.on('data', function(item) {
+      seen.push(item.key + '=' + item.value);
+      if (seen.length == 1) {
+        stream.pause();
+        setTimeout(function() { stream.resume(); }, 10);
+      }
+    });
+
+    stream.on('error', function(err) {
+      throw err;
+    });
+
+    stream.on('end', function() {
+      Assert.deepEqual(seen, ['aardvark=4', 'active=6', 'air=5', 'allow=8', 'alpha=1', 'api=3', 'apple=2', 'arrest=7']);
+      keys();
+    });
+
+    function keys() {
+      var seen = [];
+      db.createReadStream({ start: 'api', keysOnly: true })
+        .on('data', function(key) { seen.push(key); })
+        .on('end', function() {
+          Assert.equal(seen[0], 'api');
+          Assert.equal(seen[1], 'apple');
+          done();
+        });
+    }
+  },
+
+  'sync methods': function(done) {
+    Assert.ok(db.inMemory);
+
+    db.setSync('sync', 'value');
+    Assert.equal(db.getSync('sync'), 'value');
+    Assert.equal(db.getSync('sync', true).toString(), 'value');
+    Assert.equal(db.getSync('missing'), undefined);
+    Assert.deepEqual(db.getBulkSync(['sync', 'missing']), { sync: 'value' });
+    Assert.deepEqual(db.getListSync(['missing', 'sync']), [undefined, 'value']);
+    Assert.equal(db.removeSync('sync'), true);
+    Assert.equal(db.removeSync('sync'), false);
+
+    var cursor = db.cursor(),
+        sameTick = true;
+
+    cursor.jump(function(err) {
+      if (err) throw err;
+      Assert.deepEqual(cursor.getSync(true), ['4', 'aardvark']);
+      Assert.equal(cursor.stepSync(), true);
+      db.remove('sync', function(err) {
+        Assert.equal(err && err.code, Kyoto.NOREC);
+        Assert.ok(!sameTick);
+        done();
+      });
+      sameTick = false;
+    });
+  },
+
   'cursor jump back': function(done) {
     cursor.jumpBack(function(err) {
       if (err) throw err;
@@ -342,8 +342,14 @@ module.exports = {
     Assert.deepEqual(item.dumpJSON(), { a: { 'double': 1 }, b: { 'double': 5 }, c: { 'double': 3 }, d: { 'double': 6 } });
 
     done();
-  }
+  },
 
+  'close': function(done) {
+    Toji.close(function(err) {
+      if (err) throw err;
+      done();
+    });
+  }
 };
 
 
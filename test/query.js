@@ -1,6 +1,7 @@
 var Assert = require('assert'),
     Toji = require('../lib/index'),
     Query = require('../lib/query'),
+    ObjectCache = require('../lib/cache').ObjectCache,
     U = require('../lib/util'),
     db;
 
@@ -15,6 +16,17 @@ var Tree = Toji.type('QueryTree', {
   children: [Toji.ref(Data)]
 });
 
+var Nest = Toji.type('QueryNest', {
+  tree: Toji.ref(Tree)
+});
+
+var Stat = Toji.type('QueryStat', {
+  kind: String,
+  size: Number
+})
+.addIndex('kind')
+.addOrderedIndex('size');
+
 module.exports = {
   'open': function(done) {
     db = Toji.open('*memory*', function(err) {
@@ -119,6 +131,19 @@ module.exports = {
       });
   },
 
+  'stream': function(done) {
+    var names = [];
+
+    Data.find({}).json().stream()
+      .on('data', function(line) {
+        names.push(JSON.parse(line).name);
+      })
+      .on('end', function() {
+        Assert.deepEqual(names.sort(), ['alpha', 'beta', 'delta', 'gamma']);
+        done();
+      });
+  },
+
   'by attribute': function(done) {
     Data.find({ value: 'three' }).all(function(err, results) {
       if (err) throw err;
@@ -163,6 +188,24 @@ module.exports = {
       });
   },
 
+  'select': function(done) {
+    Data.find({ value: /^t/ })
+      .select('name')
+      .order('-value')
+      .all(function(err, results) {
+        if (err) throw err;
+        assertResults(results, ['beta', 'gamma']);
+        Assert.equal(results[0].value, 'two');
+        Assert.equal(results[0].when, undefined);
+        Assert.ok(results[0].__partial__);
+        Assert.throws(function() { Data.find({}).select('nope'); });
+        results[0].save(function(err) {
+          Assert.ok(/partial/.test(err.message));
+          done();
+        });
+      });
+  },
+
   'order ascending': function(done) {
     Data.find({})
       .order('value')
@@ -183,6 +226,30 @@ module.exports = {
       });
   },
 
+  'order with limit': function(done) {
+    Data.find({})
+      .order('value')
+      .slice(1, 3)
+      .all(function(err, results) {
+        if (err) throw err;
+        assertResults(results, ['alpha', 'gamma']);
+        done();
+      });
+  },
+
+  'order spills past the sort buffer': function(done) {
+    db.sortBuffer = 3;
+
+    Data.find({})
+      .order('-when')
+      .all(function(err, results) {
+        db.sortBuffer = undefined;
+        if (err) throw err;
+        assertResults(results, ['delta', 'gamma', 'beta', 'alpha']);
+        done();
+      });
+  },
+
   'include': function(done) {
     Data.find({}, function(err, results) {
       if (err) throw err;
@@ -227,6 +294,172 @@ module.exports = {
         Assert.ok(results[0].children[0] instanceof Data);
         done();
       });
+  },
+
+  'include batches references': function(done) {
+    Tree.find({}).one(function(err, tree) {
+      if (err) throw err;
+      db.load(loaded, [
+        new Nest({ tree: tree }),
+        new Nest({ tree: tree })
+      ]);
+    });
+
+    function loaded(err) {
+      if (err) throw err;
+      db.stats(true);
+      Nest.find({})
+        .include('tree.self', 'tree.children')
+        .all(function(err, results) {
+          if (err) throw err;
+          Assert.equal(results.length, 2);
+          Assert.strictEqual(results[0].tree, results[1].tree);
+          Assert.ok(results[0].tree.self instanceof Data);
+          Assert.ok(results[0].tree.children[2] instanceof Data);
+
+          var stats = db.stats();
+          Assert.equal(stats.getListSync.count, 2);
+          Assert.equal(stats.getSync, undefined);
+          done();
+        });
+    }
+  },
+
+  'include leaves cached objects alone': function(done) {
+    db.cache = new ObjectCache();
+    Nest.find({})
+      .include('tree.self')
+      .one(function(err, nest) {
+        if (err) throw err;
+        Assert.ok(nest.tree.self instanceof Data);
+        db.get(nest.tree.__key__(), function(err, tree) {
+          db.cache = null;
+          if (err) throw err;
+          Assert.ok(typeof tree.self == 'string');
+          done();
+        });
+      });
+  },
+
+  'aggregates': function(done) {
+    db.load(loaded, [
+      new Stat({ kind: 'a', size: 2 }),
+      new Stat({ kind: 'a', size: 5 }),
+      new Stat({ kind: 'b', size: 1.5 }),
+      new Stat({ kind: 'b' })
+    ]);
+
+    function loaded(err) {
+      if (err) throw err;
+      db.stats(true);
+      Stat.find({}).count(function(err, count) {
+        if (err) throw err;
+        Assert.equal(count, 4);
+        Stat.find({}).sum('size', function(err, sum) {
+          if (err) throw err;
+          Assert.equal(sum, 8.5);
+          Stat.find({}).countBy('kind', function(err, groups) {
+            if (err) throw err;
+            Assert.deepEqual(groups, { a: 2, b: 2 });
+            Stat.find({}).countBy('size', function(err, groups) {
+              if (err) throw err;
+              Assert.deepEqual(groups, { '1.5': 1, '2': 1, '5': 1 });
+              native();
+            });
+          });
+        });
+      });
+    }
+
+    function native() {
+      var stats = db.stats();
+      Assert.equal(stats.aggregate.count, 4);
+      Assert.equal(stats.scanRange, undefined);
+
+      Stat.find({ kind: 'a' }).count(function(err, count) {
+        if (err) throw err;
+        Assert.equal(count, 2);
+        Stat.find({ size: { $gte: 2 } }).limit(1).count(function(err, count) {
+          if (err) throw err;
+          Assert.equal(count, 1);
+          filtered();
+        });
+      });
+    }
+
+    function filtered() {
+      Stat.find({ kind: 'b', size: null }).count(function(err, count) {
+        if (err) throw err;
+        Assert.equal(count, 1);
+        Stat.find({ kind: 'a' }).max('size', function(err, max) {
+          if (err) throw err;
+          Assert.equal(max, 5);
+          Data.find({ value: /^t/ }).min('name', function(err, min) {
+            if (err) throw err;
+            Assert.equal(min, 'beta');
+            Assert.throws(function() { Stat.find({}).sum('kind', done); });
+            done();
+          });
+        });
+      });
+    }
+  },
+
+  'order agrees across sort paths': function(done) {
+    Stat.find({}).order('-size').all(function(err, results) {
+      if (err) throw err;
+      Assert.deepEqual(sizes(results), [5, 2, 1.5, null]);
+      db.sortBuffer = 2;
+      Stat.find({}).order('-size').all(spilled);
+    });
+
+    function spilled(err, results) {
+      db.sortBuffer = undefined;
+      if (err) throw err;
+      Assert.deepEqual(sizes(results), [5, 2, 1.5, null]);
+      Stat.find({}).order('size').all(function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(sizes(results), [null, 1.5, 2, 5]);
+        Stat.find({}).order('kind', 'size').limit(3).all(limited);
+      });
+    }
+
+    function limited(err, results) {
+      if (err) throw err;
+      Assert.deepEqual(sizes(results), [2, 5, null]);
+      done();
+    }
+
+    function sizes(results) {
+      return results.map(function(obj) {
+        return (obj.size === undefined) ? null : obj.size;
+      });
+    }
+  },
+
+  'ranges agree across paths': function(done) {
+    var range = { $gte: null, $lt: 2 };
+
+    Stat.find({ size: range }).all(function(err, indexed) {
+      if (err) throw err;
+      Assert.equal(indexed.length, 2);
+      Stat.find({ kind: 'b', size: range }).all(function(err, filtered) {
+        if (err) throw err;
+        Assert.equal(filtered.length, 2);
+        Stat.find({ kind: 'a', size: { $gt: '1' } }).count(function(err, count) {
+          if (err) throw err;
+          Assert.equal(count, 0);
+          done();
+        });
+      });
+    });
+  },
+
+  'close': function(done) {
+    Toji.close(function(err) {
+      if (err) throw err;
+      done();
+    });
   }
 };
 
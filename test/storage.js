@@ -1,7 +1,11 @@
 var Assert = require('assert'),
+    Fs = require('fs'),
     Toji = require('../lib/index'),
     Storage = require('../lib/storage'),
     Query = require('../lib/query'),
+    Key = require('../lib/key'),
+    Update = require('../lib/update'),
+    ObjectCache = require('../lib/cache').ObjectCache,
     db;
 
 var Data = Toji.type('ExampleData', {
@@ -9,6 +13,25 @@ var Data = Toji.type('ExampleData', {
   value: String
 });
 
+var Counter = Toji.type('ExampleCounter', {
+  name: Toji.ObjectId,
+  status: String,
+  hits: Number,
+  tags: [String]
+})
+.addIndex('status');
+
+var Late = Toji.type('ExampleLate', {
+  name: Toji.ObjectId,
+  code: String
+});
+
+var Tally = Toji.type('ExampleTally', {
+  name: Toji.ObjectId,
+  count: 'int',
+  total: 'long'
+});
+
 module.exports = {
   'open': function(done) {
     db = (new Storage.Storage('/tmp'))
@@ -144,6 +167,40 @@ module.exports = {
     });
   },
 
+  'update': function(done) {
+    db.create(new Counter({ name: 'page' }), function(err, obj) {
+      if (err) throw err;
+      db.update(obj, { $inc: { hits: 2 }, $push: { tags: 'new' } }, counted);
+    });
+
+    function counted(err, obj) {
+      if (err) throw err;
+      Assert.equal(obj.hits, 2);
+      Assert.deepEqual(obj.tags, ['new']);
+      db.update(obj, { $inc: { hits: 1 }, $set: { status: 'open' } }, indexed);
+    }
+
+    function indexed(err, obj) {
+      if (err) throw err;
+      Assert.equal(obj.hits, 3);
+      db.find(Counter, { status: 'open' }, function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(results.map(function(o) { return o.name; }), ['page']);
+        done();
+      });
+    }
+  },
+
+  'failed batch keeps no generated ids': function(done) {
+    var fresh = new Counter({ status: 'new' });
+
+    db.createBatch([new Counter({ name: 'page' }), fresh], function(err) {
+      Assert.ok(/Duplicate key/.test(err.message));
+      Assert.ok(!fresh.__hasKey__());
+      done();
+    });
+  },
+
   'close': function(done) {
     db.close(function(err) {
       if (err) throw err;
@@ -152,10 +209,315 @@ module.exports = {
   },
 
   'on memory': function(done) {
-    (new Storage.Storage('*memory*')).open(function(err) {
+    var mdb = new Storage.Storage('*memory*');
+
+    mdb.open(function(err) {
       if (err) throw err;
-      done();
+      mdb.close(done);
+    });
+  },
+
+  'avro format': function(done) {
+    var adb = new Storage.Storage('*memory*', { format: 'avro' });
+
+    adb.open(function(err) {
+      if (err) throw err;
+      adb.load(loaded, [
+        new Data({ name: 'alpha', value: 'apple' }),
+        new Data({ name: 'beta' })
+      ]);
+    });
+
+    function loaded(err) {
+      if (err) throw err;
+      adb.db.get('ExampleData/alpha', true, function(err, raw) {
+        if (err) throw err;
+        Assert.ok(Buffer.isBuffer(raw));
+        Assert.equal(raw[0], 0);
+        adb.get('ExampleData/alpha', gotAlpha);
+      });
+    }
+
+    function gotAlpha(err, obj) {
+      if (err) throw err;
+      Assert.ok(obj instanceof Data);
+      Assert.equal(obj.value, 'apple');
+      adb.db.set('ExampleData/gamma', JSON.stringify({ name: 'gamma', value: { 'string': 'grape' } }), mixed);
+    }
+
+    function mixed(err) {
+      if (err) throw err;
+      adb.find(Data, {}, function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(results.map(function(o) { return o.name + ':' + o.value; }),
+                         ['alpha:apple', 'beta:null', 'gamma:grape']);
+        adb.close(done);
+      });
+    }
+  },
+
+  'update increments': function() {
+    Assert.deepEqual(Update.compile(Tally, { $inc: { total: 2 } }), [['inc', ['total', 'long'], 2]]);
+    Assert.equal(Update.compile(Tally, { $inc: { count: 1 } }), null);
+    Assert.throws(function() { Update.compile(Tally, { $inc: { count: 1.5 } }); });
+    Assert.throws(function() { Update.compile(Tally, { $inc: { total: 0.5 } }); });
+  },
+
+  'concurrent avro updates': function(done) {
+    var adb = new Storage.Storage('*memory*', { format: 'avro' }),
+        pending = 5;
+
+    adb.open(function(err) {
+      if (err) throw err;
+      adb.create(new Counter({ name: 'page', hits: 0 }), created);
+    });
+
+    function created(err, obj) {
+      if (err) throw err;
+      for (var i = 0; i < 5; i++)
+        adb.update(obj, { $inc: { hits: 1 } }, counted);
+    }
+
+    function counted(err) {
+      if (err) throw err;
+      if (--pending == 0)
+        adb.get('ExampleCounter/page', function(err, obj) {
+          if (err) throw err;
+          Assert.equal(obj.hits, 5);
+          adb.close(done);
+        });
+    }
+  },
+
+  'object cache': function(done) {
+    var cdb = new Storage.Storage('*memory*', { cache: { entries: 2 } }),
+        first;
+
+    cdb.open(function(err) {
+      if (err) throw err;
+      cdb.load(loaded, [
+        new Data({ name: 'alpha', value: 'one' }),
+        new Data({ name: 'beta', value: 'two' }),
+        new Data({ name: 'gamma', value: 'three' })
+      ]);
     });
+
+    function loaded(err) {
+      if (err) throw err;
+      cdb.get('ExampleData/alpha', function(err, obj) {
+        if (err) throw err;
+        first = obj;
+        cdb.get('ExampleData/alpha', gotAgain);
+      });
+    }
+
+    function gotAgain(err, obj) {
+      if (err) throw err;
+      Assert.notStrictEqual(obj, first);
+      Assert.deepEqual(obj.json(), first.json());
+      Assert.deepEqual(cdb.cacheStats(), { entries: 1, bytes: cdb.cache.bytes, hits: 1, misses: 1, evictions: 0 });
+      obj.value = 'changed';
+      cdb.get('ExampleData/alpha', function(err, again) {
+        if (err) throw err;
+        Assert.equal(again.value, 'one');
+        cdb.save(obj, saved);
+      });
+    }
+
+    function saved(err) {
+      if (err) throw err;
+      Assert.equal(cdb.cacheStats().entries, 0);
+      cdb.get('ExampleData/alpha', function(err, obj) {
+        if (err) throw err;
+        Assert.notStrictEqual(obj, first);
+        Assert.equal(obj.value, 'changed');
+        cdb.get('ExampleData/beta', function(err) {
+          if (err) throw err;
+          cdb.get('ExampleData/gamma', evicted);
+        });
+      });
+    }
+
+    function evicted(err, obj) {
+      if (err) throw err;
+      var stats = cdb.cacheStats();
+      Assert.equal(obj.value, 'three');
+      Assert.equal(stats.entries, 2);
+      Assert.equal(stats.evictions, 1);
+      Assert.equal(stats.misses, 4);
+      cdb.close(done);
+    }
+  },
+
+  'partial copies fields': function() {
+    var store = new Storage.Storage('*memory*'),
+        whole = new Counter({ name: 'page', status: 'open', tags: ['a'] }),
+        part = store.partial(whole, ['tags']);
+
+    Assert.ok(part.__partial__);
+    Assert.equal(part.name, 'page');
+    Assert.deepEqual(part.tags, ['a']);
+    part.tags.push('b');
+    Assert.deepEqual(whole.tags, ['a']);
+  },
+
+  'object cache evicts by bytes': function() {
+    var cache = new ObjectCache({ entries: 3, bytes: 100 });
+
+    ['a', 'b', 'c', 'd'].forEach(function(key) {
+      cache.put(key, key, 60);
+    });
+    Assert.deepEqual(cache.stats(), { entries: 1, bytes: 60, hits: 0, misses: 0, evictions: 3 });
+
+    cache.put('e', 'e', 10);
+    cache.put('f', 'f', 10);
+    Assert.equal(cache.stats().entries, 3);
+    Assert.equal(cache.stats().bytes, 80);
+    Assert.equal(cache.get('e'), 'e');
+
+    cache.put('g', 'g', 10);
+    Assert.equal(cache.stats().entries, 3);
+    Assert.equal(cache.get('d'), undefined);
+    Assert.equal(cache.get('g'), 'g');
+  },
+
+  'load sorted': function(done) {
+    var sdb = new Storage.Storage('*memory*');
+
+    sdb.open(function(err) {
+      if (err) throw err;
+      sdb.loadSorted([
+        new Counter({ name: 'b', status: 'open' }),
+        new Counter({ name: 'a', status: 'closed' }),
+        new Counter({ name: 'c', status: 'open' })
+      ], loaded);
+    });
+
+    function loaded(err) {
+      if (err) throw err;
+      sdb.find(Counter, { status: 'open' }, function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(results.map(function(o) { return o.name; }).sort(), ['b', 'c']);
+        sdb.loadSorted([new Counter({ name: 'a' })], function(err) {
+          Assert.equal(err.message, 'load-unsorted');
+          sdb.close(done);
+        });
+      });
+    }
+  },
+
+  'compact keys': function(done) {
+    var cdb = new Storage.Storage('*memory*', { keys: 'compact' });
+
+    cdb.open(function(err) {
+      if (err) throw err;
+      Assert.ok(cdb.keyFormat.compact);
+      cdb.load(loaded, [
+        new Counter({ name: 'a', status: 'open' }),
+        new Counter({ name: 'b', status: 'closed' }),
+        new Counter({ name: 'c', status: 'open' })
+      ]);
+    });
+
+    function loaded(err) {
+      if (err) throw err;
+      var format = cdb.keyFormat,
+          key = Key.make(Counter, 'a').toString(format);
+      Assert.equal(key, Key.prefix(Counter, format) + 'a');
+      Assert.ok(key.length < 'ExampleCounter/a'.length);
+      Assert.equal(Key.parse(key, format).kind, 'ExampleCounter');
+      Assert.equal(Key.parse(key, format).id, 'a');
+
+      cdb.find(Counter, { status: 'open' }, function(err, results) {
+        if (err) throw err;
+        Assert.deepEqual(results.map(function(o) { return o.name; }), ['a', 'c']);
+        cdb.db.scanRange({ prefix: '\u0000' }, function(err, vals, keys) {
+          if (err) throw err;
+          Assert.deepEqual(keys, ['\u0000ExampleCounter', '\u0000ExampleCounter.status']);
+          alongside();
+        });
+      });
+    }
+
+    // A database with plain keys can be open at the same time.
+    function alongside() {
+      var pdb = new Storage.Storage('*memory*');
+
+      pdb.open(function(err) {
+        if (err) throw err;
+        Assert.ok(!pdb.keyFormat.compact);
+        pdb.create(new Counter({ name: 'a', status: 'open' }), function(err) {
+          if (err) throw err;
+          pdb.db.get('ExampleCounter/a', function(err, data) {
+            if (err) throw err;
+            Assert.ok(data);
+            cdb.findById(Counter, 'a', function(err, obj) {
+              if (err) throw err;
+              Assert.equal(obj.status, 'open');
+              pdb.close(function(err) {
+                if (err) throw err;
+                cdb.close(done);
+              });
+            });
+          });
+        });
+      });
+    }
+  },
+
+  // The index's tag is new when it's built, so it has to be saved for
+  // the entries to be found after reopening.
+  'build index on reopened compact keys': function(done) {
+    var folder = '/tmp/compact',
+        cdb;
+
+    try { Fs.mkdirSync(folder, 0755); } catch (x) {}
+    cdb = new Storage.Storage(folder, { keys: 'compact' });
+    cdb.open('w+', function(err) {
+      if (err) throw err;
+      cdb.load(loaded, [
+        new Late({ name: 'a', code: 'x' }),
+        new Late({ name: 'b', code: 'y' })
+      ]);
+    });
+
+    function loaded(err) {
+      if (err) throw err;
+      reopen(function() {
+        Late.addIndex('code');
+        cdb.buildIndex(Late, 'code', built);
+      });
+    }
+
+    function built(err, report) {
+      if (err) throw err;
+      Assert.equal(report.changed, 2);
+      reopen(function() {
+        cdb.db.scanRange({ prefix: '\u0000' }, function(err, vals, keys) {
+          if (err) throw err;
+          Assert.deepEqual(keys, ['\u0000ExampleLate', '\u0000ExampleLate.code']);
+          cdb.find(Late, { code: 'x' }, found);
+        });
+      });
+    }
+
+    function found(err, results) {
+      if (err) throw err;
+      Assert.deepEqual(results.map(function(o) { return o.name; }), ['a']);
+      cdb.close(done);
+    }
+
+    function reopen(next) {
+      cdb.close(function(err) {
+        if (err) throw err;
+        cdb = new Storage.Storage(folder);
+        cdb.open(function(err) {
+          if (err) throw err;
+          Assert.ok(cdb.keyFormat.compact);
+          next();
+        });
+      });
+    }
   },
 
   'tuning parameters': function(done) {